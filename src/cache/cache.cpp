@@ -1,8 +1,17 @@
 #include "cache.h"
+#include "frequency_sketch.h"
+#include "handle_table.h"
+#include "secondary_cache.h"
+#include "slab_allocator.h"
 #include "thread_annotation.h"
 #include "hash.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <mutex>
+#include <vector>
 #include <iostream>
 
 namespace ns_cache {
@@ -12,12 +21,17 @@ namespace {
 struct LRUHandle {
     void *value;
     DeleteFunc deleter;
+    void *deleter_arg;
+    CacheItemHelper const *helper; // nullptr unless the entry may be spilled to a secondary cache.
     LRUHandle *next_hash;
     LRUHandle *next;
     LRUHandle *prev;
     uint64_t charge;
-    uint64_t key_length;
+    uint32_t key_length;
     bool in_cache;       // Whether entry is in the cache list.
+    bool is_high_pri;    // Inserted with Cache::Priority::kHigh.
+    bool has_hit;        // Has been returned by Lookup() at least once.
+    bool in_high_pri_pool; // Whether entry sits in the high-priority part of lru_.
     uint32_t refs;       // References, including cache reference, if present.
     uint32_t hash;       // Hash of key(); used for fast sharding and comparisons
     uint8_t key_data[1]; // Beginning of key
@@ -28,15 +42,20 @@ struct LRUHandle {
         prev = nullptr;
     }
 
-    LRUHandle(void *v, DeleteFunc const &del, uint64_t c, ns_data_structure::Slice const &key, uint32_t h) {
+    LRUHandle(void *v, DeleteFunc del, void *del_arg, uint64_t c, ns_data_structure::Slice const &key, uint32_t h) {
         value = v;
         deleter = del;
+        deleter_arg = del_arg;
+        helper = nullptr;
         next_hash = nullptr;
         next = nullptr;
         prev = nullptr;
         charge = c;
         key_length = key.size();
         in_cache = false;
+        is_high_pri = false;
+        has_hit = false;
+        in_high_pri_pool = false;
         refs = 1; // for the returned handle.
         hash = h;
         std::memcpy(key_data, key.data(), key.size());
@@ -46,132 +65,124 @@ struct LRUHandle {
         assert(next != this);
         return ns_data_structure::Slice(key_data, key_length);
     }
-};
-// We provide our own simple hash table since it removes a whole bunch
-// of porting hacks and is also faster than some of the built-in hash
-// table implementations in some of the compiler/runtime combinations
-// we have tested.  E.g., readrandom speeds up by ~5% over the g++
-// 4.4.3's builtin hashtable.
-class HandleTable {
-public:
-    HandleTable() :
-        length_(0), elems_(0), list_(nullptr) {
-        Resize();
-    }
-    ~HandleTable() {
-        delete[] list_;
-    }
-
-    LRUHandle *Lookup(ns_data_structure::Slice const &key, uint32_t hash) {
-        return *FindPointer(key, hash);
-    }
 
-    LRUHandle *Insert(LRUHandle *h) {
-        LRUHandle **ptr = FindPointer(h->key(), h->hash);
-        LRUHandle *old = *ptr;
-        h->next_hash = (old == nullptr ? nullptr : old->next_hash);
-        *ptr = h;
-        if (old == nullptr) {
-            ++elems_;
-            if (elems_ > length_) {
-                Resize();
-            }
-        }
-        return old;
-    }
-
-    LRUHandle *Remove(ns_data_structure::Slice const &key, uint32_t hash) {
-        LRUHandle **ptr = FindPointer(key, hash);
-        LRUHandle *result = *ptr;
-        if (result != nullptr) {
-            *ptr = result->next_hash;
-            --elems_;
-        }
-        return result;
-    }
-
-private:
-    // The table consists of an array of buckets where each bucket is
-    // a linked list of cache entries that hash into the bucket.
-    uint32_t length_;
-    uint32_t elems_;
-    LRUHandle **list_;
-
-    LRUHandle **FindPointer(ns_data_structure::Slice const &key, uint32_t hash) {
-        LRUHandle **ptr = &list_[hash & (length_ - 1)];
-        while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key())) {
-            ptr = &(*ptr)->next_hash;
-        }
-        return ptr;
-    }
-
-    void Resize() {
-        uint32_t new_length = 4;
-        while (new_length < elems_) {
-            new_length *= 2;
-        }
-        LRUHandle **new_list = new LRUHandle *[new_length];
-        memset(new_list, 0, sizeof(new_list[0]) * new_length);
-        uint32_t count = 0;
-        for (uint32_t i = 0; i < length_; i++) {
-            LRUHandle *h = list_[i];
-            while (h != nullptr) {
-                LRUHandle *next = h->next_hash;
-                uint32_t hash = h->hash;
-                LRUHandle **ptr = &new_list[hash & (new_length - 1)];
-                h->next_hash = *ptr;
-                *ptr = h;
-                h = next;
-                count++;
-            }
-        }
-        assert(elems_ == count);
-        delete[] list_;
-        list_ = new_list;
-        length_ = new_length;
+    // Bytes needed for a handle with a key of key_length bytes.
+    static uint64_t AllocationSize(uint64_t key_length) {
+        return sizeof(LRUHandle) - 1 + key_length;
     }
 };
-
 class LRUCache {
 public:
     LRUCache();
     ~LRUCache();
 
+    // Guard Insert() with a TinyLFU admission filter sized for about
+    // expected_entries entries.
+    void EnableAdmissionFilter(uint64_t expected_entries) {
+        sketch_.reset(new FrequencySketch(expected_entries));
+    }
+
     void SetCapacity(uint64_t capacity) {
         capacity_ = capacity;
+        high_pri_pool_capacity_ = capacity_ * high_pri_pool_ratio_;
+    }
+
+    void SetHighPriorityPoolRatio(double high_pri_pool_ratio) {
+        high_pri_pool_ratio_ = high_pri_pool_ratio;
+        high_pri_pool_capacity_ = capacity_ * high_pri_pool_ratio_;
     }
 
-    Cache::Handle *Insert(ns_data_structure::Slice const &key, uint32_t hash, void *value, uint64_t charge, DeleteFunc const &deleter);
+    // Entries with a helper that the capacity limit evicts are saved to
+    // secondary_cache instead of being dropped.
+    void SetSecondaryCache(SecondaryCache *secondary_cache) {
+        secondary_cache_ = secondary_cache;
+    }
+
+    Cache::Handle *Insert(ns_data_structure::Slice const &key, uint32_t hash, void *value, uint64_t charge, DeleteFunc deleter, void *deleter_arg, CacheItemHelper const *helper, Cache::Priority priority);
     Cache::Handle *Lookup(ns_data_structure::Slice const &key, uint32_t hash);
+    // Batched Lookup()/Release() of the entries keys[indices[i]] and
+    // handles[indices[i]] for i in [0, count), all of which map to this shard.
+    void MultiLookup(ns_data_structure::Slice const *keys, uint32_t const *hashes, uint32_t const *indices, uint64_t count, Cache::Handle **handles);
+    void MultiRelease(Cache::Handle *const *handles, uint32_t const *indices, uint64_t count);
     void Release(Cache::Handle *handle);
     void Erase(ns_data_structure::Slice const &key, uint32_t hash);
     void Prune();
+    // Append the entries of this shard to *entries, those in use by clients
+    // first and then the LRU list from newest to oldest, until their charges
+    // reach max_charge.
+    void AppendHotEntries(uint64_t max_charge, std::vector<CacheEntryInfo> *entries) const;
+    void GetStats(CacheShardStats *stats) const;
     uint64_t TotalCharge() const {
         std::unique_lock<std::mutex> lck(mutex_);
         return usage_;
     }
+    void GetAdmissionStats(uint64_t *admitted, uint64_t *rejected) const {
+        std::unique_lock<std::mutex> lck(mutex_);
+        *admitted = admitted_;
+        *rejected = rejected_;
+    }
 
 private:
     // Initialized before use.
     uint64_t capacity_;
+    double high_pri_pool_ratio_;
+    uint64_t high_pri_pool_capacity_;
+    SecondaryCache *secondary_cache_;
     mutable std::mutex mutex_;
     uint64_t usage_ GUARDED_BY(mutex_);
+    uint64_t high_pri_pool_usage_ GUARDED_BY(mutex_);
+    // Dummy head of LRU list.
+    // lru.prev is newest entry, lru.next is oldest entry.
+    // Entries have refs==1 and in_cache==true.
+    // The list is split in two pools: entries from lru_.next up to
+    // *lru_low_pri_ form the low-priority pool, the ones after it form the
+    // high-priority pool.
     LRUHandle lru_ GUARDED_BY(mutex_);
+    // Newest entry of the low-priority pool, &lru_ if that pool is empty.
+    LRUHandle *lru_low_pri_ GUARDED_BY(mutex_);
+    // Dummy head of in-use list.
+    // Entries are in use by clients, and have refs >= 2 and in_cache==true.
     LRUHandle in_use_ GUARDED_BY(mutex_);
-    HandleTable table_ GUARDED_BY(mutex_);
+    HandleTable<LRUHandle> table_ GUARDED_BY(mutex_);
+    // Backs every LRUHandle of this shard, so that steady-state inserts
+    // reuse the memory of evicted handles instead of calling new[].
+    ns_memory::SlabAllocator slab_ GUARDED_BY(mutex_);
+    // TinyLFU admission filter, nullptr when disabled.
+    std::unique_ptr<FrequencySketch> sketch_ GUARDED_BY(mutex_);
+    uint64_t admitted_ GUARDED_BY(mutex_);
+    uint64_t rejected_ GUARDED_BY(mutex_);
+    // Statistics, see CacheShardStats.  Relaxed atomics: they are read
+    // without mutex_, and need no order with anything else.
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> inserts_;
+    std::atomic<uint64_t> evictions_;
+    std::atomic<uint64_t> lock_waits_;
+    std::atomic<uint64_t> lock_wait_nanos_;
+
+    // Lock mutex_ for a counted operation.  Only an acquisition that finds
+    // the mutex taken reads the clock, so the uncontended path stays cheap.
+    std::unique_lock<std::mutex> LockShard();
 
+    bool Admit(ns_data_structure::Slice const &key, uint32_t hash, uint64_t charge) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
     void LRU_Remove(LRUHandle *e);
     void LRU_Append(LRUHandle *list, LRUHandle *e);
+    void LRU_Insert(LRUHandle *e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    void MaintainPoolSize() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
     void Ref(LRUHandle *e);
     void Unref(LRUHandle *e);
+    // Take e, just removed from table_, out of the cache but leave the
+    // cache's reference to the caller.
+    void Detach(LRUHandle *e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
     void FinishErase(LRUHandle *e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 };
 
 LRUCache::LRUCache() :
-    capacity_(0), usage_(0) {
+    capacity_(0), high_pri_pool_ratio_(0), high_pri_pool_capacity_(0), secondary_cache_(nullptr), usage_(0), high_pri_pool_usage_(0), admitted_(0), rejected_(0), hits_(0), misses_(0), inserts_(0), evictions_(0), lock_waits_(0), lock_wait_nanos_(0) {
     // Make empty circular linked lists.
     lru_.next = &lru_;
     lru_.prev = &lru_;
+    lru_low_pri_ = &lru_;
     in_use_.next = &in_use_;
     in_use_.prev = &in_use_;
 }
@@ -188,44 +199,153 @@ LRUCache::~LRUCache() {
     }
 }
 
-Cache::Handle *LRUCache::Insert(ns_data_structure::Slice const &key, uint32_t hash, void *value, uint64_t charge, DeleteFunc const &deleter) {
-    std::unique_lock<std::mutex> lck(mutex_);
-    uint8_t *handle_mem = new uint8_t[sizeof(LRUHandle) - 1 + key.size()];
-    LRUHandle *e = new (handle_mem) LRUHandle(value, deleter, charge, key, hash);
-    if (capacity_ > 0) {
+Cache::Handle *LRUCache::Insert(ns_data_structure::Slice const &key, uint32_t hash, void *value, uint64_t charge, DeleteFunc deleter, void *deleter_arg, CacheItemHelper const *helper, Cache::Priority priority) {
+    std::unique_lock<std::mutex> lck = LockShard();
+    uint8_t *handle_mem = slab_.Allocate(LRUHandle::AllocationSize(key.size()));
+    LRUHandle *e = new (handle_mem) LRUHandle(value, deleter, deleter_arg, charge, key, hash);
+    inserts_.fetch_add(1, std::memory_order_relaxed);
+    e->helper = helper;
+    e->is_high_pri = (priority == Cache::Priority::kHigh);
+    if (capacity_ > 0 && Admit(key, hash, charge)) {
         e->refs++; // for the cache's reference.
         e->in_cache = true;
         LRU_Append(&in_use_, e);
         usage_ += charge;
         FinishErase(table_.Insert(e));
-    } else { // don't cache. (capacity_==0 is supported and turns off caching.)
+    } else { // don't cache. (capacity_==0 is supported and turns off caching,
+             // and the admission filter may turn the entry away.)
              // next is read by key() in an assert, so it must be initialized
         e->next = nullptr;
     }
+    // Victims to save to the secondary cache.  They are unlinked here but
+    // only spilled after unlocking, since spilling compresses them.
+    std::vector<LRUHandle *> spilled;
     while (usage_ > capacity_ && lru_.next != &lru_) {
         LRUHandle *old = lru_.next;
         assert(old->refs == 1);
-        FinishErase(table_.Remove(old->key(), old->hash));
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+        table_.Remove(old->key(), old->hash);
+        if (secondary_cache_ != nullptr && old->helper != nullptr) {
+            Detach(old);
+            spilled.push_back(old);
+        } else {
+            FinishErase(old);
+        }
+    }
+    if (!spilled.empty()) {
+        lck.unlock();
+        // Nobody else can reach the victims any more.
+        for (LRUHandle *old : spilled) {
+            secondary_cache_->Insert(old->key(), old->value, old->helper);
+        }
+        lck.lock();
+        for (LRUHandle *old : spilled) {
+            if (table_.Lookup(old->key(), old->hash) != nullptr) {
+                // A newer version came in while unlocked; the saved copy is
+                // stale.
+                secondary_cache_->Erase(old->key());
+            }
+            Unref(old);
+        }
     }
     return reinterpret_cast<Cache::Handle *>(e);
 }
 
 Cache::Handle *LRUCache::Lookup(ns_data_structure::Slice const &key, uint32_t hash) {
-    std::unique_lock<std::mutex> lck(mutex_);
+    std::unique_lock<std::mutex> lck = LockShard();
+    if (sketch_ != nullptr) {
+        sketch_->Increment(hash);
+    }
     LRUHandle *e = table_.Lookup(key, hash);
     if (e != nullptr) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        e->has_hit = true;
         Ref(e);
+    } else {
+        misses_.fetch_add(1, std::memory_order_relaxed);
     }
     return reinterpret_cast<Cache::Handle *>(e);
 }
 
+void LRUCache::MultiLookup(ns_data_structure::Slice const *keys, uint32_t const *hashes, uint32_t const *indices, uint64_t count, Cache::Handle **handles) {
+    std::unique_lock<std::mutex> lck = LockShard();
+    // Issue all bucket loads first so their cache misses overlap.
+    for (uint64_t i = 0; i < count; i++) {
+        table_.Prefetch(hashes[indices[i]]);
+    }
+    uint64_t hits = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        uint32_t const idx = indices[i];
+        if (sketch_ != nullptr) {
+            sketch_->Increment(hashes[idx]);
+        }
+        LRUHandle *e = table_.Lookup(keys[idx], hashes[idx]);
+        if (e != nullptr) {
+            hits++;
+            e->has_hit = true;
+            Ref(e);
+        }
+        handles[idx] = reinterpret_cast<Cache::Handle *>(e);
+    }
+    hits_.fetch_add(hits, std::memory_order_relaxed);
+    misses_.fetch_add(count - hits, std::memory_order_relaxed);
+}
+
+void LRUCache::MultiRelease(Cache::Handle *const *handles, uint32_t const *indices, uint64_t count) {
+    std::unique_lock<std::mutex> lck = LockShard();
+    for (uint64_t i = 0; i < count; i++) {
+        Unref(reinterpret_cast<LRUHandle *>(handles[indices[i]]));
+    }
+}
+
 void LRUCache::Release(Cache::Handle *handle) {
-    std::unique_lock<std::mutex> lck(mutex_);
+    std::unique_lock<std::mutex> lck = LockShard();
     Unref(reinterpret_cast<LRUHandle *>(handle));
 }
 
-void LRUCache::Erase(ns_data_structure::Slice const &key, uint32_t hash) {
+void LRUCache::AppendHotEntries(uint64_t max_charge, std::vector<CacheEntryInfo> *entries) const {
+    std::unique_lock<std::mutex> lck(mutex_);
+    uint64_t total = 0;
+    for (LRUHandle const *list : {&in_use_, &lru_}) {
+        for (LRUHandle const *e = list->prev; e != list && total < max_charge; e = e->prev) {
+            entries->push_back(CacheEntryInfo{e->key().ToString(), e->charge});
+            total += e->charge;
+        }
+    }
+}
+
+void LRUCache::GetStats(CacheShardStats *stats) const {
+    stats->hits = hits_.load(std::memory_order_relaxed);
+    stats->misses = misses_.load(std::memory_order_relaxed);
+    stats->inserts = inserts_.load(std::memory_order_relaxed);
+    stats->evictions = evictions_.load(std::memory_order_relaxed);
+    stats->lock_waits = lock_waits_.load(std::memory_order_relaxed);
+    stats->lock_wait_nanos = lock_wait_nanos_.load(std::memory_order_relaxed);
+    // Only the usage needs the entries to hold still.
     std::unique_lock<std::mutex> lck(mutex_);
+    stats->capacity = capacity_;
+    stats->usage = usage_;
+    stats->pinned_usage = 0;
+    for (LRUHandle const *e = in_use_.next; e != &in_use_; e = e->next) {
+        stats->pinned_usage += e->charge;
+    }
+}
+
+std::unique_lock<std::mutex> LRUCache::LockShard() {
+    std::unique_lock<std::mutex> lck(mutex_, std::try_to_lock);
+    if (!lck.owns_lock()) {
+        auto start = std::chrono::steady_clock::now();
+        lck.lock();
+        lock_waits_.fetch_add(1, std::memory_order_relaxed);
+        lock_wait_nanos_.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+            std::memory_order_relaxed);
+    }
+    return lck;
+}
+
+void LRUCache::Erase(ns_data_structure::Slice const &key, uint32_t hash) {
+    std::unique_lock<std::mutex> lck = LockShard();
     FinishErase(table_.Remove(key, hash));
 }
 
@@ -238,7 +358,39 @@ void LRUCache::Prune() {
     }
 }
 
+bool LRUCache::Admit(ns_data_structure::Slice const &key, uint32_t hash, uint64_t charge) {
+    if (sketch_ == nullptr) {
+        return true;
+    }
+    if (table_.Lookup(key, hash) != nullptr) {
+        // Always take updates, or readers would keep seeing the old value.
+        admitted_++;
+        return true;
+    }
+    // Walk the entries the capacity loop in Insert() would evict and admit
+    // the candidate only if it is more popular than all of them.
+    uint32_t const candidate = sketch_->Frequency(hash);
+    uint64_t freed = capacity_ - std::min(usage_, capacity_);
+    for (LRUHandle *victim = lru_.next; freed < charge && victim != &lru_; victim = victim->next) {
+        if (sketch_->Frequency(victim->hash) >= candidate) {
+            rejected_++;
+            return false;
+        }
+        freed += victim->charge;
+    }
+    admitted_++;
+    return true;
+}
+
 void LRUCache::LRU_Remove(LRUHandle *e) {
+    if (e == lru_low_pri_) {
+        lru_low_pri_ = e->prev;
+    }
+    if (e->in_high_pri_pool) {
+        assert(high_pri_pool_usage_ >= e->charge);
+        high_pri_pool_usage_ -= e->charge;
+        e->in_high_pri_pool = false;
+    }
     e->next->prev = e->prev;
     e->prev->next = e->next;
 }
@@ -251,6 +403,32 @@ void LRUCache::LRU_Append(LRUHandle *list, LRUHandle *e) {
     e->next->prev = e;
 }
 
+void LRUCache::LRU_Insert(LRUHandle *e) {
+    if (high_pri_pool_ratio_ > 0 && (e->is_high_pri || e->has_hit)) {
+        // Newest entry of the whole list, i.e. the head of the high-priority pool.
+        LRU_Append(&lru_, e);
+        e->in_high_pri_pool = true;
+        high_pri_pool_usage_ += e->charge;
+        MaintainPoolSize();
+    } else {
+        // Midpoint insertion: newest entry of the low-priority pool.
+        LRU_Append(lru_low_pri_->next, e);
+        lru_low_pri_ = e;
+    }
+}
+
+void LRUCache::MaintainPoolSize() {
+    // Demote the oldest high-priority entries to the low-priority pool by
+    // moving the pool boundary forward.
+    while (high_pri_pool_usage_ > high_pri_pool_capacity_) {
+        lru_low_pri_ = lru_low_pri_->next;
+        assert(lru_low_pri_ != &lru_);
+        assert(lru_low_pri_->in_high_pri_pool);
+        lru_low_pri_->in_high_pri_pool = false;
+        high_pri_pool_usage_ -= lru_low_pri_->charge;
+    }
+}
+
 void LRUCache::Ref(LRUHandle *e) {
     if (e->refs == 1 && e->in_cache) { // If on lru_ list, move to in_use_ list.
         LRU_Remove(e);
@@ -264,21 +442,25 @@ void LRUCache::Unref(LRUHandle *e) {
     e->refs--;
     if (e->refs == 0) { // Deallocate.
         assert(!e->in_cache);
-        e->deleter(e->key(), e->value);
-        delete[] (reinterpret_cast<uint8_t *>(e));
+        e->deleter(e->key(), e->value, e->deleter_arg);
+        slab_.Free(reinterpret_cast<uint8_t *>(e), LRUHandle::AllocationSize(e->key_length));
     } else if (e->in_cache && e->refs == 1) {
         // No longer in use; move to lru_ list.
         LRU_Remove(e);
-        LRU_Append(&lru_, e);
+        LRU_Insert(e);
     }
 }
 
+void LRUCache::Detach(LRUHandle *e) {
+    assert(e->in_cache);
+    LRU_Remove(e);
+    e->in_cache = false;
+    usage_ -= e->charge;
+}
+
 void LRUCache::FinishErase(LRUHandle *e) {
     if (e != nullptr) {
-        assert(e->in_cache);
-        LRU_Remove(e);
-        e->in_cache = false;
-        usage_ -= e->charge;
+        Detach(e);
         Unref(e);
     }
 }
@@ -288,19 +470,35 @@ static constexpr int32_t kNumShards = 1 << kNumShardBits;
 
 class ShardedLRUCache : public Cache {
 public:
-    explicit ShardedLRUCache(uint64_t capacaity) :
-        last_id_(0) {
-        uint64_t const per_shard = (capacaity + (kNumShards - 1)) / kNumShards;
+    explicit ShardedLRUCache(LRUCacheOptions const &options) :
+        secondary_cache_(options.secondary_cache), last_id_(0) {
+        assert(options.high_pri_pool_ratio >= 0 && options.high_pri_pool_ratio <= 1);
+        uint64_t const per_shard = (options.capacity + (kNumShards - 1)) / kNumShards;
         for (int32_t s = 0; s < kNumShards; s++) {
+            shard_[s].SetHighPriorityPoolRatio(options.high_pri_pool_ratio);
             shard_[s].SetCapacity(per_shard);
+            shard_[s].SetSecondaryCache(options.secondary_cache);
+            if (options.use_admission_filter) {
+                assert(options.estimated_entry_charge > 0);
+                shard_[s].EnableAdmissionFilter(per_shard / options.estimated_entry_charge);
+            }
         }
     }
     ~ShardedLRUCache() override {
     }
     Handle *Insert(ns_data_structure::Slice const &key, void *value, uint64_t charge,
-                   DeleteFunc const &deleter) override {
-        uint32_t const hash = HashSlice(key);
-        return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+                   DeleteFunc deleter, void *deleter_arg) override {
+        return Insert(key, value, charge, deleter, deleter_arg, Priority::kLow);
+    }
+
+    Handle *Insert(ns_data_structure::Slice const &key, void *value, uint64_t charge,
+                   DeleteFunc deleter, void *deleter_arg, Priority priority) override {
+        return Insert(key, value, charge, deleter, deleter_arg, nullptr, priority);
+    }
+
+    Handle *Insert(ns_data_structure::Slice const &key, void *value, uint64_t charge,
+                   CacheItemHelper const *helper, Priority priority) override {
+        return Insert(key, value, charge, helper->deleter, nullptr, helper, priority);
     }
 
     Handle *Lookup(ns_data_structure::Slice const &key) override {
@@ -308,11 +506,56 @@ public:
         return shard_[Shard(hash)].Lookup(key, hash);
     }
 
+    Handle *Lookup(ns_data_structure::Slice const &key, CacheItemHelper const *helper) override {
+        uint32_t const hash = HashSlice(key);
+        Handle *handle = shard_[Shard(hash)].Lookup(key, hash);
+        if (handle == nullptr && secondary_cache_ != nullptr) {
+            void *value;
+            uint64_t charge;
+            if (secondary_cache_->Lookup(key, helper, &value, &charge)) {
+                handle = shard_[Shard(hash)].Insert(key, hash, value, charge, helper->deleter, nullptr, helper, Priority::kLow);
+            }
+        }
+        return handle;
+    }
+
     void Release(Handle *handle) override {
         LRUHandle *h = reinterpret_cast<LRUHandle *>(handle);
         shard_[Shard(h->hash)].Release(handle);
     }
 
+    void MultiLookup(ns_data_structure::Slice const *keys, uint64_t n, Handle **handles) override {
+        std::vector<uint32_t> hashes(n);
+        std::vector<uint32_t> shards(n);
+        for (uint64_t i = 0; i < n; i++) {
+            hashes[i] = HashSlice(keys[i]);
+            shards[i] = Shard(hashes[i]);
+        }
+        std::vector<uint32_t> order;
+        uint64_t begin[kNumShards + 2];
+        GroupByShard(shards, &order, begin);
+        for (int32_t s = 0; s < kNumShards; s++) {
+            if (begin[s + 1] > begin[s]) {
+                shard_[s].MultiLookup(keys, hashes.data(), order.data() + begin[s], begin[s + 1] - begin[s], handles);
+            }
+        }
+    }
+
+    void MultiRelease(Handle *const *handles, uint64_t n) override {
+        std::vector<uint32_t> shards(n);
+        for (uint64_t i = 0; i < n; i++) {
+            shards[i] = (handles[i] == nullptr) ? kNumShards : Shard(reinterpret_cast<LRUHandle *>(handles[i])->hash);
+        }
+        std::vector<uint32_t> order;
+        uint64_t begin[kNumShards + 2];
+        GroupByShard(shards, &order, begin);
+        for (int32_t s = 0; s < kNumShards; s++) {
+            if (begin[s + 1] > begin[s]) {
+                shard_[s].MultiRelease(handles, order.data() + begin[s], begin[s + 1] - begin[s]);
+            }
+        }
+    }
+
     void *Value(Handle *handle) override {
         return reinterpret_cast<LRUHandle *>(handle)->value;
     }
@@ -320,6 +563,9 @@ public:
     void Erase(ns_data_structure::Slice const &key) override {
         uint32_t const hash = HashSlice(key);
         shard_[Shard(hash)].Erase(key, hash);
+        if (secondary_cache_ != nullptr) {
+            secondary_cache_->Erase(key);
+        }
     }
 
     uint64_t NewId() override {
@@ -341,8 +587,410 @@ public:
         return total;
     }
 
+    void GetHotEntries(uint64_t max_charge, std::vector<CacheEntryInfo> *entries) const override {
+        // Shards do not share a recency order, so interleave them: the
+        // newest entry of every shard, then the second newest, and so on.
+        std::vector<CacheEntryInfo> shard_entries[kNumShards];
+        for (int32_t s = 0; s < kNumShards; s++) {
+            shard_[s].AppendHotEntries(max_charge, &shard_entries[s]);
+        }
+        uint64_t total = 0;
+        for (uint64_t rank = 0; total < max_charge; rank++) {
+            bool found = false;
+            for (int32_t s = 0; s < kNumShards && total < max_charge; s++) {
+                if (rank < shard_entries[s].size()) {
+                    total += shard_entries[s][rank].charge;
+                    entries->push_back(std::move(shard_entries[s][rank]));
+                    found = true;
+                }
+            }
+            if (!found) {
+                break;
+            }
+        }
+    }
+
+    void GetShardStats(std::vector<CacheShardStats> *stats) const override {
+        stats->resize(kNumShards);
+        for (int32_t s = 0; s < kNumShards; s++) {
+            shard_[s].GetStats(&(*stats)[s]);
+        }
+    }
+
+    void GetAdmissionStats(uint64_t *admitted, uint64_t *rejected) const override {
+        *admitted = 0;
+        *rejected = 0;
+        for (int32_t s = 0; s < kNumShards; s++) {
+            uint64_t shard_admitted, shard_rejected;
+            shard_[s].GetAdmissionStats(&shard_admitted, &shard_rejected);
+            *admitted += shard_admitted;
+            *rejected += shard_rejected;
+        }
+    }
+
 private:
     LRUCache shard_[kNumShards];
+    SecondaryCache *const secondary_cache_;
+    std::mutex id_mutex_;
+    uint64_t last_id_;
+
+    static inline uint32_t HashSlice(ns_data_structure::Slice const &s) {
+        return ns_util::Hash(s.data(), s.size(), 0);
+    }
+
+    static uint32_t Shard(uint32_t hash) {
+        return hash >> (32 - kNumShardBits);
+    }
+
+    // Counting sort of [0, shards.size()) by shard: on return the indices
+    // with shards[i] == s are (*order)[begin[s], begin[s + 1]), in their
+    // original order.  shards[i] may be kNumShards to park an entry in a
+    // trailing group that callers ignore; begin must hold kNumShards + 2 slots.
+    static void GroupByShard(std::vector<uint32_t> const &shards, std::vector<uint32_t> *order, uint64_t *begin) {
+        std::fill(begin, begin + kNumShards + 2, 0);
+        for (uint32_t s : shards) {
+            begin[s + 1]++;
+        }
+        for (int32_t s = 0; s <= kNumShards; s++) {
+            begin[s + 1] += begin[s];
+        }
+        order->resize(shards.size());
+        uint64_t next[kNumShards + 1];
+        std::copy(begin, begin + kNumShards + 1, next);
+        for (uint64_t i = 0; i < shards.size(); i++) {
+            (*order)[next[shards[i]]++] = i;
+        }
+    }
+
+    Handle *Insert(ns_data_structure::Slice const &key, void *value, uint64_t charge,
+                   DeleteFunc deleter, void *deleter_arg, CacheItemHelper const *helper, Priority priority) {
+        uint32_t const hash = HashSlice(key);
+        if (secondary_cache_ != nullptr) {
+            // Drop an older version the secondary tier may still hold: this
+            // one may leave without replacing it there (Prune(), no helper).
+            secondary_cache_->Erase(key);
+        }
+        return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter, deleter_arg, helper, priority);
+    }
+};
+
+// A cache shard with the ARC policy (Megiddo & Modha, "ARC: A Self-Tuning,
+// Low Overhead Replacement Cache"), generalized from entry counts to charges.
+//
+// Resident entries are split between T1, entries seen once since they were
+// inserted, and T2, entries seen at least twice (has_hit).  Evicted entries
+// leave a ghost behind (an LRUHandle holding only key and hash) in B1 or B2
+// respectively.  Inserting a key that still has a ghost tells which side
+// evicted too early: a B1 ghost grows target_t1_, the share of capacity
+// aimed at T1, and a B2 ghost shrinks it.  The entry then goes to T2.
+//
+// Entries in use by clients sit on in_use_ like in LRUCache, and go back to
+// T1 or T2 when released.
+class ARCCache {
+public:
+    ARCCache();
+    ~ARCCache();
+
+    // Separate from constructor so caller can easily make an array of ARCCache.
+    void SetCapacity(uint64_t capacity) {
+        capacity_ = capacity;
+    }
+
+    Cache::Handle *Insert(ns_data_structure::Slice const &key, uint32_t hash, void *value, uint64_t charge, DeleteFunc deleter, void *deleter_arg);
+    Cache::Handle *Lookup(ns_data_structure::Slice const &key, uint32_t hash);
+    void Release(Cache::Handle *handle);
+    void Erase(ns_data_structure::Slice const &key, uint32_t hash);
+    void Prune();
+    uint64_t TotalCharge() const {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return usage_;
+    }
+
+private:
+    // Initialized before use.
+    uint64_t capacity_;
+    mutable std::mutex mutex_;
+    uint64_t usage_ GUARDED_BY(mutex_);
+    // Charge of the resident entries that belong to T1, in use or not.
+    uint64_t t1_usage_ GUARDED_BY(mutex_);
+    // Charge the policy currently wants T1 to hold ("p" in the paper).
+    uint64_t target_t1_ GUARDED_BY(mutex_);
+    uint64_t b1_usage_ GUARDED_BY(mutex_);
+    uint64_t b2_usage_ GUARDED_BY(mutex_);
+    // Dummy heads of the lists; list.prev is the newest entry, list.next
+    // the oldest.  t1_ and t2_ hold unpinned resident entries (refs==1),
+    // b1_ and b2_ hold ghosts.
+    LRUHandle t1_ GUARDED_BY(mutex_);
+    LRUHandle t2_ GUARDED_BY(mutex_);
+    LRUHandle b1_ GUARDED_BY(mutex_);
+    LRUHandle b2_ GUARDED_BY(mutex_);
+    LRUHandle in_use_ GUARDED_BY(mutex_);
+    HandleTable<LRUHandle> table_ GUARDED_BY(mutex_);
+    HandleTable<LRUHandle> ghost_table_ GUARDED_BY(mutex_);
+    ns_memory::SlabAllocator slab_ GUARDED_BY(mutex_);
+
+    void List_Remove(LRUHandle *e);
+    void List_Append(LRUHandle *list, LRUHandle *e);
+    // Evict the oldest unpinned entry of T1 or T2, whichever the target
+    // says, leaving a ghost behind.  Returns false if nothing can be evicted.
+    bool Replace() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    // Keep the ghost lists within the bounds of the paper: T1 + B1 and
+    // B1 + B2 each hold at most capacity_.
+    void TrimGhosts() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    void FreeGhost(LRUHandle *ghost) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    void Ref(LRUHandle *e);
+    void Unref(LRUHandle *e);
+    void FinishErase(LRUHandle *e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+};
+
+ARCCache::ARCCache() :
+    capacity_(0), usage_(0), t1_usage_(0), target_t1_(0), b1_usage_(0), b2_usage_(0) {
+    // Make empty circular linked lists.
+    for (LRUHandle *list : {&t1_, &t2_, &b1_, &b2_, &in_use_}) {
+        list->next = list;
+        list->prev = list;
+    }
+}
+
+ARCCache::~ARCCache() {
+    assert(in_use_.next == &in_use_); // Error if caller has an unreleased handle
+    for (LRUHandle *list : {&t1_, &t2_}) {
+        for (LRUHandle *e = list->next; e != list;) {
+            LRUHandle *next = e->next;
+            assert(e->in_cache);
+            e->in_cache = false;
+            assert(e->refs == 1);
+            Unref(e);
+            e = next;
+        }
+    }
+    for (LRUHandle *list : {&b1_, &b2_}) {
+        for (LRUHandle *e = list->next; e != list;) {
+            LRUHandle *next = e->next;
+            slab_.Free(reinterpret_cast<uint8_t *>(e), LRUHandle::AllocationSize(e->key_length));
+            e = next;
+        }
+    }
+}
+
+Cache::Handle *ARCCache::Insert(ns_data_structure::Slice const &key, uint32_t hash, void *value, uint64_t charge, DeleteFunc deleter, void *deleter_arg) {
+    std::unique_lock<std::mutex> lck(mutex_);
+    uint8_t *handle_mem = slab_.Allocate(LRUHandle::AllocationSize(key.size()));
+    LRUHandle *e = new (handle_mem) LRUHandle(value, deleter, deleter_arg, charge, key, hash);
+    if (capacity_ > 0) {
+        LRUHandle *ghost = ghost_table_.Remove(key, hash);
+        if (ghost != nullptr) {
+            // Evicted too early: shift the target towards the list that
+            // evicted it, by more when the other ghost list is the bigger one.
+            if (!ghost->has_hit) {
+                uint64_t const delta = std::max<uint64_t>(1, b2_usage_ / std::max<uint64_t>(b1_usage_, 1)) * charge;
+                target_t1_ = std::min(capacity_, target_t1_ + delta);
+            } else {
+                uint64_t const delta = std::max<uint64_t>(1, b1_usage_ / std::max<uint64_t>(b2_usage_, 1)) * charge;
+                target_t1_ = (target_t1_ > delta) ? target_t1_ - delta : 0;
+            }
+            FreeGhost(ghost);
+            e->has_hit = true;
+        }
+        e->refs++; // for the cache's reference.
+        e->in_cache = true;
+        List_Append(&in_use_, e);
+        usage_ += charge;
+        if (!e->has_hit) {
+            t1_usage_ += charge;
+        }
+        FinishErase(table_.Insert(e));
+    } else { // don't cache. (capacity_==0 is supported and turns off caching.)
+             // next is read by key() in an assert, so it must be initialized
+        e->next = nullptr;
+    }
+    while (usage_ > capacity_ && Replace()) {
+    }
+    TrimGhosts();
+    return reinterpret_cast<Cache::Handle *>(e);
+}
+
+Cache::Handle *ARCCache::Lookup(ns_data_structure::Slice const &key, uint32_t hash) {
+    std::unique_lock<std::mutex> lck(mutex_);
+    LRUHandle *e = table_.Lookup(key, hash);
+    if (e != nullptr) {
+        if (!e->has_hit) {
+            // Second access: moves from T1 to T2 when released.
+            e->has_hit = true;
+            t1_usage_ -= e->charge;
+        }
+        Ref(e);
+    }
+    return reinterpret_cast<Cache::Handle *>(e);
+}
+
+void ARCCache::Release(Cache::Handle *handle) {
+    std::unique_lock<std::mutex> lck(mutex_);
+    Unref(reinterpret_cast<LRUHandle *>(handle));
+}
+
+void ARCCache::Erase(ns_data_structure::Slice const &key, uint32_t hash) {
+    std::unique_lock<std::mutex> lck(mutex_);
+    FinishErase(table_.Remove(key, hash));
+}
+
+void ARCCache::Prune() {
+    std::unique_lock<std::mutex> lck(mutex_);
+    for (LRUHandle *list : {&t1_, &t2_}) {
+        while (list->next != list) {
+            LRUHandle *e = list->next;
+            assert(e->refs == 1);
+            FinishErase(table_.Remove(e->key(), e->hash));
+        }
+    }
+}
+
+void ARCCache::List_Remove(LRUHandle *e) {
+    e->next->prev = e->prev;
+    e->prev->next = e->next;
+}
+
+void ARCCache::List_Append(LRUHandle *list, LRUHandle *e) {
+    // Make "e" newest entry by inserting just before *list
+    e->next = list;
+    e->prev = list->prev;
+    e->prev->next = e;
+    e->next->prev = e;
+}
+
+bool ARCCache::Replace() {
+    bool const t1_empty = (t1_.next == &t1_);
+    bool const t2_empty = (t2_.next == &t2_);
+    if (t1_empty && t2_empty) {
+        return false; // Everything left is pinned.
+    }
+    bool const from_t1 = !t1_empty && (t1_usage_ > target_t1_ || t2_empty);
+    LRUHandle *victim = from_t1 ? t1_.next : t2_.next;
+    assert(victim->refs == 1);
+
+    ns_data_structure::Slice const key = victim->key();
+    uint8_t *ghost_mem = slab_.Allocate(LRUHandle::AllocationSize(key.size()));
+    LRUHandle *ghost = new (ghost_mem) LRUHandle(nullptr, nullptr, nullptr, victim->charge, key, victim->hash);
+    ghost->has_hit = victim->has_hit;
+    List_Append(victim->has_hit ? &b2_ : &b1_, ghost);
+    (victim->has_hit ? b2_usage_ : b1_usage_) += ghost->charge;
+    LRUHandle *old_ghost = ghost_table_.Insert(ghost);
+    if (old_ghost != nullptr) {
+        FreeGhost(old_ghost);
+    }
+    FinishErase(table_.Remove(key, victim->hash));
+    return true;
+}
+
+void ARCCache::TrimGhosts() {
+    while (t1_usage_ + b1_usage_ > capacity_ && b1_.next != &b1_) {
+        LRUHandle *ghost = b1_.next;
+        FreeGhost(ghost_table_.Remove(ghost->key(), ghost->hash));
+    }
+    while (b1_usage_ + b2_usage_ > capacity_ && b2_.next != &b2_) {
+        LRUHandle *ghost = b2_.next;
+        FreeGhost(ghost_table_.Remove(ghost->key(), ghost->hash));
+    }
+}
+
+void ARCCache::FreeGhost(LRUHandle *ghost) {
+    List_Remove(ghost);
+    (ghost->has_hit ? b2_usage_ : b1_usage_) -= ghost->charge;
+    slab_.Free(reinterpret_cast<uint8_t *>(ghost), LRUHandle::AllocationSize(ghost->key_length));
+}
+
+void ARCCache::Ref(LRUHandle *e) {
+    if (e->refs == 1 && e->in_cache) { // If on t1_ or t2_, move to in_use_ list.
+        List_Remove(e);
+        List_Append(&in_use_, e);
+    }
+    e->refs++;
+}
+
+void ARCCache::Unref(LRUHandle *e) {
+    assert(e->refs > 0);
+    e->refs--;
+    if (e->refs == 0) { // Deallocate.
+        assert(!e->in_cache);
+        e->deleter(e->key(), e->value, e->deleter_arg);
+        slab_.Free(reinterpret_cast<uint8_t *>(e), LRUHandle::AllocationSize(e->key_length));
+    } else if (e->in_cache && e->refs == 1) {
+        // No longer in use; newest entry of its list.
+        List_Remove(e);
+        List_Append(e->has_hit ? &t2_ : &t1_, e);
+    }
+}
+
+void ARCCache::FinishErase(LRUHandle *e) {
+    if (e != nullptr) {
+        assert(e->in_cache);
+        List_Remove(e);
+        e->in_cache = false;
+        usage_ -= e->charge;
+        if (!e->has_hit) {
+            t1_usage_ -= e->charge;
+        }
+        Unref(e);
+    }
+}
+
+class ShardedARCCache : public Cache {
+public:
+    explicit ShardedARCCache(uint64_t capacity) :
+        last_id_(0) {
+        uint64_t const per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+        for (int32_t s = 0; s < kNumShards; s++) {
+            shard_[s].SetCapacity(per_shard);
+        }
+    }
+    ~ShardedARCCache() override {
+    }
+    Handle *Insert(ns_data_structure::Slice const &key, void *value, uint64_t charge,
+                   DeleteFunc deleter, void *deleter_arg) override {
+        uint32_t const hash = HashSlice(key);
+        return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter, deleter_arg);
+    }
+
+    Handle *Lookup(ns_data_structure::Slice const &key) override {
+        uint32_t const hash = HashSlice(key);
+        return shard_[Shard(hash)].Lookup(key, hash);
+    }
+
+    void Release(Handle *handle) override {
+        LRUHandle *h = reinterpret_cast<LRUHandle *>(handle);
+        shard_[Shard(h->hash)].Release(handle);
+    }
+
+    void *Value(Handle *handle) override {
+        return reinterpret_cast<LRUHandle *>(handle)->value;
+    }
+
+    void Erase(ns_data_structure::Slice const &key) override {
+        uint32_t const hash = HashSlice(key);
+        shard_[Shard(hash)].Erase(key, hash);
+    }
+
+    uint64_t NewId() override {
+        std::unique_lock<std::mutex> lck(id_mutex_);
+        return ++(last_id_);
+    }
+
+    void Prune() override {
+        for (int32_t s = 0; s < kNumShards; s++) {
+            shard_[s].Prune();
+        }
+    }
+
+    uint64_t TotalCharge() const override {
+        uint64_t total = 0;
+        for (int32_t s = 0; s < kNumShards; s++) {
+            total += shard_[s].TotalCharge();
+        }
+        return total;
+    }
+
+private:
+    ARCCache shard_[kNumShards];
     std::mutex id_mutex_;
     uint64_t last_id_;
 
@@ -357,6 +1005,23 @@ private:
 
 } // anonymous namespace
 Cache *NewLRUCache(uint64_t capacity) {
-    return new ShardedLRUCache(capacity);
+    LRUCacheOptions options;
+    options.capacity = capacity;
+    return new ShardedLRUCache(options);
+}
+
+Cache *NewLRUCache(uint64_t capacity, double high_pri_pool_ratio) {
+    LRUCacheOptions options;
+    options.capacity = capacity;
+    options.high_pri_pool_ratio = high_pri_pool_ratio;
+    return new ShardedLRUCache(options);
+}
+
+Cache *NewLRUCache(LRUCacheOptions const &options) {
+    return new ShardedLRUCache(options);
+}
+
+Cache *NewARCCache(uint64_t capacity) {
+    return new ShardedARCCache(capacity);
 }
 } // ns_cache
\ No newline at end of file
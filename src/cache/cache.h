@@ -2,11 +2,61 @@
 #define _LEVEL_DB_XY_CACHE_H_
 
 #include "slice.h"
-#include <functional>
+#include <string>
+#include <vector>
 
 namespace ns_cache {
 
-using DeleteFunc = std::function<void(ns_data_structure::Slice const &, void *)>;
+// Called with the key and value of an entry that is no longer needed, and the
+// deleter_arg given to Cache::Insert().  A plain function pointer keeps the
+// insert path free of the allocations a capturing std::function may need.
+using DeleteFunc = void (*)(ns_data_structure::Slice const &key, void *value, void *arg);
+
+// Callbacks that let a secondary cache tier (see secondary_cache.h) save an
+// entry evicted from the primary cache as bytes and rebuild it on a later
+// miss.  Entries inserted without a helper are simply dropped on eviction.
+struct CacheItemHelper {
+    // Return the number of bytes save_to() writes for value.
+    using SizeFunc = uint64_t (*)(void *value);
+    // Write the serialized form of value to out[0, size(value)).
+    using SaveToFunc = void (*)(void *value, uint8_t *out);
+    // Rebuild a value from the bytes written by save_to().  Returns false if
+    // data cannot be turned back into a value.
+    using CreateFunc = bool (*)(ns_data_structure::Slice const &data, void **value, uint64_t *charge);
+
+    SizeFunc size;
+    SaveToFunc save_to;
+    CreateFunc create;
+    // Releases values built by create() as well as inserted ones.  Called
+    // with a null arg.
+    DeleteFunc deleter;
+};
+
+class SecondaryCache;
+
+// Counters of one cache shard, as reported by Cache::GetShardStats().
+struct CacheShardStats {
+    uint64_t capacity{0};
+    // Combined charge of all cached entries.
+    uint64_t usage{0};
+    // Part of usage held by entries that clients have not released yet.
+    uint64_t pinned_usage{0};
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t inserts{0};
+    // Entries pushed out by the capacity limit.
+    uint64_t evictions{0};
+    // Operations that found the shard mutex held by another thread, and the
+    // time they spent waiting for it.
+    uint64_t lock_waits{0};
+    uint64_t lock_wait_nanos{0};
+};
+
+// Key and charge of a cached entry, as reported by Cache::GetHotEntries().
+struct CacheEntryInfo {
+    std::string key;
+    uint64_t charge;
+};
 
 class Cache {
 public:
@@ -18,6 +68,13 @@ public:
     virtual ~Cache() = default;
     // Opaque handle to an entry stored in the cache.
     struct Handle {};
+    // Caches with priority pools keep kHigh entries (e.g. index and filter
+    // blocks) in a protected pool that scans cannot flush out.  kLow entries
+    // start in the low-priority pool and only move up after a hit.
+    enum class Priority {
+        kHigh,
+        kLow,
+    };
     // Insert a mapping from key->value into the cache and assign it
     // the specified charge against the total cache capacity.
     //
@@ -25,20 +82,57 @@ public:
     // must call this->Release(handle) when the returned mapping is no
     // longer needed.
     //
-    // When the inserted entry is no longer needed, the key and
-    // value will be passed to "deleter".
+    // When the inserted entry is no longer needed, the key,
+    // value and deleter_arg will be passed to "deleter".
+    virtual Handle *Insert(ns_data_structure::Slice const &key, void *value, uint64_t charge,
+                           DeleteFunc deleter, void *deleter_arg) = 0;
+    // Same as above, but lets the caller pick the pool the entry starts in.
+    // Default implementation ignores the priority.
     virtual Handle *Insert(ns_data_structure::Slice const &key, void *value, uint64_t charge,
-                           DeleteFunc const &deleter) = 0;
+                           DeleteFunc deleter, void *deleter_arg, Priority priority) {
+        return Insert(key, value, charge, deleter, deleter_arg);
+    }
+    // Same as above, with helper->deleter as the deleter.  Caches with a
+    // secondary tier use the helper to spill the entry there on eviction.
+    // REQUIRES: helper must outlive the cache.
+    virtual Handle *Insert(ns_data_structure::Slice const &key, void *value, uint64_t charge,
+                           CacheItemHelper const *helper, Priority priority) {
+        return Insert(key, value, charge, helper->deleter, nullptr, priority);
+    }
     // If the cache has no mapping for "key", returns nullptr.
     //
     // Else return a handle that corresponds to the mapping.  The caller
     // must call this->Release(handle) when the returned mapping is no
     // longer needed.
     virtual Handle *Lookup(ns_data_structure::Slice const &key) = 0;
+    // Same as above, but on a miss a cache with a secondary tier rebuilds the
+    // entry from that tier with helper->create() and inserts it again.
+    // Default implementation ignores the helper.
+    virtual Handle *Lookup(ns_data_structure::Slice const &key, CacheItemHelper const *helper) {
+        return Lookup(key);
+    }
     // Release a mapping returned by a previous Lookup().
     // REQUIRES: handle must not have been released yet.
     // REQUIRES: handle must have been returned by a method on *this.
     virtual void Release(Handle *handle) = 0;
+    // Look up keys[0, n) and store in handles[i] what Lookup(keys[i]) would
+    // return.  Sharded caches take each shard lock once per batch instead
+    // of once per key.  Default implementation calls Lookup() n times.
+    virtual void MultiLookup(ns_data_structure::Slice const *keys, uint64_t n, Handle **handles) {
+        for (uint64_t i = 0; i < n; i++) {
+            handles[i] = Lookup(keys[i]);
+        }
+    }
+    // Release handles[0, n), skipping null ones, so that the output of
+    // MultiLookup() can be passed back as is.
+    // REQUIRES: same as Release() for every non-null handle.
+    virtual void MultiRelease(Handle *const *handles, uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            if (handles[i] != nullptr) {
+                Release(handles[i]);
+            }
+        }
+    }
     // Return the value encapsulated in a handle returned by a
     // successful Lookup().
     // REQUIRES: handle must not have been released yet.
@@ -63,10 +157,79 @@ public:
     // Return an estimate of the combined charges of all elements stored in the
     // cache.
     virtual uint64_t TotalCharge() const = 0;
+    // Append the keys and charges of the most recently used entries to
+    // *entries, hottest first, stopping once their charges add up to
+    // max_charge.  Used to carry the hot set of a cache across restarts,
+    // see cache_dump.h.  Default implementation appends nothing.
+    virtual void GetHotEntries(uint64_t max_charge, std::vector<CacheEntryInfo> *entries) const {
+    }
+    // Replace *stats with one entry per shard.  Counters count from the
+    // creation of the cache.  Default implementation reports no shards.
+    virtual void GetShardStats(std::vector<CacheShardStats> *stats) const {
+        stats->clear();
+    }
+    // Report how many inserts the admission policy let into the cache and how
+    // many it turned away.  Caches without an admission policy report zeros.
+    virtual void GetAdmissionStats(uint64_t *admitted, uint64_t *rejected) const {
+        *admitted = 0;
+        *rejected = 0;
+    }
+};
+
+struct LRUCacheOptions {
+    // Total charge the cache may hold.
+    uint64_t capacity{0};
+    // Fraction of each shard reserved for high-priority entries, see
+    // NewLRUCache(uint64_t, double).
+    double high_pri_pool_ratio{0};
+    // If true, a TinyLFU admission filter guards Insert(): an entry that
+    // would evict others is only cached if it has been looked up more often
+    // than the entries it would push out.  Access frequencies are sampled on
+    // Lookup(), so callers should look a key up before inserting it.
+    // Rejected entries are returned to the caller but never cached.
+    bool use_admission_filter{false};
+    // Typical charge of one entry; sizes the admission filter's frequency
+    // sketch.  Defaults to Options::block_size.
+    uint64_t estimated_entry_charge{4 * 1024};
+    // If non-null, entries that were inserted with a CacheItemHelper are
+    // saved here when the capacity limit evicts them, and Lookup() with a
+    // helper checks this tier before reporting a miss.
+    // REQUIRES: must outlive the cache.
+    SecondaryCache *secondary_cache{nullptr};
 };
 
 Cache *NewLRUCache(uint64_t capacity);
 
+// Create a LRU cache whose shards reserve high_pri_pool_ratio of their
+// capacity for high-priority entries (midpoint insertion).  Entries inserted
+// with Priority::kLow go to the low-priority pool and are promoted to the
+// high-priority pool once they are hit, so a one-pass scan can only flush the
+// low-priority pool.  A ratio of 0 gives the plain LRU behavior.
+// REQUIRES: 0 <= high_pri_pool_ratio <= 1
+Cache *NewLRUCache(uint64_t capacity, double high_pri_pool_ratio);
+
+Cache *NewLRUCache(LRUCacheOptions const &options);
+
+// Create a cache with the adaptive replacement (ARC) policy.  Each shard
+// splits its capacity between entries seen once and entries seen again, and
+// remembers the keys it recently evicted from either side.  A miss on such a
+// key moves the split in favour of the side that evicted it, so the cache
+// tunes itself between recency (scans, new data) and frequency (hot point
+// lookups) with no ratio to configure.  Remembered keys cost a key copy each
+// but no value.
+Cache *NewARCCache(uint64_t capacity);
+
+// Create a cache that evicts with the CLOCK algorithm instead of a strict LRU
+// list.  Lookup() and Release() never take a lock: a hit only bumps an atomic
+// reference/usage counter of the entry.  Insert() and Erase() still serialize
+// on a per-shard mutex.
+//
+// Each shard uses a fixed-size open-addressing table, sized so that about
+// capacity / estimated_entry_charge entries fit.  When the table runs out of
+// slots the inserted entry is returned to the caller without being cached.
+Cache *NewClockCache(uint64_t capacity);
+Cache *NewClockCache(uint64_t capacity, uint64_t estimated_entry_charge);
+
 } // ns_cache
 
 #endif
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "cache_dump.h"
+#include "coding.h"
+#include "crc32c.h"
+
+#include <algorithm>
+
+namespace ns_cache {
+
+namespace {
+
+// File layout:
+//    magic    : fixed32
+//    entries  : (key: length-prefixed slice, charge: varint64)*
+//    checksum : fixed32, masked crc32c of everything before it
+static constexpr uint32_t kCacheDumpMagic = 0x6b647063; // "cpdk"
+
+// Longest single sleep of the rate limiter, well inside int32_t micros.
+static constexpr uint64_t kMaxSleepMicros = 1000000;
+
+struct ReloadTask {
+    ns_env::Env *env;
+    Cache *cache;
+    std::string fname;
+    CacheReloadOptions options;
+    CacheLoadFunc loader;
+    void *loader_arg;
+    CacheReloadDoneFunc done;
+    void *done_arg;
+};
+
+void RunReloadTask(void *arg) {
+    ReloadTask *task = reinterpret_cast<ReloadTask *>(arg);
+    ns_util::Status s = ReloadCacheKeys(task->env, task->cache, task->fname, task->options, task->loader, task->loader_arg);
+    if (task->done != nullptr) {
+        task->done(s, task->done_arg);
+    }
+    delete task;
+}
+
+} // anonymous namespace
+
+ns_util::Status SaveCacheKeys(ns_env::Env *env, Cache const *cache, uint64_t max_charge, std::string const &fname) {
+    std::vector<CacheEntryInfo> entries;
+    cache->GetHotEntries(max_charge, &entries);
+
+    std::string contents;
+    ns_util::PutFixed32(&contents, kCacheDumpMagic);
+    for (CacheEntryInfo const &entry : entries) {
+        ns_util::PutLengthPrefixedSlice(&contents, entry.key);
+        ns_util::PutVarint64(&contents, entry.charge);
+    }
+    uint32_t const crc = ns_util::Value(reinterpret_cast<uint8_t const *>(contents.data()), contents.size());
+    ns_util::PutFixed32(&contents, ns_util::Mask(crc));
+
+    std::string const tmp = fname + ".tmp";
+    ns_util::Status s = ns_env::WriteStringToFileSync(env, contents, tmp, true);
+    if (s.ok()) {
+        s = env->RenameFile(tmp, fname);
+    }
+    if (!s.ok()) {
+        env->RemoveFile(tmp);
+    }
+    return s;
+}
+
+ns_util::Status ReloadCacheKeys(ns_env::Env *env, Cache *cache, std::string const &fname, CacheReloadOptions const &options,
+                                CacheLoadFunc loader, void *loader_arg) {
+    std::string contents;
+    ns_util::Status s = ns_env::ReadFileToString(env, fname, &contents);
+    if (!s.ok()) {
+        return s;
+    }
+    if (contents.size() < 8) {
+        return ns_util::Status::Corruption("cache dump too short", fname);
+    }
+    uint8_t const *data = reinterpret_cast<uint8_t const *>(contents.data());
+    uint64_t const body_size = contents.size() - 4;
+    if (ns_util::DecodeFixed32(data) != kCacheDumpMagic) {
+        return ns_util::Status::Corruption("not a cache dump", fname);
+    }
+    if (ns_util::Unmask(ns_util::DecodeFixed32(data + body_size)) != ns_util::Value(data, body_size)) {
+        return ns_util::Status::Corruption("cache dump checksum mismatch", fname);
+    }
+
+    ns_data_structure::Slice input(data + 4, body_size - 4);
+    uint64_t const start_micros = env->NowMicros();
+    uint64_t loaded = 0;
+    while (!input.empty()) {
+        ns_data_structure::Slice key;
+        uint64_t charge;
+        if (!ns_util::GetLengthPrefixedSlice(&input, &key) || !ns_util::GetVarint64(&input, &charge)) {
+            return ns_util::Status::Corruption("bad cache dump entry", fname);
+        }
+        if (options.max_bytes > 0 && loaded + charge > options.max_bytes) {
+            break;
+        }
+        Cache::Handle *handle = cache->Lookup(key);
+        if (handle != nullptr) {
+            cache->Release(handle);
+            continue;
+        }
+        if (!loader(key, charge, loader_arg)) {
+            break;
+        }
+        loaded += charge;
+        if (options.bytes_per_second > 0) {
+            // Sleep until the average rate since the start is back within budget.
+            uint64_t const due_micros = loaded * 1000000 / options.bytes_per_second;
+            uint64_t elapsed_micros;
+            while (due_micros > (elapsed_micros = env->NowMicros() - start_micros)) {
+                env->SleepForMicroseconds(std::min(due_micros - elapsed_micros, kMaxSleepMicros));
+            }
+        }
+    }
+    return ns_util::Status::OK();
+}
+
+void ScheduleCacheReload(ns_env::Env *env, Cache *cache, std::string const &fname, CacheReloadOptions const &options,
+                         CacheLoadFunc loader, void *loader_arg, CacheReloadDoneFunc done, void *done_arg) {
+    ReloadTask *task = new ReloadTask{env, cache, fname, options, loader, loader_arg, done, done_arg};
+    env->Schedule(RunReloadTask, task);
+}
+
+} // ns_cache
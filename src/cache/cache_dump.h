@@ -0,0 +1,53 @@
+#ifndef _LEVEL_DB_XY_CACHE_DUMP_H_
+#define _LEVEL_DB_XY_CACHE_DUMP_H_
+
+#include "cache.h"
+#include "env.h"
+#include "status.h"
+
+namespace ns_cache {
+
+// Warm start: before shutting down, save the keys of the hottest cache
+// entries with SaveCacheKeys(); after a restart, ReloadCacheKeys() (or its
+// background form ScheduleCacheReload()) walks the saved keys hottest first
+// and asks the caller to bring each one back into the new cache.  Only keys
+// and charges are saved, values are re-read by the loader.
+
+// Called for every saved key that is not in the cache yet, hottest first.
+// Should read the entry for key and insert it into the cache.  charge is the
+// charge the entry had when it was saved.  Returns false to stop the reload.
+using CacheLoadFunc = bool (*)(ns_data_structure::Slice const &key, uint64_t charge, void *arg);
+
+// Called once a scheduled reload has finished, with its outcome.
+using CacheReloadDoneFunc = void (*)(ns_util::Status const &s, void *arg);
+
+struct CacheReloadOptions {
+    // Charge the reload may bring in per second, 0 for no limit.  Charges
+    // stand in for the bytes the loader reads, so this caps the I/O the
+    // reload adds on top of the regular workload.
+    uint64_t bytes_per_second{0};
+    // Stop once this much charge has been loaded, 0 for no limit.
+    uint64_t max_bytes{0};
+};
+
+// Write the keys and charges of up to max_charge worth of the most recently
+// used entries of cache to fname.  The file is replaced atomically.
+ns_util::Status SaveCacheKeys(ns_env::Env *env, Cache const *cache, uint64_t max_charge, std::string const &fname);
+
+// Read the keys saved in fname and call loader(key, charge, loader_arg) for
+// each one that cache does not hold yet, within the limits of options.
+// Returns Corruption if fname was not written by SaveCacheKeys(); nothing is
+// loaded in that case.
+ns_util::Status ReloadCacheKeys(ns_env::Env *env, Cache *cache, std::string const &fname, CacheReloadOptions const &options,
+                                CacheLoadFunc loader, void *loader_arg);
+
+// Same as ReloadCacheKeys(), but runs on env's background thread and returns
+// immediately.  If done is non-null, done(status, done_arg) is called when
+// the reload is over.
+// REQUIRES: cache, loader_arg and done_arg outlive the reload.
+void ScheduleCacheReload(ns_env::Env *env, Cache *cache, std::string const &fname, CacheReloadOptions const &options,
+                         CacheLoadFunc loader, void *loader_arg, CacheReloadDoneFunc done, void *done_arg);
+
+} // ns_cache
+
+#endif
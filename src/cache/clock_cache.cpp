@@ -0,0 +1,420 @@
+#include "cache.h"
+#include "thread_annotation.h"
+#include "hash.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace ns_cache {
+
+namespace {
+
+// Every slot of the table carries one 64-bit meta word:
+//   bits [0, 30)  : external references (handles held by callers)
+//   bits [30, 32) : CLOCK usage counter, bumped on every hit
+//   bits [32, 34) : slot state
+// Lookup() and Release() only touch this word with atomic operations, so hits
+// never take the shard mutex.  Insert(), Erase(), Prune() and the CLOCK sweep
+// are serialized by the shard mutex, which keeps the table layout simple.
+static constexpr uint64_t kRefsBits = 30;
+static constexpr uint64_t kOneRef = 1ULL;
+static constexpr uint64_t kRefsMask = (1ULL << kRefsBits) - 1;
+static constexpr uint64_t kUsageShift = kRefsBits;
+static constexpr uint64_t kOneUsage = 1ULL << kUsageShift;
+static constexpr uint64_t kMaxUsage = 3;
+static constexpr uint64_t kUsageMask = kMaxUsage << kUsageShift;
+static constexpr uint64_t kStateShift = kUsageShift + 2;
+
+enum SlotState : uint64_t {
+    kStateEmpty = 0x0,        // Free slot.
+    kStateConstruction = 0x1, // Exclusively owned by one thread (being filled or freed).
+    kStateVisible = 0x2,      // In the cache, can be found by Lookup().
+    kStateInvisible = 0x3,    // Erased or replaced, freed once the last reference is released.
+};
+
+inline uint64_t GetRefs(uint64_t meta) {
+    return meta & kRefsMask;
+}
+
+inline uint64_t GetUsage(uint64_t meta) {
+    return (meta & kUsageMask) >> kUsageShift;
+}
+
+inline SlotState GetState(uint64_t meta) {
+    return static_cast<SlotState>(meta >> kStateShift);
+}
+
+inline uint64_t MakeMeta(SlotState state, uint64_t refs) {
+    return (static_cast<uint64_t>(state) << kStateShift) | refs;
+}
+
+struct ClockHandle {
+    std::atomic<uint64_t> meta{MakeMeta(kStateEmpty, 0)};
+    // Number of entries whose probe sequence passed over this slot.  A
+    // Lookup() can stop probing at the first non-matching slot with no
+    // displacements.
+    std::atomic<uint32_t> displacements{0};
+    uint32_t hash{0};
+    bool detached{false}; // Not part of any table, see ClockCacheShard::Insert().
+    void *value{nullptr};
+    DeleteFunc deleter{nullptr};
+    void *deleter_arg{nullptr};
+    uint64_t charge{0};
+    std::string key_data;
+
+    ns_data_structure::Slice key() const {
+        return ns_data_structure::Slice(key_data);
+    }
+};
+
+class ClockCacheShard {
+public:
+    ClockCacheShard() :
+        capacity_(0), usage_(0), length_(0), table_(nullptr), clock_hand_(0) {
+    }
+    ClockCacheShard(ClockCacheShard const &) = delete;
+    ClockCacheShard &operator=(ClockCacheShard const &) = delete;
+    ~ClockCacheShard();
+
+    // Must be called once before the shard is used.
+    void Init(uint64_t capacity, uint32_t length);
+
+    Cache::Handle *Insert(ns_data_structure::Slice const &key, uint32_t hash, void *value, uint64_t charge, DeleteFunc deleter, void *deleter_arg);
+    Cache::Handle *Lookup(ns_data_structure::Slice const &key, uint32_t hash);
+    void Release(Cache::Handle *handle);
+    void Erase(ns_data_structure::Slice const &key, uint32_t hash);
+    void Prune();
+    uint64_t TotalCharge() const {
+        return usage_.load(std::memory_order_relaxed);
+    }
+
+private:
+    uint64_t capacity_;
+    std::mutex mutex_;
+    std::atomic<uint64_t> usage_;
+    uint32_t length_;
+    ClockHandle *table_;
+    uint32_t clock_hand_ GUARDED_BY(mutex_);
+
+    uint32_t Probe(uint32_t hash, uint32_t i) const {
+        // length_ is a power of two and the increment is odd, so the first
+        // length_ probes visit every slot exactly once.
+        return (hash + i * ((hash >> 16) | 1U)) & (length_ - 1);
+    }
+    ClockHandle *FindVisible(ns_data_structure::Slice const &key, uint32_t hash) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    bool EvictOne() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    void EvictToFit(uint64_t charge) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    ClockHandle *ClaimSlot(uint32_t hash) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    void MarkInvisible(ClockHandle *h) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    void FreeSlot(ClockHandle *h);
+};
+
+ClockCacheShard::~ClockCacheShard() {
+    for (uint32_t i = 0; i < length_; i++) {
+        ClockHandle *h = &table_[i];
+        uint64_t const meta = h->meta.load(std::memory_order_acquire);
+        // Error if caller has an unreleased handle
+        assert(GetRefs(meta) == 0);
+        if (GetState(meta) == kStateVisible) {
+            h->deleter(h->key(), h->value, h->deleter_arg);
+        }
+    }
+    delete[] table_;
+}
+
+void ClockCacheShard::Init(uint64_t capacity, uint32_t length) {
+    assert(table_ == nullptr);
+    assert((length & (length - 1)) == 0);
+    capacity_ = capacity;
+    length_ = length;
+    table_ = new ClockHandle[length_];
+}
+
+Cache::Handle *ClockCacheShard::Insert(ns_data_structure::Slice const &key, uint32_t hash, void *value, uint64_t charge, DeleteFunc deleter, void *deleter_arg) {
+    ClockHandle *e = nullptr;
+    if (capacity_ > 0) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        ClockHandle *old = FindVisible(key, hash);
+        if (old != nullptr) {
+            MarkInvisible(old);
+        }
+        EvictToFit(charge);
+        e = ClaimSlot(hash);
+        if (e == nullptr && EvictOne()) {
+            e = ClaimSlot(hash);
+        }
+        if (e != nullptr) {
+            e->hash = hash;
+            e->value = value;
+            e->deleter = deleter;
+            e->deleter_arg = deleter_arg;
+            e->charge = charge;
+            e->key_data.assign(reinterpret_cast<char const *>(key.data()), key.size());
+            usage_.fetch_add(charge, std::memory_order_relaxed);
+            e->meta.store(MakeMeta(kStateVisible, 1), std::memory_order_release);
+            return reinterpret_cast<Cache::Handle *>(e);
+        }
+    }
+    // Don't cache.  (capacity_==0 is supported and turns off caching, and a
+    // full table of pinned entries leaves no room.)  The handle is still
+    // returned to the caller and freed on its last Release().
+    e = new ClockHandle();
+    e->detached = true;
+    e->hash = hash;
+    e->value = value;
+    e->deleter = deleter;
+    e->deleter_arg = deleter_arg;
+    e->charge = charge;
+    e->key_data.assign(reinterpret_cast<char const *>(key.data()), key.size());
+    e->meta.store(MakeMeta(kStateInvisible, 1), std::memory_order_release);
+    return reinterpret_cast<Cache::Handle *>(e);
+}
+
+Cache::Handle *ClockCacheShard::Lookup(ns_data_structure::Slice const &key, uint32_t hash) {
+    for (uint32_t i = 0; i < length_; i++) {
+        ClockHandle *h = &table_[Probe(hash, i)];
+        uint64_t meta = h->meta.load(std::memory_order_acquire);
+        while (GetState(meta) == kStateVisible) {
+            uint64_t desired = meta + kOneRef;
+            if (GetUsage(meta) < kMaxUsage) {
+                desired += kOneUsage;
+            }
+            if (h->meta.compare_exchange_weak(meta, desired, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                // The reference pins the slot, so its key can be read safely.
+                if (h->hash == hash && h->key() == key) {
+                    return reinterpret_cast<Cache::Handle *>(h);
+                }
+                Release(reinterpret_cast<Cache::Handle *>(h));
+                break;
+            }
+        }
+        if (h->displacements.load(std::memory_order_acquire) == 0) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+void ClockCacheShard::Release(Cache::Handle *handle) {
+    ClockHandle *h = reinterpret_cast<ClockHandle *>(handle);
+    uint64_t const old_meta = h->meta.fetch_sub(kOneRef, std::memory_order_acq_rel);
+    assert(GetRefs(old_meta) > 0);
+    if (GetRefs(old_meta) == 1 && GetState(old_meta) == kStateInvisible) {
+        // We dropped the last reference of an erased entry; nobody else can
+        // reach it any more, so we own it exclusively.
+        if (h->detached) {
+            h->deleter(h->key(), h->value, h->deleter_arg);
+            delete h;
+        } else {
+            h->meta.store(MakeMeta(kStateConstruction, 0), std::memory_order_relaxed);
+            FreeSlot(h);
+        }
+    }
+}
+
+void ClockCacheShard::Erase(ns_data_structure::Slice const &key, uint32_t hash) {
+    std::unique_lock<std::mutex> lck(mutex_);
+    ClockHandle *h = FindVisible(key, hash);
+    if (h != nullptr) {
+        MarkInvisible(h);
+    }
+}
+
+void ClockCacheShard::Prune() {
+    std::unique_lock<std::mutex> lck(mutex_);
+    for (uint32_t i = 0; i < length_; i++) {
+        ClockHandle *h = &table_[i];
+        uint64_t meta = h->meta.load(std::memory_order_acquire);
+        if (GetState(meta) == kStateVisible && GetRefs(meta) == 0 && h->meta.compare_exchange_strong(meta, MakeMeta(kStateConstruction, 0), std::memory_order_acq_rel)) {
+            usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+            FreeSlot(h);
+        }
+    }
+}
+
+ClockHandle *ClockCacheShard::FindVisible(ns_data_structure::Slice const &key, uint32_t hash) {
+    // Only the mutex holder moves a slot out of kStateVisible, so the fields
+    // of a visible slot are stable here without taking a reference.
+    for (uint32_t i = 0; i < length_; i++) {
+        ClockHandle *h = &table_[Probe(hash, i)];
+        if (GetState(h->meta.load(std::memory_order_acquire)) == kStateVisible && h->hash == hash && h->key() == key) {
+            return h;
+        }
+        if (h->displacements.load(std::memory_order_acquire) == 0) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+bool ClockCacheShard::EvictOne() {
+    // Each unreferenced entry survives at most kMaxUsage passes of the hand.
+    uint32_t const max_steps = length_ * (kMaxUsage + 1);
+    for (uint32_t step = 0; step < max_steps; step++) {
+        ClockHandle *h = &table_[clock_hand_];
+        clock_hand_ = (clock_hand_ + 1) & (length_ - 1);
+        uint64_t meta = h->meta.load(std::memory_order_acquire);
+        if (GetState(meta) != kStateVisible || GetRefs(meta) != 0) {
+            continue;
+        }
+        if (GetUsage(meta) > 0) {
+            // Second chance; a failed CAS means a concurrent hit, which is fine.
+            h->meta.compare_exchange_strong(meta, meta - kOneUsage, std::memory_order_acq_rel);
+        } else if (h->meta.compare_exchange_strong(meta, MakeMeta(kStateConstruction, 0), std::memory_order_acq_rel)) {
+            usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+            FreeSlot(h);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ClockCacheShard::EvictToFit(uint64_t charge) {
+    while (usage_.load(std::memory_order_relaxed) + charge > capacity_) {
+        if (!EvictOne()) {
+            break;
+        }
+    }
+}
+
+ClockHandle *ClockCacheShard::ClaimSlot(uint32_t hash) {
+    for (uint32_t i = 0; i < length_; i++) {
+        ClockHandle *h = &table_[Probe(hash, i)];
+        uint64_t meta = MakeMeta(kStateEmpty, 0);
+        if (h->meta.compare_exchange_strong(meta, MakeMeta(kStateConstruction, 0), std::memory_order_acq_rel)) {
+            return h;
+        }
+        h->displacements.fetch_add(1, std::memory_order_release);
+    }
+    // Table is full; roll back the displacements we just added.
+    for (uint32_t i = 0; i < length_; i++) {
+        table_[Probe(hash, i)].displacements.fetch_sub(1, std::memory_order_release);
+    }
+    return nullptr;
+}
+
+void ClockCacheShard::MarkInvisible(ClockHandle *h) {
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    while (!h->meta.compare_exchange_weak(meta, (meta & ~(3ULL << kStateShift)) | MakeMeta(kStateInvisible, 0), std::memory_order_acq_rel, std::memory_order_acquire)) {
+    }
+    usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+    if (GetRefs(meta) == 0) {
+        // Unreferenced: no Release() will ever see it, free it now.
+        h->meta.store(MakeMeta(kStateConstruction, 0), std::memory_order_relaxed);
+        FreeSlot(h);
+    }
+}
+
+void ClockCacheShard::FreeSlot(ClockHandle *h) {
+    assert(GetState(h->meta.load(std::memory_order_relaxed)) == kStateConstruction);
+    h->deleter(h->key(), h->value, h->deleter_arg);
+    h->deleter = nullptr;
+    h->deleter_arg = nullptr;
+    h->value = nullptr;
+    h->key_data.clear();
+    uint32_t const slot = static_cast<uint32_t>(h - table_);
+    for (uint32_t i = 0; Probe(h->hash, i) != slot; i++) {
+        table_[Probe(h->hash, i)].displacements.fetch_sub(1, std::memory_order_release);
+    }
+    h->meta.store(MakeMeta(kStateEmpty, 0), std::memory_order_release);
+}
+
+static constexpr int32_t kNumShardBits = 4;
+static constexpr int32_t kNumShards = 1 << kNumShardBits;
+// Keep the table at most ~70% full when every entry has the estimated charge.
+static constexpr uint64_t kLoadFactorPercent = 70;
+static constexpr uint32_t kMinTableLength = 16;
+
+class ShardedClockCache : public Cache {
+public:
+    ShardedClockCache(uint64_t capacity, uint64_t estimated_entry_charge) :
+        last_id_(0) {
+        assert(estimated_entry_charge > 0);
+        uint64_t const per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+        uint64_t const entries = (per_shard + estimated_entry_charge - 1) / estimated_entry_charge;
+        uint64_t const wanted = entries * 100 / kLoadFactorPercent;
+        uint32_t length = kMinTableLength;
+        while (length < wanted) {
+            length *= 2;
+        }
+        for (int32_t s = 0; s < kNumShards; s++) {
+            shard_[s].Init(per_shard, length);
+        }
+    }
+    ~ShardedClockCache() override {
+    }
+    using Cache::Insert;
+    using Cache::Lookup;
+    Handle *Insert(ns_data_structure::Slice const &key, void *value, uint64_t charge,
+                   DeleteFunc deleter, void *deleter_arg) override {
+        uint32_t const hash = HashSlice(key);
+        return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter, deleter_arg);
+    }
+
+    Handle *Lookup(ns_data_structure::Slice const &key) override {
+        uint32_t const hash = HashSlice(key);
+        return shard_[Shard(hash)].Lookup(key, hash);
+    }
+
+    void Release(Handle *handle) override {
+        ClockHandle *h = reinterpret_cast<ClockHandle *>(handle);
+        shard_[Shard(h->hash)].Release(handle);
+    }
+
+    void *Value(Handle *handle) override {
+        return reinterpret_cast<ClockHandle *>(handle)->value;
+    }
+
+    void Erase(ns_data_structure::Slice const &key) override {
+        uint32_t const hash = HashSlice(key);
+        shard_[Shard(hash)].Erase(key, hash);
+    }
+
+    uint64_t NewId() override {
+        std::unique_lock<std::mutex> lck(id_mutex_);
+        return ++(last_id_);
+    }
+
+    void Prune() override {
+        for (int32_t s = 0; s < kNumShards; s++) {
+            shard_[s].Prune();
+        }
+    }
+
+    uint64_t TotalCharge() const override {
+        uint64_t total = 0;
+        for (int32_t s = 0; s < kNumShards; s++) {
+            total += shard_[s].TotalCharge();
+        }
+        return total;
+    }
+
+private:
+    ClockCacheShard shard_[kNumShards];
+    std::mutex id_mutex_;
+    uint64_t last_id_;
+
+    static inline uint32_t HashSlice(ns_data_structure::Slice const &s) {
+        return ns_util::Hash(s.data(), s.size(), 0);
+    }
+
+    static uint32_t Shard(uint32_t hash) {
+        return hash >> (32 - kNumShardBits);
+    }
+};
+
+} // anonymous namespace
+
+// Matches the default Options::block_size.
+static constexpr uint64_t kDefaultEstimatedEntryCharge = 4 * 1024;
+
+Cache *NewClockCache(uint64_t capacity) {
+    return new ShardedClockCache(capacity, kDefaultEstimatedEntryCharge);
+}
+
+Cache *NewClockCache(uint64_t capacity, uint64_t estimated_entry_charge) {
+    return new ShardedClockCache(capacity, estimated_entry_charge);
+}
+
+} // ns_cache
@@ -0,0 +1,82 @@
+#include "secondary_cache.h"
+
+#include <memory>
+
+namespace ns_cache {
+
+namespace {
+
+// Saved entries live in a plain LRU cache as heap-allocated strings:
+//    type     : uint8_t, the CompressionType of payload
+//    payload  : uint8_t[]
+class CompressedSecondaryCache : public SecondaryCache {
+public:
+    CompressedSecondaryCache(uint64_t capacity, ns_compression::CompressionType type) :
+        cache_(NewLRUCache(capacity)),
+        type_(ns_compression::CompressionTypeSupported(type) ? type : ns_compression::kNoCompression) {
+    }
+    ~CompressedSecondaryCache() override = default;
+
+    void Insert(ns_data_structure::Slice const &key, void *value, CacheItemHelper const *helper) override {
+        std::string raw(helper->size(value), '\0');
+        helper->save_to(value, reinterpret_cast<uint8_t *>(&raw[0]));
+        std::string *saved = new std::string();
+        std::string compressed;
+        if (type_ != ns_compression::kNoCompression && ns_compression::Compress(type_, raw, &compressed) && compressed.size() < raw.size()) {
+            saved->reserve(compressed.size() + 1);
+            saved->push_back(static_cast<char>(type_));
+            saved->append(compressed);
+        } else {
+            saved->reserve(raw.size() + 1);
+            saved->push_back(static_cast<char>(ns_compression::kNoCompression));
+            saved->append(raw);
+        }
+        cache_->Release(cache_->Insert(key, saved, saved->size(), &DeleteSaved, nullptr));
+    }
+
+    bool Lookup(ns_data_structure::Slice const &key, CacheItemHelper const *helper, void **value, uint64_t *charge) override {
+        Cache::Handle *handle = cache_->Lookup(key);
+        if (handle == nullptr) {
+            return false;
+        }
+        std::string const *saved = reinterpret_cast<std::string const *>(cache_->Value(handle));
+        assert(!saved->empty());
+        ns_compression::CompressionType const type = static_cast<ns_compression::CompressionType>((*saved)[0]);
+        ns_data_structure::Slice payload(saved->data() + 1, saved->size() - 1);
+        bool found;
+        if (type == ns_compression::kNoCompression) {
+            found = helper->create(payload, value, charge);
+        } else {
+            std::string raw;
+            found = ns_compression::Uncompress(type, payload, &raw) && helper->create(raw, value, charge);
+        }
+        cache_->Release(handle);
+        // The entry moves back into the primary cache.
+        cache_->Erase(key);
+        return found;
+    }
+
+    void Erase(ns_data_structure::Slice const &key) override {
+        cache_->Erase(key);
+    }
+
+    uint64_t TotalCharge() const override {
+        return cache_->TotalCharge();
+    }
+
+private:
+    static void DeleteSaved(ns_data_structure::Slice const &key, void *value, void *arg) {
+        delete reinterpret_cast<std::string *>(value);
+    }
+
+    std::unique_ptr<Cache> cache_;
+    ns_compression::CompressionType const type_;
+};
+
+} // anonymous namespace
+
+SecondaryCache *NewCompressedSecondaryCache(uint64_t capacity, ns_compression::CompressionType type) {
+    return new CompressedSecondaryCache(capacity, type);
+}
+
+} // ns_cache
@@ -0,0 +1,75 @@
+#include "frequency_sketch.h"
+
+#include <cassert>
+
+namespace ns_cache {
+
+static constexpr uint64_t kSeeds[] = {
+    0xC3A5C85C97CB3127ULL,
+    0xB492B66FBE98F273ULL,
+    0x9AE16A3B2F90404FULL,
+    0xCBF29CE484222325ULL,
+};
+
+// A sample covers ten accesses per expected entry, as in the TinyLFU paper.
+static constexpr uint64_t kSampleFactor = 10;
+
+FrequencySketch::FrequencySketch(uint64_t expected_entries) :
+    additions_(0) {
+    uint64_t words = 1;
+    while (words < expected_entries) {
+        words *= 2;
+    }
+    table_.assign(words, 0);
+    counter_mask_ = words * 16 - 1;
+    sample_size_ = (expected_entries == 0 ? 1 : expected_entries) * kSampleFactor;
+}
+
+void FrequencySketch::Increment(uint32_t hash) {
+    bool added = false;
+    for (int32_t i = 0; i < kDepth; i++) {
+        uint64_t const index = CounterIndex(hash, i);
+        uint64_t &word = table_[index >> 4];
+        uint64_t const shift = (index & 15) << 2;
+        if (((word >> shift) & kMaxCount) < kMaxCount) {
+            word += (1ULL << shift);
+            added = true;
+        }
+    }
+    if (added && ++additions_ >= sample_size_) {
+        Reset();
+    }
+}
+
+uint32_t FrequencySketch::Frequency(uint32_t hash) const {
+    uint64_t frequency = kMaxCount;
+    for (int32_t i = 0; i < kDepth; i++) {
+        uint64_t const index = CounterIndex(hash, i);
+        uint64_t const count = (table_[index >> 4] >> ((index & 15) << 2)) & kMaxCount;
+        if (count < frequency) {
+            frequency = count;
+        }
+    }
+    return static_cast<uint32_t>(frequency);
+}
+
+uint64_t FrequencySketch::CounterIndex(uint32_t hash, int32_t row) const {
+    // splitmix64 finalizer, so that every row spreads the 32-bit hash
+    // independently over the whole table.
+    uint64_t h = static_cast<uint64_t>(hash) + kSeeds[row];
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h ^= (h >> 31);
+    return h & counter_mask_;
+}
+
+void FrequencySketch::Reset() {
+    // Halve every counter: shift each word and drop the bit that crossed
+    // into the neighbouring nibble.
+    for (uint64_t &word : table_) {
+        word = (word >> 1) & 0x7777777777777777ULL;
+    }
+    additions_ /= 2;
+}
+
+} // ns_cache
@@ -0,0 +1,46 @@
+#ifndef _LEVEL_DB_XY_FREQUENCY_SKETCH_H_
+#define _LEVEL_DB_XY_FREQUENCY_SKETCH_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace ns_cache {
+
+// A count-min sketch of 4-bit counters used by the TinyLFU admission policy
+// to estimate how often a key has been accessed recently.
+//
+// Every key maps to four counters, one per row, packed sixteen to a 64-bit
+// word.  Once the number of recorded accesses reaches the sample size all
+// counters are halved, so the sketch tracks recent rather than all-time
+// popularity.
+//
+// Not thread-safe; callers provide their own synchronization.
+class FrequencySketch {
+public:
+    // Sized so that up to expected_entries keys can be told apart.
+    explicit FrequencySketch(uint64_t expected_entries);
+
+    FrequencySketch(FrequencySketch const &) = delete;
+    FrequencySketch &operator=(FrequencySketch const &) = delete;
+
+    // Record one access of the key with the given hash.
+    void Increment(uint32_t hash);
+    // Return the estimated number of recent accesses, at most 15.
+    uint32_t Frequency(uint32_t hash) const;
+
+private:
+    static constexpr int32_t kDepth = 4;
+    static constexpr uint64_t kMaxCount = 15;
+
+    uint64_t CounterIndex(uint32_t hash, int32_t row) const;
+    void Reset();
+
+    std::vector<uint64_t> table_;
+    uint64_t counter_mask_;
+    uint64_t sample_size_;
+    uint64_t additions_;
+};
+
+} // ns_cache
+
+#endif
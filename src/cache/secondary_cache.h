@@ -0,0 +1,41 @@
+#ifndef _LEVEL_DB_XY_SECONDARY_CACHE_H_
+#define _LEVEL_DB_XY_SECONDARY_CACHE_H_
+
+#include "cache.h"
+#include "compression.h"
+
+namespace ns_cache {
+
+// A second, larger tier behind the block cache.  The primary cache hands
+// over entries it evicts, and asks for them back on a miss before the caller
+// has to go to disk.
+//
+// Implementations must be safe for concurrent use.
+class SecondaryCache {
+public:
+    SecondaryCache() = default;
+    SecondaryCache(SecondaryCache const &) = delete;
+    SecondaryCache &operator=(SecondaryCache const &) = delete;
+    virtual ~SecondaryCache() = default;
+
+    // Save the entry key->value, serialized with helper.  value still belongs
+    // to the caller.
+    virtual void Insert(ns_data_structure::Slice const &key, void *value, CacheItemHelper const *helper) = 0;
+    // If the tier holds key, rebuild the value with helper->create(), store
+    // it in *value and its charge in *charge, drop it from this tier (it is
+    // about to move back into the primary cache) and return true.
+    virtual bool Lookup(ns_data_structure::Slice const &key, CacheItemHelper const *helper, void **value, uint64_t *charge) = 0;
+    // Drop any saved entry for key.
+    virtual void Erase(ns_data_structure::Slice const &key) = 0;
+    // Return the combined size of all saved entries.
+    virtual uint64_t TotalCharge() const = 0;
+};
+
+// Create a secondary cache that keeps up to capacity bytes of entries
+// compressed with type.  If this build does not support type, or an entry
+// does not shrink, it is kept uncompressed.
+SecondaryCache *NewCompressedSecondaryCache(uint64_t capacity, ns_compression::CompressionType type);
+
+} // ns_cache
+
+#endif
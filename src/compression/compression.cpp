@@ -0,0 +1,107 @@
+#include "compression.h"
+
+#if defined(HAVE_SNAPPY)
+#include <snappy.h>
+#endif // defined(HAVE_SNAPPY)
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif // defined(HAVE_ZSTD)
+
+namespace ns_compression {
+
+#if defined(HAVE_ZSTD)
+static constexpr int32_t kZstdCompressionLevel = 1;
+#endif // defined(HAVE_ZSTD)
+
+bool CompressionTypeSupported(CompressionType type) {
+    switch (type) {
+    case kNoCompression:
+        return true;
+    case kSnappyCompression:
+#if defined(HAVE_SNAPPY)
+        return true;
+#else
+        return false;
+#endif // defined(HAVE_SNAPPY)
+    case kZstdCompression:
+#if defined(HAVE_ZSTD)
+        return true;
+#else
+        return false;
+#endif // defined(HAVE_ZSTD)
+    }
+    return false;
+}
+
+bool Compress(CompressionType type, ns_data_structure::Slice const &input, std::string *output) {
+    char const *data = reinterpret_cast<char const *>(input.data());
+    switch (type) {
+    case kNoCompression: {
+        output->assign(data, input.size());
+        return true;
+    }
+    case kSnappyCompression: {
+#if defined(HAVE_SNAPPY)
+        output->resize(snappy::MaxCompressedLength(input.size()));
+        size_t outlen;
+        snappy::RawCompress(data, input.size(), &(*output)[0], &outlen);
+        output->resize(outlen);
+        return true;
+#else
+        return false;
+#endif // defined(HAVE_SNAPPY)
+    }
+    case kZstdCompression: {
+#if defined(HAVE_ZSTD)
+        output->resize(ZSTD_compressBound(input.size()));
+        size_t const outlen = ZSTD_compress(&(*output)[0], output->size(), data, input.size(), kZstdCompressionLevel);
+        if (ZSTD_isError(outlen)) {
+            return false;
+        }
+        output->resize(outlen);
+        return true;
+#else
+        return false;
+#endif // defined(HAVE_ZSTD)
+    }
+    }
+    return false;
+}
+
+bool Uncompress(CompressionType type, ns_data_structure::Slice const &input, std::string *output) {
+    char const *data = reinterpret_cast<char const *>(input.data());
+    switch (type) {
+    case kNoCompression: {
+        output->assign(data, input.size());
+        return true;
+    }
+    case kSnappyCompression: {
+#if defined(HAVE_SNAPPY)
+        size_t ulength;
+        if (!snappy::GetUncompressedLength(data, input.size(), &ulength)) {
+            return false;
+        }
+        output->resize(ulength);
+        return snappy::RawUncompress(data, input.size(), &(*output)[0]);
+#else
+        return false;
+#endif // defined(HAVE_SNAPPY)
+    }
+    case kZstdCompression: {
+#if defined(HAVE_ZSTD)
+        unsigned long long const ulength = ZSTD_getFrameContentSize(data, input.size());
+        if (ulength == ZSTD_CONTENTSIZE_ERROR || ulength == ZSTD_CONTENTSIZE_UNKNOWN) {
+            return false;
+        }
+        output->resize(ulength);
+        size_t const outlen = ZSTD_decompress(&(*output)[0], output->size(), data, input.size());
+        return !ZSTD_isError(outlen) && outlen == ulength;
+#else
+        return false;
+#endif // defined(HAVE_ZSTD)
+    }
+    }
+    return false;
+}
+
+} // ns_compression
@@ -1,6 +1,9 @@
 #ifndef _LEVEL_DB_XY_COMPRESSION_H_
 #define _LEVEL_DB_XY_COMPRESSION_H_
 
+#include "slice.h"
+#include <string>
+
 namespace ns_compression {
 
 enum CompressionType {
@@ -9,6 +12,19 @@ enum CompressionType {
     kZstdCompression = 0x2,
 };
 
+// Return true if this build can compress and uncompress data of type.
+// kNoCompression is always supported.
+bool CompressionTypeSupported(CompressionType type);
+
+// Store the compressed form of input in *output.  Returns false if type is
+// not supported by this build or compression failed.
+bool Compress(CompressionType type, ns_data_structure::Slice const &input, std::string *output);
+
+// Store the uncompressed form of input, which was produced by Compress()
+// with the same type, in *output.  Returns false if type is not supported by
+// this build or input is corrupted.
+bool Uncompress(CompressionType type, ns_data_structure::Slice const &input, std::string *output);
+
 } // ns_compression
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,515 @@
+#include "adaptive_radix_tree.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+namespace ns_data_structure {
+
+namespace {
+
+enum NodeType : uint8_t {
+    kLeaf,
+    kNode4,
+    kNode16,
+    kNode48,
+    kNode256,
+};
+
+} // anonymous namespace
+
+struct AdaptiveRadixTree::Node {
+    explicit Node(uint8_t t) :
+        type(t) {
+    }
+    uint8_t const type;
+};
+
+// The key bytes follow the leaf in its allocation.
+struct AdaptiveRadixTree::Leaf : Node {
+    Leaf(void *v, uint32_t size) :
+        Node(kLeaf), value(v), key_size(size) {
+    }
+    uint8_t *key() {
+        return reinterpret_cast<uint8_t *>(this + 1);
+    }
+    uint8_t const *key() const {
+        return reinterpret_cast<uint8_t const *>(this + 1);
+    }
+    void *const value;
+    uint32_t const key_size;
+};
+
+// Every key below an inner node at depth d (the number of key bytes its
+// ancestors consumed) continues with prefix; the byte after the prefix picks
+// the child.  Prefixes point into the key of some leaf below the node.
+struct AdaptiveRadixTree::Inner : Node {
+    Inner(uint8_t t, uint8_t const *p, uint32_t size) :
+        Node(t), prefix(p), prefix_size(size), num_children(0) {
+    }
+    uint8_t const *const prefix;
+    uint32_t const prefix_size;
+    // Only the writer reads it, except for Node4 and Node16, whose readers
+    // acquire it before reading keys and children.
+    std::atomic<uint16_t> num_children;
+};
+
+// Node4 and Node16 keep keys in insertion order, so that children are only
+// ever appended.
+struct AdaptiveRadixTree::Node4 : Inner {
+    Node4(uint8_t const *p, uint32_t size) :
+        Inner(kNode4, p, size) {
+    }
+    uint8_t keys[4];
+    std::atomic<Node *> children[4];
+};
+
+struct AdaptiveRadixTree::Node16 : Inner {
+    Node16(uint8_t const *p, uint32_t size) :
+        Inner(kNode16, p, size) {
+    }
+    uint8_t keys[16];
+    std::atomic<Node *> children[16];
+};
+
+struct AdaptiveRadixTree::Node48 : Inner {
+    Node48(uint8_t const *p, uint32_t size) :
+        Inner(kNode48, p, size) {
+        for (auto &i : index) {
+            i.store(0, std::memory_order_relaxed);
+        }
+    }
+    // One more than the slot in children of each byte, 0 for none.
+    std::atomic<uint8_t> index[256];
+    std::atomic<Node *> children[48];
+};
+
+struct AdaptiveRadixTree::Node256 : Inner {
+    Node256(uint8_t const *p, uint32_t size) :
+        Inner(kNode256, p, size) {
+        for (auto &c : children) {
+            c.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    std::atomic<Node *> children[256];
+};
+
+AdaptiveRadixTree::AdaptiveRadixTree(ns_memory::Allocator *allocator) :
+    allocator_(allocator), root_(nullptr) {
+}
+
+AdaptiveRadixTree::Leaf *AdaptiveRadixTree::NewLeaf(Slice const &key, void *value) {
+    uint8_t *mem = allocator_->AllocateAligned(sizeof(Leaf) + key.size());
+    Leaf *leaf = new (mem) Leaf(value, key.size());
+    std::memcpy(leaf->key(), key.data(), key.size());
+    return leaf;
+}
+
+AdaptiveRadixTree::Inner *AdaptiveRadixTree::NewInner(uint8_t type, uint8_t const *prefix, uint32_t prefix_size) {
+    switch (type) {
+    case kNode4:
+        return new (allocator_->AllocateAligned(sizeof(Node4))) Node4(prefix, prefix_size);
+    case kNode16:
+        return new (allocator_->AllocateAligned(sizeof(Node16))) Node16(prefix, prefix_size);
+    case kNode48:
+        return new (allocator_->AllocateAligned(sizeof(Node48))) Node48(prefix, prefix_size);
+    default:
+        assert(type == kNode256);
+        return new (allocator_->AllocateAligned(sizeof(Node256))) Node256(prefix, prefix_size);
+    }
+}
+
+AdaptiveRadixTree::Inner *AdaptiveRadixTree::CopyInner(Inner const *node, uint8_t type, uint8_t const *prefix,
+                                                       uint32_t prefix_size) {
+    assert(type >= node->type);
+    Inner *copy = NewInner(type, prefix, prefix_size);
+    for (int32_t b = NextChildByte(node, -1); b < 256; b = NextChildByte(node, b)) {
+        AddChild(copy, static_cast<uint8_t>(b), ChildAt(node, static_cast<uint8_t>(b)));
+    }
+    return copy;
+}
+
+bool AdaptiveRadixTree::IsFull(Inner const *node) {
+    uint16_t const n = node->num_children.load(std::memory_order_relaxed);
+    switch (node->type) {
+    case kNode4:
+        return n == 4;
+    case kNode16:
+        return n == 16;
+    case kNode48:
+        return n == 48;
+    default:
+        return false;
+    }
+}
+
+void AdaptiveRadixTree::AddChild(Inner *node, uint8_t byte, Node *child) {
+    // Fill the slot, then publish it.
+    uint16_t const n = node->num_children.load(std::memory_order_relaxed);
+    switch (node->type) {
+    case kNode4: {
+        auto *n4 = static_cast<Node4 *>(node);
+        n4->keys[n] = byte;
+        n4->children[n].store(child, std::memory_order_relaxed);
+        node->num_children.store(n + 1, std::memory_order_release);
+        break;
+    }
+    case kNode16: {
+        auto *n16 = static_cast<Node16 *>(node);
+        n16->keys[n] = byte;
+        n16->children[n].store(child, std::memory_order_relaxed);
+        node->num_children.store(n + 1, std::memory_order_release);
+        break;
+    }
+    case kNode48: {
+        auto *n48 = static_cast<Node48 *>(node);
+        n48->children[n].store(child, std::memory_order_relaxed);
+        n48->index[byte].store(static_cast<uint8_t>(n + 1), std::memory_order_release);
+        node->num_children.store(n + 1, std::memory_order_relaxed);
+        break;
+    }
+    default:
+        static_cast<Node256 *>(node)->children[byte].store(child, std::memory_order_release);
+        node->num_children.store(n + 1, std::memory_order_relaxed);
+        break;
+    }
+}
+
+std::atomic<AdaptiveRadixTree::Node *> *AdaptiveRadixTree::FindChild(Inner *node, uint8_t byte) {
+    switch (node->type) {
+    case kNode4: {
+        auto *n4 = static_cast<Node4 *>(node);
+        uint16_t const n = node->num_children.load(std::memory_order_acquire);
+        for (uint16_t i = 0; i < n; i++) {
+            if (n4->keys[i] == byte) {
+                return &n4->children[i];
+            }
+        }
+        return nullptr;
+    }
+    case kNode16: {
+        auto *n16 = static_cast<Node16 *>(node);
+        uint16_t const n = node->num_children.load(std::memory_order_acquire);
+        for (uint16_t i = 0; i < n; i++) {
+            if (n16->keys[i] == byte) {
+                return &n16->children[i];
+            }
+        }
+        return nullptr;
+    }
+    case kNode48: {
+        auto *n48 = static_cast<Node48 *>(node);
+        uint8_t const slot = n48->index[byte].load(std::memory_order_acquire);
+        return slot == 0 ? nullptr : &n48->children[slot - 1];
+    }
+    default: {
+        std::atomic<Node *> *child = &static_cast<Node256 *>(node)->children[byte];
+        return child->load(std::memory_order_acquire) == nullptr ? nullptr : child;
+    }
+    }
+}
+
+AdaptiveRadixTree::Node *AdaptiveRadixTree::ChildAt(Inner const *node, uint8_t byte) {
+    // Lookups never write; FindChild() is only non-const for the writer.
+    std::atomic<Node *> *child = FindChild(const_cast<Inner *>(node), byte);
+    return child == nullptr ? nullptr : child->load(std::memory_order_acquire);
+}
+
+int32_t AdaptiveRadixTree::NextChildByte(Inner const *node, int32_t after) {
+    switch (node->type) {
+    case kNode4:
+    case kNode16: {
+        uint8_t const *keys =
+            node->type == kNode4 ? static_cast<Node4 const *>(node)->keys : static_cast<Node16 const *>(node)->keys;
+        uint16_t const n = node->num_children.load(std::memory_order_acquire);
+        int32_t result = 256;
+        for (uint16_t i = 0; i < n; i++) {
+            if (keys[i] > after && keys[i] < result) {
+                result = keys[i];
+            }
+        }
+        return result;
+    }
+    case kNode48: {
+        auto const *n48 = static_cast<Node48 const *>(node);
+        for (int32_t b = after + 1; b < 256; b++) {
+            if (n48->index[b].load(std::memory_order_acquire) != 0) {
+                return b;
+            }
+        }
+        return 256;
+    }
+    default: {
+        auto const *n256 = static_cast<Node256 const *>(node);
+        for (int32_t b = after + 1; b < 256; b++) {
+            if (n256->children[b].load(std::memory_order_acquire) != nullptr) {
+                return b;
+            }
+        }
+        return 256;
+    }
+    }
+}
+
+int32_t AdaptiveRadixTree::PrevChildByte(Inner const *node, int32_t before) {
+    switch (node->type) {
+    case kNode4:
+    case kNode16: {
+        uint8_t const *keys =
+            node->type == kNode4 ? static_cast<Node4 const *>(node)->keys : static_cast<Node16 const *>(node)->keys;
+        uint16_t const n = node->num_children.load(std::memory_order_acquire);
+        int32_t result = -1;
+        for (uint16_t i = 0; i < n; i++) {
+            if (keys[i] < before && keys[i] > result) {
+                result = keys[i];
+            }
+        }
+        return result;
+    }
+    case kNode48: {
+        auto const *n48 = static_cast<Node48 const *>(node);
+        for (int32_t b = before - 1; b >= 0; b--) {
+            if (n48->index[b].load(std::memory_order_acquire) != 0) {
+                return b;
+            }
+        }
+        return -1;
+    }
+    default: {
+        auto const *n256 = static_cast<Node256 const *>(node);
+        for (int32_t b = before - 1; b >= 0; b--) {
+            if (n256->children[b].load(std::memory_order_acquire) != nullptr) {
+                return b;
+            }
+        }
+        return -1;
+    }
+    }
+}
+
+void AdaptiveRadixTree::Insert(Slice const &key, void *value) {
+    Leaf *leaf = NewLeaf(key, value);
+    uint8_t const *k = leaf->key();
+    std::atomic<Node *> *ref = &root_;
+    uint32_t depth = 0;
+    while (true) {
+        // Only the writer stores nodes.
+        Node *node = ref->load(std::memory_order_relaxed);
+        if (node == nullptr) {
+            ref->store(leaf, std::memory_order_release);
+            return;
+        }
+        if (node->type == kLeaf) {
+            // Both keys go below a new node with the bytes they share as its
+            // prefix; being prefix-free, they differ before either ends.
+            Leaf *other = static_cast<Leaf *>(node);
+            uint8_t const *o = other->key();
+            uint32_t i = depth;
+            while (o[i] == k[i]) {
+                i++;
+                assert(i < leaf->key_size && i < other->key_size);
+            }
+            Inner *inner = NewInner(kNode4, k + depth, i - depth);
+            AddChild(inner, o[i], other);
+            AddChild(inner, k[i], leaf);
+            ref->store(inner, std::memory_order_release);
+            return;
+        }
+        Inner *inner = static_cast<Inner *>(node);
+        uint32_t p = 0;
+        while (p < inner->prefix_size && inner->prefix[p] == k[depth + p]) {
+            p++;
+            assert(depth + p < leaf->key_size);
+        }
+        if (p < inner->prefix_size) {
+            // Split the prefix: a new node holds the shared part, with the
+            // rest of the old node (copied, since readers may be on it) and
+            // the leaf below.
+            Inner *split = NewInner(kNode4, inner->prefix, p);
+            Inner *rest = CopyInner(inner, inner->type, inner->prefix + p + 1, inner->prefix_size - p - 1);
+            AddChild(split, inner->prefix[p], rest);
+            AddChild(split, k[depth + p], leaf);
+            ref->store(split, std::memory_order_release);
+            return;
+        }
+        depth += inner->prefix_size;
+        assert(depth < leaf->key_size);
+        std::atomic<Node *> *child = FindChild(inner, k[depth]);
+        if (child != nullptr) {
+            ref = child;
+            depth++;
+            continue;
+        }
+        if (IsFull(inner)) {
+            Inner *bigger = CopyInner(inner, static_cast<uint8_t>(inner->type + 1), inner->prefix, inner->prefix_size);
+            AddChild(bigger, k[depth], leaf);
+            ref->store(bigger, std::memory_order_release);
+        } else {
+            AddChild(inner, k[depth], leaf);
+        }
+        return;
+    }
+}
+
+void *AdaptiveRadixTree::Get(Slice const &key) const {
+    Node const *node = root_.load(std::memory_order_acquire);
+    uint64_t depth = 0;
+    while (node != nullptr) {
+        if (node->type == kLeaf) {
+            auto const *leaf = static_cast<Leaf const *>(node);
+            return Slice(leaf->key(), leaf->key_size) == key ? leaf->value : nullptr;
+        }
+        auto const *inner = static_cast<Inner const *>(node);
+        if (depth + inner->prefix_size >= key.size() ||
+            std::memcmp(inner->prefix, key.data() + depth, inner->prefix_size) != 0) {
+            return nullptr;
+        }
+        depth += inner->prefix_size;
+        node = ChildAt(inner, key[depth]);
+        depth++;
+    }
+    return nullptr;
+}
+
+AdaptiveRadixTree::Iterator::Iterator(AdaptiveRadixTree const *tree) :
+    tree_(tree), leaf_(nullptr) {
+}
+
+bool AdaptiveRadixTree::Iterator::Valid() const {
+    return leaf_ != nullptr;
+}
+
+Slice AdaptiveRadixTree::Iterator::key() const {
+    assert(Valid());
+    return Slice(leaf_->key(), leaf_->key_size);
+}
+
+void *AdaptiveRadixTree::Iterator::value() const {
+    assert(Valid());
+    return leaf_->value;
+}
+
+void AdaptiveRadixTree::Iterator::Next() {
+    assert(Valid());
+    Advance();
+}
+
+void AdaptiveRadixTree::Iterator::Prev() {
+    assert(Valid());
+    Retreat();
+}
+
+void AdaptiveRadixTree::Iterator::Seek(Slice const &target) {
+    stack_.clear();
+    leaf_ = nullptr;
+    Node const *node = tree_->root_.load(std::memory_order_acquire);
+    uint64_t depth = 0;
+    if (node == nullptr) {
+        return;
+    }
+    while (true) {
+        if (node->type == kLeaf) {
+            auto const *leaf = static_cast<Leaf const *>(node);
+            if (Slice(leaf->key(), leaf->key_size).compare(target) >= 0) {
+                leaf_ = leaf;
+            } else {
+                Advance();
+            }
+            return;
+        }
+        auto const *inner = static_cast<Inner const *>(node);
+        uint64_t const rest = target.size() - depth;
+        int32_t cmp = std::memcmp(inner->prefix, target.data() + depth, std::min<uint64_t>(inner->prefix_size, rest));
+        if (cmp == 0 && rest <= inner->prefix_size) {
+            // target ends within the prefix: every key below is greater.
+            cmp = 1;
+        }
+        if (cmp > 0) {
+            DescendLeftmost(inner);
+            return;
+        }
+        if (cmp < 0) {
+            // Every key below is less.
+            Advance();
+            return;
+        }
+        depth += inner->prefix_size;
+        uint8_t const byte = target[depth];
+        stack_.push_back({inner, byte});
+        node = ChildAt(inner, byte);
+        if (node == nullptr) {
+            Advance();
+            return;
+        }
+        depth++;
+    }
+}
+
+void AdaptiveRadixTree::Iterator::SeekToFirst() {
+    stack_.clear();
+    leaf_ = nullptr;
+    Node const *root = tree_->root_.load(std::memory_order_acquire);
+    if (root != nullptr) {
+        DescendLeftmost(root);
+    }
+}
+
+void AdaptiveRadixTree::Iterator::SeekToLast() {
+    stack_.clear();
+    leaf_ = nullptr;
+    Node const *root = tree_->root_.load(std::memory_order_acquire);
+    if (root != nullptr) {
+        DescendRightmost(root);
+    }
+}
+
+void AdaptiveRadixTree::Iterator::DescendLeftmost(Node const *node) {
+    while (node->type != kLeaf) {
+        auto const *inner = static_cast<Inner const *>(node);
+        int32_t const byte = NextChildByte(inner, -1);
+        stack_.push_back({inner, byte});
+        node = ChildAt(inner, static_cast<uint8_t>(byte));
+    }
+    leaf_ = static_cast<Leaf const *>(node);
+}
+
+void AdaptiveRadixTree::Iterator::DescendRightmost(Node const *node) {
+    while (node->type != kLeaf) {
+        auto const *inner = static_cast<Inner const *>(node);
+        int32_t const byte = PrevChildByte(inner, 256);
+        stack_.push_back({inner, byte});
+        node = ChildAt(inner, static_cast<uint8_t>(byte));
+    }
+    leaf_ = static_cast<Leaf const *>(node);
+}
+
+void AdaptiveRadixTree::Iterator::Advance() {
+    leaf_ = nullptr;
+    while (!stack_.empty()) {
+        Level &top = stack_.back();
+        int32_t const byte = NextChildByte(top.node, top.byte);
+        if (byte < 256) {
+            top.byte = byte;
+            DescendLeftmost(ChildAt(top.node, static_cast<uint8_t>(byte)));
+            return;
+        }
+        stack_.pop_back();
+    }
+}
+
+void AdaptiveRadixTree::Iterator::Retreat() {
+    leaf_ = nullptr;
+    while (!stack_.empty()) {
+        Level &top = stack_.back();
+        int32_t const byte = PrevChildByte(top.node, top.byte);
+        if (byte >= 0) {
+            top.byte = byte;
+            DescendRightmost(ChildAt(top.node, static_cast<uint8_t>(byte)));
+            return;
+        }
+        stack_.pop_back();
+    }
+}
+
+} // ns_data_structure
@@ -0,0 +1,109 @@
+#ifndef _LEVEL_DB_XY_ADAPTIVE_RADIX_TREE_H_
+#define _LEVEL_DB_XY_ADAPTIVE_RADIX_TREE_H_
+
+#include "allocator.h"
+#include "slice.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace ns_data_structure {
+
+// An adaptive radix tree (Leis et al., "The Adaptive Radix Tree", ICDE 2013)
+// that maps byte-string keys to values and keeps them in bytewise order.
+// Inner nodes have room for 4, 16, 48 or 256 children and are replaced by
+// the next size when full; a chain of single-child nodes is collapsed into
+// the prefix of the node below it.  A lookup inspects every key byte at
+// most once instead of comparing whole keys.
+//
+// Keys must be prefix-free: no key may be a prefix of another.
+//
+// Thread safety: inserts require external synchronization, reads need
+// none.  A child is added to a node with room by filling the slot first and
+// publishing it last, with a release store; a node that has to grow, or
+// whose prefix is split, is copied and the copy published in its parent.
+// Nodes live in the allocator and are never freed, so readers still on a
+// replaced node remain safe.
+class AdaptiveRadixTree {
+private:
+    struct Node;
+    struct Leaf;
+    struct Inner;
+    struct Node4;
+    struct Node16;
+    struct Node48;
+    struct Node256;
+
+public:
+    explicit AdaptiveRadixTree(ns_memory::Allocator *allocator);
+    AdaptiveRadixTree(AdaptiveRadixTree const &) = delete;
+    AdaptiveRadixTree &operator=(AdaptiveRadixTree const &) = delete;
+
+    // Copies key into the allocator.
+    // REQUIRES: external synchronization with other inserts, the keys in
+    // the tree stay prefix-free with key, key is not in the tree.
+    void Insert(Slice const &key, void *value);
+
+    // The value of key, nullptr if it is not in the tree.
+    void *Get(Slice const &key) const;
+
+    class Iterator {
+    public:
+        explicit Iterator(AdaptiveRadixTree const *tree);
+        bool Valid() const;
+        // REQUIRES: Valid()
+        Slice key() const;
+        void *value() const;
+        void Next();
+        void Prev();
+        // Position at the first key at or after target.
+        void Seek(Slice const &target);
+        void SeekToFirst();
+        void SeekToLast();
+
+    private:
+        // An inner node on the path to the current leaf, and the byte of
+        // the child the path goes through.
+        struct Level {
+            Inner const *node;
+            int32_t byte;
+        };
+
+        // Push the path to the first (last) leaf below node.
+        void DescendLeftmost(Node const *node);
+        void DescendRightmost(Node const *node);
+        // Move to the first leaf after (before) the child at the top of
+        // stack_.
+        void Advance();
+        void Retreat();
+
+        AdaptiveRadixTree const *const tree_;
+        std::vector<Level> stack_;
+        Leaf const *leaf_;
+    };
+
+private:
+    Leaf *NewLeaf(Slice const &key, void *value);
+    Inner *NewInner(uint8_t type, uint8_t const *prefix, uint32_t prefix_size);
+    // A copy of node of type type (at least node's size) with another prefix.
+    Inner *CopyInner(Inner const *node, uint8_t type, uint8_t const *prefix, uint32_t prefix_size);
+
+    static bool IsFull(Inner const *node);
+    // REQUIRES: !IsFull(node), no child at byte.
+    static void AddChild(Inner *node, uint8_t byte, Node *child);
+    // The slot of the child at byte, nullptr if there is none.
+    static std::atomic<Node *> *FindChild(Inner *node, uint8_t byte);
+    static Node *ChildAt(Inner const *node, uint8_t byte);
+    // The smallest byte above after (largest below before) that has a
+    // child, 256 (-1) if there is none.
+    static int32_t NextChildByte(Inner const *node, int32_t after);
+    static int32_t PrevChildByte(Inner const *node, int32_t before);
+
+    ns_memory::Allocator *const allocator_;
+    std::atomic<Node *> root_;
+};
+
+} // ns_data_structure
+
+#endif
@@ -1,5 +1,9 @@
 #include "mem_table.h"
 #include "coding.h"
+#include "hash.h"
+#include <algorithm>
+#include <new>
+#include <vector>
 
 namespace ns_data_structure {
 
@@ -10,13 +14,75 @@ static ns_data_structure::Slice GetLengthPrefixedSlice(uint8_t const *data) {
     return ns_data_structure::Slice(p, len);
 }
 
+// With about 10 bits per key, 6 probes keep false positives near 1%.
+static constexpr uint32_t kBloomProbes = 6;
+
+// Stripes of the in-place update locks; collisions only cost a reader
+// waiting for an unrelated update.
+static constexpr uint32_t kInplaceUpdateLocks = 1024;
+
+static ns_filter_policy::DynamicBloom *NewBloom(ns_options::Options const &options, ns_memory::Arena *arena) {
+    if (options.memtable_bloom_size_ratio <= 0) {
+        return nullptr;
+    }
+    uint64_t const bytes = static_cast<uint64_t>(options.write_buffer_size * options.memtable_bloom_size_ratio);
+    return new (arena->AllocateAligned(sizeof(ns_filter_policy::DynamicBloom)))
+        ns_filter_policy::DynamicBloom(arena, std::max<uint64_t>(bytes * 8, 1), kBloomProbes);
+}
+
 MemTable::MemTable(ns_db_format::InternalKeyComparator const &comparator) :
+    MemTable(comparator, ns_options::Options()) {
+}
+MemTable::MemTable(ns_db_format::InternalKeyComparator const &comparator, ns_options::Options const &options) :
     comparator_(comparator),
     refs_(0),
-    table_(comparator_, &arena_) {
+    arena_(options.arena_block_size, options.memtable_use_huge_pages, options.arena_block_pool),
+    table_(options.memtable_rep_factory != nullptr ? options.memtable_rep_factory->CreateMemTableRep(comparator_, &arena_)
+                                                   : NewSkipListRep(comparator_, &arena_)),
+    bloom_(NewBloom(options, &arena_)),
+    bloom_prefix_length_(options.memtable_bloom_prefix_length),
+    merge_operator_(options.merge_operator),
+    inplace_update_locks_(options.memtable_inplace_update_support ? new std::shared_mutex[kInplaceUpdateLocks] : nullptr),
+    newest_snapshot_(0),
+    has_range_tombstones_(false),
+    write_buffer_manager_(options.write_buffer_manager),
+    reported_usage_(0),
+    immutable_(false) {
+    ReportMemoryUsage();
+}
+MemTable::~MemTable() {
+    assert(refs_ == 0);
+    if (write_buffer_manager_ != nullptr) {
+        if (!immutable_) {
+            write_buffer_manager_->ScheduleFreeMem(reported_usage_);
+        }
+        write_buffer_manager_->FreeMem(reported_usage_);
+    }
+    delete table_;
 }
 uint64_t MemTable::ApproximateMemoryUsage() {
-    return arena_.MemoryUsage();
+    return arena_.MemoryUsage() + table_->ApproximateMemoryUsage();
+}
+void MemTable::MarkImmutable() {
+    if (immutable_) {
+        return;
+    }
+    if (write_buffer_manager_ != nullptr) {
+        write_buffer_manager_->ScheduleFreeMem(reported_usage_);
+    }
+    table_->MarkReadOnly();
+    immutable_ = true;
+}
+void MemTable::ReportMemoryUsage() {
+    if (write_buffer_manager_ == nullptr) {
+        return;
+    }
+    // Memory only grows a block at a time, so most calls report nothing.
+    uint64_t const usage = ApproximateMemoryUsage();
+    if (usage > reported_usage_) {
+        write_buffer_manager_->ReserveMem(usage - reported_usage_);
+        reported_usage_ = usage;
+    }
 }
 
 static uint8_t const *EncodeKey(std::string *scratch, ns_data_structure::Slice const &target) {
@@ -28,37 +94,63 @@ static uint8_t const *EncodeKey(std::string *scratch, ns_data_structure::Slice c
 
 class MemTableIterator : public ns_iterator::Iterator {
 public:
-    explicit MemTableIterator(MemTable::Table *table) :
-        iter_(table) {
+    // Skips the entries that a tombstone in tombstones (may be nullptr) up
+    // to read_seq deletes.
+    MemTableIterator(MemTableRep::Iterator *iter, std::shared_ptr<FragmentedRangeTombstoneList const> tombstones,
+                     ns_db_format::SequenceNumber read_seq) :
+        MemTableIterator(iter, std::move(tombstones), read_seq, nullptr) {
+    }
+    // Same as above, but Seek() to a target whose key prefix mem's bloom
+    // filter rules out leaves the iterator invalid without searching iter.
+    MemTableIterator(MemTableRep::Iterator *iter, std::shared_ptr<FragmentedRangeTombstoneList const> tombstones,
+                     ns_db_format::SequenceNumber read_seq, MemTable const *mem) :
+        iter_(iter),
+        tombstones_(std::move(tombstones)),
+        read_seq_(read_seq),
+        prefix_filter_(mem),
+        filtered_out_(false) {
     }
     MemTableIterator(MemTableIterator const &) = delete;
     MemTableIterator &operator=(MemTableIterator const &) = delete;
 
-    ~MemTableIterator() override = default;
+    ~MemTableIterator() override {
+        delete iter_;
+    }
 
     bool Valid() const override {
-        return iter_.Valid();
+        return !filtered_out_ && iter_->Valid();
     }
     void SeekToFirst() override {
-        iter_.SeekToFirst();
+        filtered_out_ = false;
+        iter_->SeekToFirst();
+        SkipDeletedForward();
     }
     void SeekToLast() override {
-        iter_.SeekToLast();
+        filtered_out_ = false;
+        iter_->SeekToLast();
+        SkipDeletedBackward();
     }
     void Seek(ns_data_structure::Slice const &target) override {
-        iter_.Seek(EncodeKey(&tmp_, target));
+        filtered_out_ = prefix_filter_ != nullptr &&
+                        !prefix_filter_->bloom_->MayContain(prefix_filter_->BloomKey(ns_db_format::ExtractUserKey(target)));
+        if (!filtered_out_) {
+            iter_->Seek(EncodeKey(&tmp_, target));
+            SkipDeletedForward();
+        }
     }
     void Next() override {
-        iter_.Next();
+        iter_->Next();
+        SkipDeletedForward();
     }
     void Prev() override {
-        iter_.Prev();
+        iter_->Prev();
+        SkipDeletedBackward();
     }
     ns_data_structure::Slice key() const override {
-        return GetLengthPrefixedSlice(iter_.key());
+        return GetLengthPrefixedSlice(iter_->key());
     }
     ns_data_structure::Slice value() const override {
-        ns_data_structure::Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+        ns_data_structure::Slice key_slice = GetLengthPrefixedSlice(iter_->key());
         return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
     }
     ns_util::Status status() const override {
@@ -66,15 +158,226 @@ public:
     }
 
 private:
-    MemTable::Table::Iterator iter_;
+    bool Deleted() const {
+        ns_data_structure::Slice const key = GetLengthPrefixedSlice(iter_->key());
+        ns_db_format::SequenceNumber const seq = ns_util::DecodeFixed64(key.data() + key.size() - 8) >> 8;
+        return tombstones_->MaxCoveringSeq(ns_db_format::ExtractUserKey(key), read_seq_) > seq;
+    }
+    void SkipDeletedForward() {
+        if (tombstones_ != nullptr) {
+            while (iter_->Valid() && Deleted()) {
+                iter_->Next();
+            }
+        }
+    }
+    void SkipDeletedBackward() {
+        if (tombstones_ != nullptr) {
+            while (iter_->Valid() && Deleted()) {
+                iter_->Prev();
+            }
+        }
+    }
+
+    MemTableRep::Iterator *const iter_;
+    std::shared_ptr<FragmentedRangeTombstoneList const> const tombstones_;
+    ns_db_format::SequenceNumber const read_seq_;
+    // nullptr unless mem has a prefix bloom filter.
+    MemTable const *const prefix_filter_;
+    bool filtered_out_;
     std::string tmp_;
 };
 
+// Iterates over the fragments of a FragmentedRangeTombstoneList, one entry
+// per fragment and sequence number.
+class RangeTombstoneIterator : public ns_iterator::Iterator {
+public:
+    RangeTombstoneIterator(std::shared_ptr<FragmentedRangeTombstoneList const> tombstones,
+                           ns_comparator::Comparator const *user_comparator) :
+        tombstones_(std::move(tombstones)),
+        user_comparator_(user_comparator),
+        fragment_(tombstones_->fragments().size()),
+        seq_(0) {
+    }
+
+    bool Valid() const override {
+        return fragment_ < tombstones_->fragments().size();
+    }
+    void SeekToFirst() override {
+        SetPosition(0, 0);
+    }
+    void SeekToLast() override {
+        uint64_t const n = tombstones_->fragments().size();
+        SetPosition(n == 0 ? 0 : n - 1, n == 0 ? 0 : tombstones_->fragments()[n - 1].seq_end - 1);
+    }
+    void Seek(ns_data_structure::Slice const &target) override {
+        // The first entry whose internal key is at or after target: a later
+        // start, or the same start and a tag not above target's.
+        ns_data_structure::Slice const user_key = ns_db_format::ExtractUserKey(target);
+        uint64_t const tag = ns_util::DecodeFixed64(target.data() + target.size() - 8);
+        std::vector<FragmentedRangeTombstoneList::Fragment> const &fragments = tombstones_->fragments();
+        auto it = std::lower_bound(fragments.begin(), fragments.end(), user_key,
+                                   [this](FragmentedRangeTombstoneList::Fragment const &f, ns_data_structure::Slice const &k) {
+                                       return user_comparator_->Compare(f.start, k) < 0;
+                                   });
+        if (it != fragments.end() && user_comparator_->Compare(it->start, user_key) == 0) {
+            for (uint64_t i = it->seq_begin; i < it->seq_end; i++) {
+                if (ns_db_format::PackSequenceAndType(tombstones_->seqs()[i], ns_db_format::kTypeRangeDeletion) <= tag) {
+                    SetPosition(it - fragments.begin(), i);
+                    return;
+                }
+            }
+            ++it;
+        }
+        SetPosition(it - fragments.begin(), it != fragments.end() ? it->seq_begin : 0);
+    }
+    void Next() override {
+        assert(Valid());
+        if (seq_ + 1 < tombstones_->fragments()[fragment_].seq_end) {
+            SetPosition(fragment_, seq_ + 1);
+        } else {
+            SetPosition(fragment_ + 1, seq_ + 1);
+        }
+    }
+    void Prev() override {
+        assert(Valid());
+        if (seq_ > tombstones_->fragments()[fragment_].seq_begin) {
+            SetPosition(fragment_, seq_ - 1);
+        } else if (fragment_ > 0) {
+            SetPosition(fragment_ - 1, seq_ - 1);
+        } else {
+            SetPosition(tombstones_->fragments().size(), 0);
+        }
+    }
+    ns_data_structure::Slice key() const override {
+        assert(Valid());
+        return key_;
+    }
+    ns_data_structure::Slice value() const override {
+        assert(Valid());
+        return tombstones_->fragments()[fragment_].end;
+    }
+    ns_util::Status status() const override {
+        return ns_util::Status::OK();
+    }
+
+private:
+    // Fragments and their sequence numbers are laid out in order, so the
+    // sequence number after the last one of a fragment is the first one of
+    // the next.
+    void SetPosition(uint64_t fragment, uint64_t seq) {
+        fragment_ = fragment;
+        seq_ = seq;
+        if (Valid()) {
+            key_.clear();
+            ns_db_format::AppendInternalKey(&key_, ns_db_format::ParsedInternalKey(tombstones_->fragments()[fragment_].start,
+                                                                                   tombstones_->seqs()[seq_],
+                                                                                   ns_db_format::kTypeRangeDeletion));
+        }
+    }
+
+    std::shared_ptr<FragmentedRangeTombstoneList const> const tombstones_;
+    ns_comparator::Comparator const *const user_comparator_;
+    uint64_t fragment_;
+    uint64_t seq_;
+    std::string key_;
+};
+
 ns_iterator::Iterator *MemTable::NewIterator() {
-    return new MemTableIterator(&table_);
+    return new MemTableIterator(table_->NewIterator(), nullptr, ns_db_format::kMaxSequenceNumber);
+}
+
+ns_iterator::Iterator *MemTable::NewIterator(ns_db_format::SequenceNumber read_seq) {
+    return new MemTableIterator(table_->NewIterator(), RangeTombstones(), read_seq);
+}
+
+ns_iterator::Iterator *MemTable::NewPrefixIterator() {
+    bool const prefix_bloom = bloom_ != nullptr && bloom_prefix_length_ > 0;
+    return new MemTableIterator(table_->NewPrefixIterator(), nullptr, ns_db_format::kMaxSequenceNumber,
+                                prefix_bloom ? this : nullptr);
+}
+
+ns_iterator::Iterator *MemTable::NewPrefixIterator(ns_db_format::SequenceNumber read_seq) {
+    bool const prefix_bloom = bloom_ != nullptr && bloom_prefix_length_ > 0;
+    return new MemTableIterator(table_->NewPrefixIterator(), RangeTombstones(), read_seq,
+                                prefix_bloom ? this : nullptr);
+}
+
+ns_iterator::Iterator *MemTable::NewRangeTombstoneIterator() {
+    std::shared_ptr<FragmentedRangeTombstoneList const> tombstones = RangeTombstones();
+    if (tombstones == nullptr) {
+        tombstones = std::make_shared<FragmentedRangeTombstoneList const>(std::vector<RangeTombstone>(),
+                                                                          comparator_.comparator.user_comparator());
+    }
+    return new RangeTombstoneIterator(std::move(tombstones), comparator_.comparator.user_comparator());
+}
+
+std::shared_ptr<FragmentedRangeTombstoneList const> MemTable::RangeTombstones() const {
+    if (!has_range_tombstones_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    std::unique_lock<std::mutex> lck(range_tombstones_mutex_);
+    return fragmented_range_tombstones_;
+}
+
+ns_data_structure::Slice MemTable::BloomKey(ns_data_structure::Slice const &user_key) const {
+    if (bloom_prefix_length_ == 0 || user_key.size() <= bloom_prefix_length_) {
+        return user_key;
+    }
+    return ns_data_structure::Slice(user_key.data(), bloom_prefix_length_);
+}
+
+std::shared_mutex &MemTable::InplaceUpdateLock(ns_data_structure::Slice const &user_key) const {
+    return inplace_update_locks_[ns_util::Hash(user_key.data(), user_key.size(), 0) % kInplaceUpdateLocks];
+}
+
+void MemTable::SetNewestSnapshot(ns_db_format::SequenceNumber seq) {
+    newest_snapshot_ = seq;
+}
+
+bool MemTable::UpdateInPlace(ns_db_format::SequenceNumber seq, ns_data_structure::Slice const &key,
+                             ns_data_structure::Slice const &value) {
+    if (bloom_ != nullptr && !bloom_->MayContain(BloomKey(key))) {
+        return false;
+    }
+    ns_db_format::LookupKey const lkey(key, seq);
+    uint8_t const *const entry = table_->FindGreaterOrEqual(lkey.memtable_key().data());
+    if (entry == nullptr) {
+        return false;
+    }
+    uint32_t key_length;
+    uint8_t const *key_ptr = ns_util::GetVarint32Ptr(entry, entry + 5, &key_length);
+    if (comparator_.comparator.user_comparator()->Compare(ns_data_structure::Slice(key_ptr, key_length - 8), key) != 0) {
+        return false;
+    }
+    uint64_t const tag = ns_util::DecodeFixed64(key_ptr + key_length - 8);
+    ns_db_format::SequenceNumber const existing_seq = tag >> 8;
+    if (static_cast<ns_db_format::ValueType>(tag & 0xFFU) != ns_db_format::ValueType::kTypeValue ||
+        existing_seq <= newest_snapshot_) {
+        return false;
+    }
+    std::shared_ptr<FragmentedRangeTombstoneList const> tombstones = RangeTombstones();
+    if (tombstones != nullptr && tombstones->MaxCoveringSeq(key, seq) > existing_seq) {
+        return false;
+    }
+    // Only the writer changes values, so reading the old one needs no lock.
+    uint8_t *const value_ptr = const_cast<uint8_t *>(key_ptr + key_length);
+    uint32_t existing_size;
+    uint8_t const *const existing_data = ns_util::GetVarint32Ptr(value_ptr, value_ptr + 5, &existing_size);
+    uint64_t const room = existing_data - value_ptr + existing_size;
+    if (ns_util::VarintLength(value.size()) + value.size() > room) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lck(InplaceUpdateLock(key));
+    uint8_t *const p = ns_util::EncodeVarint32(value_ptr, value.size());
+    std::memcpy(p, value.data(), value.size());
+    return true;
 }
 
 void MemTable::Add(ns_db_format::SequenceNumber seq, ns_db_format::ValueType type, ns_data_structure::Slice const &key, ns_data_structure::Slice const &value) {
+    if (type == ns_db_format::ValueType::kTypeValue && inplace_update_locks_ != nullptr &&
+        UpdateInPlace(seq, key, value)) {
+        return;
+    }
     // Format of an entry is concatenation of:
     //  key_size     : varint32 of internal_key.size()
     //  key bytes    : uint8_t[internal_key.size()]
@@ -87,6 +390,7 @@ void MemTable::Add(ns_db_format::SequenceNumber seq, ns_db_format::ValueType typ
     uint64_t const encoded_len = ns_util::VarintLength(internal_key_size) + internal_key_size + ns_util::VarintLength(val_size) + val_size;
     uint8_t *buf = arena_.Allocate(encoded_len);
     uint8_t *p = ns_util::EncodeVarint32(buf, internal_key_size);
+    uint8_t const *const key_start = p;
     std::memcpy(p, key.data(), key_size);
     p += key_size;
     ns_util::EncodeFixed64(p, (seq << 8 | type));
@@ -94,14 +398,88 @@ void MemTable::Add(ns_db_format::SequenceNumber seq, ns_db_format::ValueType typ
     p = ns_util::EncodeVarint32(p, val_size);
     std::memcpy(p, value.data(), val_size);
     assert(p + val_size == buf + encoded_len);
-    table_.Insert(buf);
+    if (type == ns_db_format::ValueType::kTypeRangeDeletion) {
+        // The entry only keeps the keys in the arena.  Range deletions are
+        // rare, so the fragments are simply rebuilt.
+        range_tombstones_.push_back({ns_data_structure::Slice(key_start, key_size),
+                                     ns_data_structure::Slice(p, val_size), seq});
+        std::shared_ptr<FragmentedRangeTombstoneList const> fragmented = std::make_shared<FragmentedRangeTombstoneList const>(
+            range_tombstones_, comparator_.comparator.user_comparator());
+        {
+            std::unique_lock<std::mutex> lck(range_tombstones_mutex_);
+            fragmented_range_tombstones_ = std::move(fragmented);
+        }
+        has_range_tombstones_.store(true, std::memory_order_release);
+        ReportMemoryUsage();
+        return;
+    }
+    if (bloom_ != nullptr) {
+        bloom_->Add(BloomKey(key));
+    }
+    table_->Insert(buf);
+    ReportMemoryUsage();
 }
 
 bool MemTable::Get(ns_db_format::LookupKey const &key, std::string *value, ns_util::Status *s) {
-    ns_data_structure::Slice mem_key = key.memtable_key();
-    Table::Iterator iter(&table_);
-    iter.Seek(mem_key.data());
-    if (iter.Valid()) {
+    std::vector<std::string> merge_operands;
+    if (Get(key, value, s, &merge_operands)) {
+        return true;
+    }
+    if (merge_operands.empty()) {
+        return false;
+    }
+    // Nothing older to merge into.
+    Resolve(key, nullptr, merge_operands, value, s);
+    return true;
+}
+
+bool MemTable::Get(ns_db_format::LookupKey const &key, std::string *value, ns_util::Status *s,
+                   std::vector<std::string> *merge_operands) {
+    std::shared_ptr<FragmentedRangeTombstoneList const> tombstones = RangeTombstones();
+    ns_db_format::SequenceNumber const covering_seq =
+        tombstones != nullptr ? tombstones->MaxCoveringSeq(key.user_key(), key.sequence()) : 0;
+    uint8_t const *entry = nullptr;
+    if (bloom_ == nullptr || bloom_->MayContain(BloomKey(key.user_key()))) {
+        entry = table_->FindGreaterOrEqual(key.memtable_key().data());
+    }
+    return GetFromEntry(entry, key, covering_seq, merge_operands, value, s);
+}
+
+void MemTable::MultiGet(ns_db_format::LookupKey const *const *keys, uint64_t n, std::string *values,
+                        ns_util::Status *statuses, bool *found) {
+    std::shared_ptr<FragmentedRangeTombstoneList const> tombstones = RangeTombstones();
+    // Only search for the keys the bloom filter lets through.
+    std::vector<uint8_t const *> targets;
+    for (uint64_t i = 0; i < n; i++) {
+        if (bloom_ == nullptr || bloom_->MayContain(BloomKey(keys[i]->user_key()))) {
+            targets.push_back(keys[i]->memtable_key().data());
+        }
+    }
+    std::vector<uint8_t const *> entries(targets.size());
+    table_->MultiFindGreaterOrEqual(targets.data(), targets.size(), entries.data());
+    std::vector<std::string> merge_operands;
+    for (uint64_t i = 0, j = 0; i < n; i++) {
+        uint8_t const *entry = nullptr;
+        if (j < targets.size() && targets[j] == keys[i]->memtable_key().data()) {
+            entry = entries[j++];
+        }
+        ns_db_format::SequenceNumber const covering_seq =
+            tombstones != nullptr ? tombstones->MaxCoveringSeq(keys[i]->user_key(), keys[i]->sequence()) : 0;
+        merge_operands.clear();
+        found[i] = GetFromEntry(entry, *keys[i], covering_seq, &merge_operands, &values[i], &statuses[i]);
+        if (!found[i] && !merge_operands.empty()) {
+            Resolve(*keys[i], nullptr, merge_operands, &values[i], &statuses[i]);
+            found[i] = true;
+        }
+    }
+}
+
+bool MemTable::GetFromEntry(uint8_t const *entry, ns_db_format::LookupKey const &key,
+                            ns_db_format::SequenceNumber covering_seq, std::vector<std::string> *merge_operands,
+                            std::string *value, ns_util::Status *s) const {
+    // Only created to walk down a stack of merges.
+    std::unique_ptr<MemTableRep::Iterator> iter;
+    while (entry != nullptr) {
         // entry format is:
         //    klength  varint32
         //    userkey  uint8_t[klength]
@@ -111,34 +489,72 @@ bool MemTable::Get(ns_db_format::LookupKey const &key, std::string *value, ns_ut
         // Check that it belongs to same user key.  We do not check the
         // sequence number since the Seek() call above should have skipped
         // all entries with overly large sequence numbers.
-        uint8_t const *entry = iter.key();
         uint32_t key_length;
         uint8_t const *key_ptr = ns_util::GetVarint32Ptr(entry, entry + 5, &key_length);
-        if (comparator_.comparator.user_comparator()->Compare(ns_data_structure::Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
-            // Correct user key
-            uint64_t const tag = ns_util::DecodeFixed64(key_ptr + key_length - 8);
-            switch (static_cast<ns_db_format::ValueType>(tag & 0xFFU)) {
-            case ns_db_format::ValueType::kTypeValue: {
-                ns_data_structure::Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-                value->assign(reinterpret_cast<char const *>(v.data()), v.size());
-                return true;
-            }
-            case ns_db_format::ValueType::kTypeDeletion: {
-                *s = ns_util::Status::NotFound(ns_data_structure::Slice());
-                return true;
+        if (comparator_.comparator.user_comparator()->Compare(ns_data_structure::Slice(key_ptr, key_length - 8), key.user_key()) != 0) {
+            break;
+        }
+        // Correct user key
+        uint64_t const tag = ns_util::DecodeFixed64(key_ptr + key_length - 8);
+        if ((tag >> 8) < covering_seq) {
+            // Deleted by a newer range tombstone.
+            break;
+        }
+        switch (static_cast<ns_db_format::ValueType>(tag & 0xFFU)) {
+        case ns_db_format::ValueType::kTypeValue: {
+            // The writer may be overwriting the value (see UpdateInPlace()).
+            std::shared_lock<std::shared_mutex> lck;
+            if (inplace_update_locks_ != nullptr) {
+                lck = std::shared_lock<std::shared_mutex>(InplaceUpdateLock(key.user_key()));
             }
-            default:
-                break;
+            ns_data_structure::Slice const v = GetLengthPrefixedSlice(key_ptr + key_length);
+            Resolve(key, &v, *merge_operands, value, s);
+            return true;
+        }
+        case ns_db_format::ValueType::kTypeDeletion:
+            Resolve(key, nullptr, *merge_operands, value, s);
+            return true;
+        case ns_db_format::ValueType::kTypeMerge:
+            // Older entries of the key follow.
+            merge_operands->push_back(GetLengthPrefixedSlice(key_ptr + key_length).ToString());
+            if (iter == nullptr) {
+                iter.reset(table_->NewPrefixIterator());
+                iter->Seek(entry);
             }
+            iter->Next();
+            entry = iter->Valid() ? iter->key() : nullptr;
+            continue;
+        default:
+            return false;
         }
     }
+    if (covering_seq > 0) {
+        // No older entry of the key, but a range tombstone deleted it.
+        Resolve(key, nullptr, *merge_operands, value, s);
+        return true;
+    }
     return false;
 }
 
-int32_t MemTable::KeyComparator::operator()(uint8_t const *ap, uint8_t const *bp) const {
-    ns_data_structure::Slice a = GetLengthPrefixedSlice(ap);
-    ns_data_structure::Slice b = GetLengthPrefixedSlice(bp);
-    return comparator.Compare(a, b);
+void MemTable::Resolve(ns_db_format::LookupKey const &key, ns_data_structure::Slice const *existing_value,
+                       std::vector<std::string> const &merge_operands, std::string *value, ns_util::Status *s) const {
+    if (merge_operands.empty()) {
+        if (existing_value != nullptr) {
+            value->assign(reinterpret_cast<char const *>(existing_value->data()), existing_value->size());
+        } else {
+            *s = ns_util::Status::NotFound(ns_data_structure::Slice());
+        }
+        return;
+    }
+    if (merge_operator_ == nullptr) {
+        *s = ns_util::Status::InvalidArgument("merge operator not set");
+        return;
+    }
+    // The operator takes operands oldest first.
+    std::vector<ns_data_structure::Slice> const operands(merge_operands.rbegin(), merge_operands.rend());
+    if (!merge_operator_->FullMerge(key.user_key(), existing_value, operands, value)) {
+        *s = ns_util::Status::Corruption("merge operator failed");
+    }
 }
 
-} // ns_data_structure
\ No newline at end of file
+} // ns_data_structure
@@ -2,14 +2,33 @@
 #define _LEVEL_DB_XY_MEM_TABLE_H_
 
 #include "db_format.h"
+#include "arena.h"
+#include "dynamic_bloom.h"
 #include "iterator.h"
-#include "skip_list.h"
+#include "mem_table_rep.h"
+#include "options.h"
+#include "range_tombstone.h"
+#include "thread_annotation.h"
+#include "write_buffer_manager.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
 
 namespace ns_data_structure {
 
 class MemTable {
 public:
     explicit MemTable(ns_db_format::InternalKeyComparator const &comparator);
+    // Same as above, configured by the memtable fields of options: arena
+    // blocks (arena_block_size, memtable_use_huge_pages, arena_block_pool),
+    // write_buffer_manager, memtable_rep_factory, the memtable bloom
+    // filter (memtable_bloom_size_ratio, memtable_bloom_prefix_length),
+    // memtable_inplace_update_support and merge_operator.
+    // REQUIRES: the objects options points to outlive the memtable.
+    MemTable(ns_db_format::InternalKeyComparator const &comparator, ns_options::Options const &options);
 
     MemTable(MemTable const &) = delete;
     MemTable &operator=(MemTable const &) = delete;
@@ -30,31 +49,114 @@ public:
 
     uint64_t ApproximateMemoryUsage();
 
-    ns_iterator::Iterator *NewIterator();
+    // The memtable takes no more writes and waits to be flushed; its memory
+    // no longer counts as mutable for the write buffer manager, and its rep
+    // may prepare for the flush (see MemTableRep::MarkReadOnly()).
+    void MarkImmutable();
 
+    // Iterates over every entry, including those a range tombstone (see
+    // Add()) deletes; a flush writes them out along with
+    // NewRangeTombstoneIterator().
+    ns_iterator::Iterator *NewIterator();
+    // Same as above, but skips the entries that range tombstones up to
+    // read_seq delete, as a read at read_seq would.
+    ns_iterator::Iterator *NewIterator(ns_db_format::SequenceNumber read_seq);
+    // Same as NewIterator(), but after Seek(target) only bound to visit the
+    // entries whose user key shares the prefix of target's; see
+    // MemTableRep::NewPrefixIterator().  Cheap with a hash rep, and free
+    // for prefixes a prefix bloom filter rules out.
+    ns_iterator::Iterator *NewPrefixIterator();
+    // Same as above, skipping deleted entries as NewIterator(read_seq).
+    ns_iterator::Iterator *NewPrefixIterator(ns_db_format::SequenceNumber read_seq);
+    // Iterates over the range tombstones, fragmented (see
+    // FragmentedRangeTombstoneList): one entry per fragment and sequence
+    // number, its internal key the fragment start with kTypeRangeDeletion,
+    // its value the fragment end.
+    ns_iterator::Iterator *NewRangeTombstoneIterator();
+
+    // A type of kTypeRangeDeletion deletes the user keys in [key, value)
+    // written before seq; it goes to a list of fragmented range tombstones
+    // that Get() and iterators consult instead of the rep.
     void Add(ns_db_format::SequenceNumber seq, ns_db_format::ValueType type, ns_data_structure::Slice const &key, ns_data_structure::Slice const &value);
+    // In-place updates (see Options::memtable_inplace_update_support) keep
+    // the values snapshots up to seq see.  Call before the next Add() once
+    // such a snapshot is taken; the initial 0 stands for no snapshot.
+    // REQUIRES: external synchronization with Add().
+    void SetNewestSnapshot(ns_db_format::SequenceNumber seq);
+
+    // Merges of key (kTypeMerge entries) are applied to the value or
+    // deletion below them, or to no value if there is none in the memtable.
     bool Get(ns_db_format::LookupKey const &key, std::string *value, ns_util::Status *s);
+    // Same as above, for a memtable with older data behind it: merge
+    // operands of key from newer data come in merge_operands, newest first.
+    // If the memtable has no value or deletion of key below them, it adds
+    // its own operands and returns false, for the caller to go on with
+    // older data.
+    bool Get(ns_db_format::LookupKey const &key, std::string *value, ns_util::Status *s,
+             std::vector<std::string> *merge_operands);
+    // Same as found[i] = Get(*keys[i], &values[i], &statuses[i]) for i in
+    // [0, n).  The skiplist rep interleaves the searches (see
+    // SkipList::MultiSeek) so that their cache misses overlap.
+    void MultiGet(ns_db_format::LookupKey const *const *keys, uint64_t n, std::string *values, ns_util::Status *statuses,
+                  bool *found);
 
 private:
     friend class MemTableIterator;
     friend class MemTableBackwardIterator;
 
-    struct KeyComparator {
-        ns_db_format::InternalKeyComparator const comparator;
-        explicit KeyComparator(ns_db_format::InternalKeyComparator const &c) :
-            comparator(c) {
-        }
-        int32_t operator()(uint8_t const *ap, uint8_t const *bp) const;
-    };
-
-    using Table = ns_data_structure::SkipList<uint8_t const *, KeyComparator>;
-
-    ~MemTable() { assert(refs_ == 0); }; // Private since only Unref() should be used to delete it
-
-    KeyComparator comparator_;
+    ~MemTable(); // Private since only Unref() should be used to delete it
+
+    // Reserve memory growth since the last call with write_buffer_manager_.
+    void ReportMemoryUsage();
+    // What the bloom filter holds of user_key.
+    ns_data_structure::Slice BloomKey(ns_data_structure::Slice const &user_key) const;
+    // nullptr if there are none.
+    std::shared_ptr<FragmentedRangeTombstoneList const> RangeTombstones() const;
+    // Overwrite the value of the newest entry of key with value if it is a
+    // value with room for it that no snapshot sees and no range tombstone
+    // deletes; return whether it did.  The entry keeps its sequence number.
+    bool UpdateInPlace(ns_db_format::SequenceNumber seq, ns_data_structure::Slice const &key,
+                       ns_data_structure::Slice const &value);
+    // The lock of the values of user_key.
+    // REQUIRES: in-place updates are enabled.
+    std::shared_mutex &InplaceUpdateLock(ns_data_structure::Slice const &user_key) const;
+    // The Get() result for key (with merge_operands as in Get()), given
+    // entry, the first entry at or after it (nullptr if none), and the
+    // newest tombstone covering key.
+    bool GetFromEntry(uint8_t const *entry, ns_db_format::LookupKey const &key,
+                      ns_db_format::SequenceNumber covering_seq, std::vector<std::string> *merge_operands,
+                      std::string *value, ns_util::Status *s) const;
+    // Set *value (or *s) to what merge_operands, newest first, make of
+    // existing_value, the value below them (nullptr if none).
+    void Resolve(ns_db_format::LookupKey const &key, ns_data_structure::Slice const *existing_value,
+                 std::vector<std::string> const &merge_operands, std::string *value, ns_util::Status *s) const;
+
+    MemTableKeyComparator comparator_;
     int32_t refs_;
     ns_memory::Arena arena_;
-    Table table_;
+    MemTableRep *const table_;
+    // nullptr if disabled.  Lives in arena_.
+    ns_filter_policy::DynamicBloom *const bloom_;
+    uint64_t const bloom_prefix_length_;
+    ns_merge_operator::MergeOperator const *const merge_operator_;
+    // nullptr unless in-place updates are enabled.  Values are overwritten
+    // under the exclusive lock of their user key's stripe and read under
+    // the shared one.
+    std::unique_ptr<std::shared_mutex[]> const inplace_update_locks_;
+    // Only touched by the writer.
+    ns_db_format::SequenceNumber newest_snapshot_;
+    // Only touched by the writer.
+    std::vector<RangeTombstone> range_tombstones_;
+    // Whether fragmented_range_tombstones_ is set, to read without locking
+    // while there are none.
+    std::atomic<bool> has_range_tombstones_;
+    mutable std::mutex range_tombstones_mutex_;
+    // Rebuilt from range_tombstones_ on every range deletion.
+    std::shared_ptr<FragmentedRangeTombstoneList const> fragmented_range_tombstones_ GUARDED_BY(range_tombstones_mutex_);
+    ns_memory::WriteBufferManager *const write_buffer_manager_;
+    // Memory already reserved with write_buffer_manager_.
+    uint64_t reported_usage_;
+    bool immutable_;
 };
 
 } // ns_data_structure
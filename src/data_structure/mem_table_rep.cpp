@@ -0,0 +1,598 @@
+#include "mem_table_rep.h"
+#include "adaptive_radix_tree.h"
+#include "coding.h"
+#include "hash.h"
+#include "skip_list.h"
+#include "thread_annotation.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ns_data_structure {
+
+namespace {
+
+ns_data_structure::Slice GetLengthPrefixedSlice(uint8_t const *data) {
+    uint32_t len;
+    uint8_t const *p = data;
+    p = ns_util::GetVarint32Ptr(p, p + 5, &len); // 按变长方式存储32位正整数最多需要5字节
+    return ns_data_structure::Slice(p, len);
+}
+
+class SkipListRep : public MemTableRep {
+public:
+    SkipListRep(MemTableKeyComparator const &comparator, ns_memory::Allocator *allocator) :
+        table_(comparator, allocator) {
+    }
+
+    void Insert(uint8_t const *entry) override {
+        table_.Insert(entry);
+    }
+
+    uint64_t ApproximateMemoryUsage() override {
+        // Nodes live in the allocator.
+        return 0;
+    }
+
+    uint8_t const *FindGreaterOrEqual(uint8_t const *target) override {
+        Table::Iterator iter(&table_);
+        iter.Seek(target);
+        return iter.Valid() ? iter.key() : nullptr;
+    }
+
+    void MultiFindGreaterOrEqual(uint8_t const *const *targets, uint64_t n, uint8_t const **results) override {
+        std::vector<Table::Iterator> iters(n, Table::Iterator(&table_));
+        std::vector<Table::Iterator *> iter_ptrs(n);
+        for (uint64_t i = 0; i < n; i++) {
+            iter_ptrs[i] = &iters[i];
+        }
+        table_.MultiSeek(targets, n, iter_ptrs.data());
+        for (uint64_t i = 0; i < n; i++) {
+            results[i] = iters[i].Valid() ? iters[i].key() : nullptr;
+        }
+    }
+
+    MemTableRep::Iterator *NewIterator() override {
+        return new Iterator(&table_);
+    }
+
+private:
+    using Table = SkipList<uint8_t const *, MemTableKeyComparator>;
+
+    class Iterator : public MemTableRep::Iterator {
+    public:
+        explicit Iterator(Table const *table) :
+            iter_(table) {
+        }
+        bool Valid() const override {
+            return iter_.Valid();
+        }
+        uint8_t const *key() const override {
+            return iter_.key();
+        }
+        void Next() override {
+            iter_.Next();
+        }
+        void Prev() override {
+            iter_.Prev();
+        }
+        void Seek(uint8_t const *target) override {
+            iter_.Seek(target);
+        }
+        void SeekToFirst() override {
+            iter_.SeekToFirst();
+        }
+        void SeekToLast() override {
+            iter_.SeekToLast();
+        }
+
+    private:
+        Table::Iterator iter_;
+    };
+
+    Table table_;
+};
+
+class SkipListRepFactory : public MemTableRepFactory {
+public:
+    char const *Name() const override {
+        return "leveldb.SkipListRepFactory";
+    }
+    MemTableRep *CreateMemTableRep(MemTableKeyComparator const &comparator,
+                                   ns_memory::Allocator *allocator) const override {
+        return new SkipListRep(comparator, allocator);
+    }
+};
+
+using EntryVector = std::vector<uint8_t const *>;
+
+// Don't start a sort thread for fewer entries than this.
+static constexpr uint64_t kMinEntriesPerSortThread = 64 * 1024;
+
+// Sort entries on up to one thread per core: every thread sorts a run, then
+// pairs of neighbouring runs are merged, also in parallel, until one is left.
+void ParallelSort(EntryVector *entries, MemTableKeyComparator const &comparator) {
+    auto less = [&comparator](uint8_t const *a, uint8_t const *b) { return comparator(a, b) < 0; };
+    uint64_t const cores = std::max(1U, std::thread::hardware_concurrency());
+    uint64_t const num_runs = std::min(cores, std::max<uint64_t>(1, entries->size() / kMinEntriesPerSortThread));
+    if (num_runs == 1) {
+        std::sort(entries->begin(), entries->end(), less);
+        return;
+    }
+
+    std::vector<EntryVector::iterator> bounds;
+    for (uint64_t i = 0; i <= num_runs; i++) {
+        bounds.push_back(entries->begin() + entries->size() * i / num_runs);
+    }
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < num_runs; i++) {
+        threads.emplace_back([&bounds, &less, i]() { std::sort(bounds[i], bounds[i + 1], less); });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    while (bounds.size() > 2) {
+        threads.clear();
+        std::vector<EntryVector::iterator> merged_bounds;
+        uint64_t i = 0;
+        for (; i + 2 < bounds.size(); i += 2) {
+            threads.emplace_back([&bounds, &less, i]() { std::inplace_merge(bounds[i], bounds[i + 1], bounds[i + 2], less); });
+            merged_bounds.push_back(bounds[i]);
+        }
+        // An odd run out is merged in the next round.
+        for (; i < bounds.size(); i++) {
+            merged_bounds.push_back(bounds[i]);
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        bounds.swap(merged_bounds);
+    }
+}
+
+// Iterates over a sorted vector that nobody modifies any more.
+class SortedVectorIterator : public MemTableRep::Iterator {
+public:
+    SortedVectorIterator(std::shared_ptr<EntryVector const> entries, MemTableKeyComparator const *comparator) :
+        entries_(std::move(entries)), comparator_(comparator), pos_(entries_->end()) {
+    }
+    bool Valid() const override {
+        return pos_ != entries_->end();
+    }
+    uint8_t const *key() const override {
+        assert(Valid());
+        return *pos_;
+    }
+    void Next() override {
+        assert(Valid());
+        ++pos_;
+    }
+    void Prev() override {
+        assert(Valid());
+        if (pos_ == entries_->begin()) {
+            pos_ = entries_->end();
+        } else {
+            --pos_;
+        }
+    }
+    void Seek(uint8_t const *target) override {
+        pos_ = std::lower_bound(entries_->begin(), entries_->end(), target,
+                                [this](uint8_t const *a, uint8_t const *b) { return (*comparator_)(a, b) < 0; });
+    }
+    void SeekToFirst() override {
+        pos_ = entries_->begin();
+    }
+    void SeekToLast() override {
+        pos_ = entries_->empty() ? entries_->end() : entries_->end() - 1;
+    }
+
+private:
+    std::shared_ptr<EntryVector const> const entries_;
+    MemTableKeyComparator const *const comparator_;
+    EntryVector::const_iterator pos_;
+};
+
+class VectorRep : public MemTableRep {
+public:
+    explicit VectorRep(MemTableKeyComparator const &comparator) :
+        comparator_(comparator), entries_(std::make_shared<EntryVector>()), read_only_(false) {
+    }
+
+    void Insert(uint8_t const *entry) override {
+        std::unique_lock<std::mutex> lck(mutex_);
+        assert(!read_only_);
+        entries_->push_back(entry);
+    }
+
+    void MarkReadOnly() override {
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (!read_only_) {
+            ParallelSort(entries_.get(), comparator_);
+            read_only_ = true;
+        }
+    }
+
+    uint64_t ApproximateMemoryUsage() override {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return entries_->capacity() * sizeof(uint8_t const *);
+    }
+
+    uint8_t const *FindGreaterOrEqual(uint8_t const *target) override {
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (read_only_) {
+            auto it = std::lower_bound(entries_->begin(), entries_->end(), target,
+                                       [this](uint8_t const *a, uint8_t const *b) { return comparator_(a, b) < 0; });
+            return it != entries_->end() ? *it : nullptr;
+        }
+        // Unsorted: the smallest entry that is not before target.
+        uint8_t const *result = nullptr;
+        for (uint8_t const *entry : *entries_) {
+            if (comparator_(entry, target) >= 0 && (result == nullptr || comparator_(entry, result) < 0)) {
+                result = entry;
+            }
+        }
+        return result;
+    }
+
+    MemTableRep::Iterator *NewIterator() override {
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (read_only_) {
+            return new SortedVectorIterator(entries_, &comparator_);
+        }
+        // Sort a snapshot; later inserts go to entries_ only.
+        std::shared_ptr<EntryVector> snapshot = std::make_shared<EntryVector>(*entries_);
+        lck.unlock();
+        std::sort(snapshot->begin(), snapshot->end(),
+                  [this](uint8_t const *a, uint8_t const *b) { return comparator_(a, b) < 0; });
+        return new SortedVectorIterator(snapshot, &comparator_);
+    }
+
+private:
+    MemTableKeyComparator const comparator_;
+    std::mutex mutex_;
+    // Sorted once read_only_; shared with the iterators from then on.
+    std::shared_ptr<EntryVector> const entries_ GUARDED_BY(mutex_);
+    bool read_only_ GUARDED_BY(mutex_);
+};
+
+class VectorRepFactory : public MemTableRepFactory {
+public:
+    char const *Name() const override {
+        return "leveldb.VectorRepFactory";
+    }
+    MemTableRep *CreateMemTableRep(MemTableKeyComparator const &comparator,
+                                   ns_memory::Allocator *allocator) const override {
+        return new VectorRep(comparator);
+    }
+};
+
+class HashSkipListRep : public MemTableRep {
+public:
+    HashSkipListRep(MemTableKeyComparator const &comparator, ns_memory::Allocator *allocator, uint64_t prefix_length,
+                    uint64_t bucket_count) :
+        comparator_(comparator),
+        allocator_(allocator),
+        prefix_length_(prefix_length),
+        bucket_count_(bucket_count),
+        buckets_(reinterpret_cast<std::atomic<Bucket *> *>(allocator->AllocateAligned(sizeof(std::atomic<Bucket *>) * bucket_count))) {
+        for (uint64_t i = 0; i < bucket_count_; i++) {
+            new (&buckets_[i]) std::atomic<Bucket *>(nullptr);
+        }
+    }
+
+    void Insert(uint8_t const *entry) override {
+        std::atomic<Bucket *> &slot = buckets_[BucketIndex(entry)];
+        // Only the writer stores buckets.
+        Bucket *bucket = slot.load(std::memory_order_relaxed);
+        if (bucket == nullptr) {
+            bucket = new (allocator_->AllocateAligned(sizeof(Bucket))) Bucket(comparator_, allocator_);
+            slot.store(bucket, std::memory_order_release);
+        }
+        bucket->Insert(entry);
+    }
+
+    uint64_t ApproximateMemoryUsage() override {
+        // Buckets live in the allocator.
+        return 0;
+    }
+
+    uint8_t const *FindGreaterOrEqual(uint8_t const *target) override {
+        Bucket *bucket = GetBucket(target);
+        if (bucket == nullptr) {
+            return nullptr;
+        }
+        Bucket::Iterator iter(bucket);
+        iter.Seek(target);
+        return iter.Valid() ? iter.key() : nullptr;
+    }
+
+    MemTableRep::Iterator *NewIterator() override {
+        std::shared_ptr<EntryVector> entries = std::make_shared<EntryVector>();
+        for (uint64_t i = 0; i < bucket_count_; i++) {
+            Bucket *bucket = buckets_[i].load(std::memory_order_acquire);
+            if (bucket != nullptr) {
+                Bucket::Iterator iter(bucket);
+                for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+                    entries->push_back(iter.key());
+                }
+            }
+        }
+        std::sort(entries->begin(), entries->end(),
+                  [this](uint8_t const *a, uint8_t const *b) { return comparator_(a, b) < 0; });
+        return new SortedVectorIterator(entries, &comparator_);
+    }
+
+    MemTableRep::Iterator *NewPrefixIterator() override {
+        return new PrefixIterator(this);
+    }
+
+private:
+    using Bucket = SkipList<uint8_t const *, MemTableKeyComparator>;
+
+    // Iterates over the bucket of the last Seek() target.  Entries of other
+    // prefixes that share the bucket sort around the target's prefix, never
+    // into it.  Without a Seek() target (SeekToFirst(), SeekToLast()) it
+    // falls back to a full-order iterator.
+    class PrefixIterator : public MemTableRep::Iterator {
+    public:
+        explicit PrefixIterator(HashSkipListRep *rep) :
+            rep_(rep), iter_(nullptr) {
+        }
+        bool Valid() const override {
+            return full_order_ != nullptr ? full_order_->Valid() : iter_.Valid();
+        }
+        uint8_t const *key() const override {
+            return full_order_ != nullptr ? full_order_->key() : iter_.key();
+        }
+        void Next() override {
+            if (full_order_ != nullptr) {
+                full_order_->Next();
+            } else {
+                iter_.Next();
+            }
+        }
+        void Prev() override {
+            if (full_order_ != nullptr) {
+                full_order_->Prev();
+            } else {
+                iter_.Prev();
+            }
+        }
+        void Seek(uint8_t const *target) override {
+            full_order_.reset();
+            // An iterator over no bucket is never valid.
+            Bucket *bucket = rep_->GetBucket(target);
+            iter_ = Bucket::Iterator(bucket);
+            if (bucket != nullptr) {
+                iter_.Seek(target);
+            }
+        }
+        void SeekToFirst() override {
+            FullOrder()->SeekToFirst();
+        }
+        void SeekToLast() override {
+            FullOrder()->SeekToLast();
+        }
+
+    private:
+        MemTableRep::Iterator *FullOrder() {
+            if (full_order_ == nullptr) {
+                full_order_.reset(rep_->NewIterator());
+            }
+            return full_order_.get();
+        }
+
+        HashSkipListRep *const rep_;
+        Bucket::Iterator iter_;
+        std::unique_ptr<MemTableRep::Iterator> full_order_;
+    };
+
+    uint64_t BucketIndex(uint8_t const *entry) const {
+        uint32_t internal_key_size;
+        uint8_t const *user_key = ns_util::GetVarint32Ptr(entry, entry + 5, &internal_key_size);
+        uint64_t const prefix_size = std::min<uint64_t>(prefix_length_, internal_key_size - 8);
+        return ns_util::Hash(user_key, prefix_size, 0) % bucket_count_;
+    }
+
+    Bucket *GetBucket(uint8_t const *entry) const {
+        return buckets_[BucketIndex(entry)].load(std::memory_order_acquire);
+    }
+
+    MemTableKeyComparator const comparator_;
+    ns_memory::Allocator *const allocator_;
+    uint64_t const prefix_length_;
+    uint64_t const bucket_count_;
+    // Created on the first insert into a bucket.
+    std::atomic<Bucket *> *const buckets_;
+};
+
+class HashSkipListRepFactory : public MemTableRepFactory {
+public:
+    HashSkipListRepFactory(uint64_t prefix_length, uint64_t bucket_count) :
+        prefix_length_(prefix_length), bucket_count_(bucket_count) {
+    }
+    char const *Name() const override {
+        return "leveldb.HashSkipListRepFactory";
+    }
+    MemTableRep *CreateMemTableRep(MemTableKeyComparator const &comparator,
+                                   ns_memory::Allocator *allocator) const override {
+        return new HashSkipListRep(comparator, allocator, prefix_length_, bucket_count_);
+    }
+
+private:
+    uint64_t const prefix_length_;
+    uint64_t const bucket_count_;
+};
+
+// The key of an entry in an ArtRep: bytes that sort like the internal key
+// under a bytewise comparator.  The user key comes first, with each 0x00
+// escaped as 0x00 0xff and 0x00 0x00 appended, so that a shorter user key
+// sorts first and no key is a prefix of another; then the tag, inverted and
+// big-endian, so that newer entries sort first.
+class ArtKey {
+public:
+    explicit ArtKey(uint8_t const *entry) {
+        uint32_t internal_key_size;
+        uint8_t const *user_key = ns_util::GetVarint32Ptr(entry, entry + 5, &internal_key_size);
+        uint32_t const user_key_size = internal_key_size - 8;
+        uint64_t const max_size = 2 * static_cast<uint64_t>(user_key_size) + 10;
+        if (max_size > sizeof(space_)) {
+            heap_.reset(new uint8_t[max_size]);
+        }
+        uint8_t *const start = heap_ != nullptr ? heap_.get() : space_;
+        uint8_t *p = start;
+        for (uint32_t i = 0; i < user_key_size; i++) {
+            *p++ = user_key[i];
+            if (user_key[i] == 0) {
+                *p++ = 0xff;
+            }
+        }
+        *p++ = 0;
+        *p++ = 0;
+        uint64_t const tag = ~ns_util::DecodeFixed64(user_key + user_key_size);
+        ns_util::EncodeFixed64(p, __builtin_bswap64(tag));
+        key_ = Slice(start, p + 8 - start);
+    }
+    ArtKey(ArtKey const &) = delete;
+    ArtKey &operator=(ArtKey const &) = delete;
+
+    Slice const &slice() const {
+        return key_;
+    }
+
+private:
+    uint8_t space_[128];
+    std::unique_ptr<uint8_t[]> heap_;
+    Slice key_;
+};
+
+// Requires a bytewise comparator, see ArtKey.
+class ArtRep : public MemTableRep {
+public:
+    explicit ArtRep(ns_memory::Allocator *allocator) :
+        tree_(allocator) {
+    }
+
+    void Insert(uint8_t const *entry) override {
+        tree_.Insert(ArtKey(entry).slice(), const_cast<uint8_t *>(entry));
+    }
+
+    uint64_t ApproximateMemoryUsage() override {
+        // Nodes live in the allocator.
+        return 0;
+    }
+
+    uint8_t const *FindGreaterOrEqual(uint8_t const *target) override {
+        AdaptiveRadixTree::Iterator iter(&tree_);
+        iter.Seek(ArtKey(target).slice());
+        return iter.Valid() ? static_cast<uint8_t const *>(iter.value()) : nullptr;
+    }
+
+    MemTableRep::Iterator *NewIterator() override {
+        return new Iterator(&tree_);
+    }
+
+private:
+    class Iterator : public MemTableRep::Iterator {
+    public:
+        explicit Iterator(AdaptiveRadixTree const *tree) :
+            iter_(tree) {
+        }
+        bool Valid() const override {
+            return iter_.Valid();
+        }
+        uint8_t const *key() const override {
+            return static_cast<uint8_t const *>(iter_.value());
+        }
+        void Next() override {
+            iter_.Next();
+        }
+        void Prev() override {
+            iter_.Prev();
+        }
+        void Seek(uint8_t const *target) override {
+            iter_.Seek(ArtKey(target).slice());
+        }
+        void SeekToFirst() override {
+            iter_.SeekToFirst();
+        }
+        void SeekToLast() override {
+            iter_.SeekToLast();
+        }
+
+    private:
+        AdaptiveRadixTree::Iterator iter_;
+    };
+
+    AdaptiveRadixTree tree_;
+};
+
+class ArtRepFactory : public MemTableRepFactory {
+public:
+    char const *Name() const override {
+        return "leveldb.ArtRepFactory";
+    }
+    MemTableRep *CreateMemTableRep(MemTableKeyComparator const &comparator,
+                                   ns_memory::Allocator *allocator) const override {
+        if (!comparator.bytewise) {
+            return new SkipListRep(comparator, allocator);
+        }
+        return new ArtRep(allocator);
+    }
+};
+
+} // anonymous namespace
+
+int32_t MemTableKeyComparator::operator()(uint8_t const *ap, uint8_t const *bp) const {
+    ns_data_structure::Slice a = GetLengthPrefixedSlice(ap);
+    ns_data_structure::Slice b = GetLengthPrefixedSlice(bp);
+    return comparator.Compare(a, b);
+}
+
+void MemTableKeyComparator::GetKeyPrefix(uint8_t const *entry, uint64_t *prefix, uint32_t *size) const {
+    if (!bytewise) {
+        // Equal prefixes of unknown size: every comparison goes to operator().
+        *prefix = 0;
+        *size = UINT32_MAX;
+        return;
+    }
+    uint32_t internal_key_size;
+    uint8_t const *p = ns_util::GetVarint32Ptr(entry, entry + 5, &internal_key_size);
+    uint32_t const user_key_size = internal_key_size - 8;
+    uint64_t result = 0;
+    if (user_key_size >= 8) {
+        result = __builtin_bswap64(ns_util::DecodeFixed64(p));
+    } else {
+        for (uint32_t i = 0; i < user_key_size; i++) {
+            result |= static_cast<uint64_t>(p[i]) << (56 - 8 * i);
+        }
+    }
+    *prefix = result;
+    *size = user_key_size;
+}
+
+MemTableRep *NewSkipListRep(MemTableKeyComparator const &comparator, ns_memory::Allocator *allocator) {
+    return new SkipListRep(comparator, allocator);
+}
+
+MemTableRepFactory *NewSkipListRepFactory() {
+    return new SkipListRepFactory();
+}
+
+MemTableRepFactory *NewHashSkipListRepFactory(uint64_t prefix_length, uint64_t bucket_count) {
+    assert(bucket_count > 0);
+    return new HashSkipListRepFactory(prefix_length, bucket_count);
+}
+
+MemTableRepFactory *NewVectorRepFactory() {
+    return new VectorRepFactory();
+}
+
+MemTableRepFactory *NewArtRepFactory() {
+    return new ArtRepFactory();
+}
+
+} // ns_data_structure
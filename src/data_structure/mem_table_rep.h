@@ -0,0 +1,144 @@
+#ifndef _LEVEL_DB_XY_MEM_TABLE_REP_H_
+#define _LEVEL_DB_XY_MEM_TABLE_REP_H_
+
+#include "db_format.h"
+#include "allocator.h"
+
+namespace ns_data_structure {
+
+// Orders memtable entries, which start with their internal key prefixed by
+// its varint32 length, by internal key.
+struct MemTableKeyComparator {
+    ns_db_format::InternalKeyComparator const comparator;
+    // Internal keys sort by the bytes of their user key first, so the
+    // skiplist may compare inline user-key prefixes (see SkipList).
+    bool const bytewise;
+    explicit MemTableKeyComparator(ns_db_format::InternalKeyComparator const &c) :
+        comparator(c), bytewise(c.user_comparator() == ns_comparator::BytewiseComparator()) {
+    }
+    int32_t operator()(uint8_t const *ap, uint8_t const *bp) const;
+    void GetKeyPrefix(uint8_t const *entry, uint64_t *prefix, uint32_t *size) const;
+};
+
+// The index a MemTable keeps its entries in.  Entries are allocated by the
+// memtable; a rep only stores pointers to them, and may itself allocate
+// from the memtable's allocator.
+//
+// Insert() requires external synchronization; everything else may run
+// concurrently with one Insert().
+class MemTableRep {
+public:
+    // Iterates over the entries in MemTableKeyComparator order.
+    class Iterator {
+    public:
+        virtual ~Iterator() = default;
+        virtual bool Valid() const = 0;
+        // REQUIRES: Valid()
+        virtual uint8_t const *key() const = 0;
+        virtual void Next() = 0;
+        virtual void Prev() = 0;
+        // Position at the first entry at or after target, an entry-encoded
+        // (length-prefixed) internal key.
+        virtual void Seek(uint8_t const *target) = 0;
+        virtual void SeekToFirst() = 0;
+        virtual void SeekToLast() = 0;
+    };
+
+    MemTableRep() = default;
+    MemTableRep(MemTableRep const &) = delete;
+    MemTableRep &operator=(MemTableRep const &) = delete;
+    virtual ~MemTableRep() = default;
+
+    // REQUIRES: nothing equal to entry is in the rep, MarkReadOnly() has
+    // not been called.
+    virtual void Insert(uint8_t const *entry) = 0;
+
+    // No more inserts will come; the memtable is about to be flushed.
+    virtual void MarkReadOnly() {
+    }
+
+    // Memory the rep holds outside the memtable's allocator.
+    virtual uint64_t ApproximateMemoryUsage() = 0;
+
+    // The first entry at or after target, nullptr if there is none.  Reps
+    // that partition entries by key prefix may return nullptr instead of an
+    // entry with another prefix than target, so this is only good for
+    // finding entries of target's user key.
+    virtual uint8_t const *FindGreaterOrEqual(uint8_t const *target) = 0;
+
+    // Same as results[i] = FindGreaterOrEqual(targets[i]) for i in [0, n).
+    virtual void MultiFindGreaterOrEqual(uint8_t const *const *targets, uint64_t n, uint8_t const **results) {
+        for (uint64_t i = 0; i < n; i++) {
+            results[i] = FindGreaterOrEqual(targets[i]);
+        }
+    }
+
+    // Caller should delete the iterator when it is no longer needed.
+    virtual Iterator *NewIterator() = 0;
+
+    // Same as NewIterator(), but after Seek(target) it is only bound to
+    // visit the entries with the key prefix of target: past them, it may
+    // skip entries or become invalid.  Reps that partition entries by
+    // prefix make this much cheaper than NewIterator().
+    virtual Iterator *NewPrefixIterator() {
+        return NewIterator();
+    }
+};
+
+// Creates the rep of every new memtable of a DB, see
+// ns_options::Options::memtable_rep_factory.
+class MemTableRepFactory {
+public:
+    virtual ~MemTableRepFactory() = default;
+    virtual char const *Name() const = 0;
+    // REQUIRES: comparator and allocator outlive the rep.
+    virtual MemTableRep *CreateMemTableRep(MemTableKeyComparator const &comparator,
+                                           ns_memory::Allocator *allocator) const = 0;
+};
+
+// Return a new skiplist rep, the rep of memtables created without a
+// factory.  REQUIRES: comparator and allocator outlive the rep.
+MemTableRep *NewSkipListRep(MemTableKeyComparator const &comparator, ns_memory::Allocator *allocator);
+
+// Return a factory of skiplist reps: ordered at all times, so reads are cheap
+// while the memtable is still written to.  This is the default.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+MemTableRepFactory *NewSkipListRepFactory();
+
+// Return a factory of hash reps for workloads that read inside known key
+// prefixes (e.g. a tenant id): entries are hashed by the first
+// prefix_length bytes of their user key (all of it if shorter) into
+// bucket_count buckets, each a skiplist of its own.  Get() and prefix
+// iterators search one small bucket instead of the whole memtable; a
+// full-order iterator collects and sorts all entries.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+MemTableRepFactory *NewHashSkipListRepFactory(uint64_t prefix_length, uint64_t bucket_count);
+
+// Return a factory of vector reps for bulk loads: inserts only append to an
+// unsorted vector, which is sorted once, on as many threads as there are
+// cores, when the memtable becomes immutable.  Reads before that scan the
+// whole vector, and iterators copy and sort it, so writers should not
+// expect to read back from the mutable memtable.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+MemTableRepFactory *NewVectorRepFactory();
+
+// Return a factory of adaptive radix tree reps for point-lookup-heavy
+// workloads: a lookup walks the bytes of the key once, without the key
+// comparisons of a skiplist search.  Iterators stay ordered and readers take
+// no locks, like the skiplist's; each entry costs its key again, re-encoded
+// into the tree.  Only memtables with a bytewise user comparator get one,
+// others fall back to a skiplist rep.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+MemTableRepFactory *NewArtRepFactory();
+
+} // ns_data_structure
+
+#endif
@@ -0,0 +1,74 @@
+#include "range_tombstone.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace ns_data_structure {
+
+FragmentedRangeTombstoneList::FragmentedRangeTombstoneList(std::vector<RangeTombstone> const &tombstones,
+                                                           ns_comparator::Comparator const *user_comparator) :
+    user_comparator_(user_comparator) {
+    auto less = [user_comparator](Slice const &a, Slice const &b) { return user_comparator->Compare(a, b) < 0; };
+    std::vector<RangeTombstone const *> by_start;
+    std::vector<Slice> bounds;
+    for (RangeTombstone const &t : tombstones) {
+        if (less(t.start, t.end)) {
+            by_start.push_back(&t);
+            bounds.push_back(t.start);
+            bounds.push_back(t.end);
+        }
+    }
+    std::sort(by_start.begin(), by_start.end(),
+              [&less](RangeTombstone const *a, RangeTombstone const *b) { return less(a->start, b->start); });
+    std::sort(bounds.begin(), bounds.end(), less);
+    bounds.erase(std::unique(bounds.begin(), bounds.end(),
+                             [&less](Slice const &a, Slice const &b) { return !less(a, b) && !less(b, a); }),
+                 bounds.end());
+
+    // Sweep the bounds in order, with the tombstones that started at or
+    // before the current bound and have not ended yet.  They cover all of
+    // the range up to the next bound.
+    std::vector<RangeTombstone const *> active;
+    uint64_t next = 0;
+    for (uint64_t i = 0; i + 1 < bounds.size(); i++) {
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [&](RangeTombstone const *t) { return !less(bounds[i], t->end); }),
+                     active.end());
+        while (next < by_start.size() && !less(bounds[i], by_start[next]->start)) {
+            active.push_back(by_start[next++]);
+        }
+        if (active.empty()) {
+            continue;
+        }
+        Fragment fragment{bounds[i], bounds[i + 1], seqs_.size(), 0};
+        for (RangeTombstone const *t : active) {
+            seqs_.push_back(t->seq);
+        }
+        std::sort(seqs_.begin() + fragment.seq_begin, seqs_.end(), std::greater<ns_db_format::SequenceNumber>());
+        seqs_.erase(std::unique(seqs_.begin() + fragment.seq_begin, seqs_.end()), seqs_.end());
+        fragment.seq_end = seqs_.size();
+        fragments_.push_back(fragment);
+    }
+}
+
+ns_db_format::SequenceNumber FragmentedRangeTombstoneList::MaxCoveringSeq(Slice const &user_key,
+                                                                          ns_db_format::SequenceNumber read_seq) const {
+    // The last fragment that starts at or before user_key.
+    auto it = std::upper_bound(fragments_.begin(), fragments_.end(), user_key,
+                               [this](Slice const &key, Fragment const &f) {
+                                   return user_comparator_->Compare(key, f.start) < 0;
+                               });
+    if (it == fragments_.begin()) {
+        return 0;
+    }
+    --it;
+    if (user_comparator_->Compare(user_key, it->end) >= 0) {
+        return 0;
+    }
+    // Newest first: the first one at most read_seq.
+    auto seq = std::lower_bound(seqs_.begin() + it->seq_begin, seqs_.begin() + it->seq_end, read_seq,
+                                std::greater<ns_db_format::SequenceNumber>());
+    return seq != seqs_.begin() + it->seq_end ? *seq : 0;
+}
+
+} // ns_data_structure
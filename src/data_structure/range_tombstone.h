@@ -0,0 +1,67 @@
+#ifndef _LEVEL_DB_XY_RANGE_TOMBSTONE_H_
+#define _LEVEL_DB_XY_RANGE_TOMBSTONE_H_
+
+#include "comparator.h"
+#include "db_format.h"
+#include "slice.h"
+
+#include <vector>
+
+namespace ns_data_structure {
+
+// Deletes the user keys in [start, end) written before seq.
+struct RangeTombstone {
+    Slice start;
+    Slice end;
+    ns_db_format::SequenceNumber seq;
+};
+
+// A set of range tombstones cut into fragments: non-overlapping
+// [start, end) ranges sorted by start, each with the sequence numbers of
+// the tombstones that cover all of it, newest first.  Finding the
+// tombstones that cover a key is one binary search.
+//
+// Immutable, so it may be shared between threads.  Keys point into the
+// tombstones it was built from.
+class FragmentedRangeTombstoneList {
+public:
+    struct Fragment {
+        Slice start;
+        Slice end;
+        // The fragment's sequence numbers are seqs()[seq_begin, seq_end).
+        uint64_t seq_begin;
+        uint64_t seq_end;
+    };
+
+    // Tombstones may overlap, come in any order and be empty (start not
+    // before end, these are dropped).
+    // REQUIRES: the keys of tombstones outlive the list.
+    FragmentedRangeTombstoneList(std::vector<RangeTombstone> const &tombstones,
+                                 ns_comparator::Comparator const *user_comparator);
+
+    FragmentedRangeTombstoneList(FragmentedRangeTombstoneList const &) = delete;
+    FragmentedRangeTombstoneList &operator=(FragmentedRangeTombstoneList const &) = delete;
+
+    bool empty() const {
+        return fragments_.empty();
+    }
+    std::vector<Fragment> const &fragments() const {
+        return fragments_;
+    }
+    std::vector<ns_db_format::SequenceNumber> const &seqs() const {
+        return seqs_;
+    }
+
+    // The newest sequence number, at most read_seq, of a tombstone that
+    // covers user_key; 0 if there is none.
+    ns_db_format::SequenceNumber MaxCoveringSeq(Slice const &user_key, ns_db_format::SequenceNumber read_seq) const;
+
+private:
+    ns_comparator::Comparator const *const user_comparator_;
+    std::vector<Fragment> fragments_;
+    std::vector<ns_db_format::SequenceNumber> seqs_;
+};
+
+} // ns_data_structure
+
+#endif
@@ -1,31 +1,98 @@
 #ifndef _LEVEL_DB_XY_SKIP_LIST_H_
 #define _LEVEL_DB_XY_SKIP_LIST_H_
 
-#include "arena.h"
+#include "allocator.h"
 #include "random.h"
 #include "log.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <type_traits>
+#include <utility>
 
 namespace ns_data_structure {
 
 static constexpr int32_t kMaxHeight = 12;
 
+// A comparator may let the list settle most comparisons without touching
+// the keys by defining
+//
+//   void GetKeyPrefix(Key const &key, uint64_t *prefix, uint32_t *size) const;
+//
+// which returns the first 8 bytes of the bytes the key sorts by, big-endian
+// and zero-padded, and the number of those bytes.  Keys must sort by these
+// bytes first: a smaller prefix means a smaller key, and of two keys with
+// equal prefixes and at most 8 bytes each the shorter one is smaller.  Every
+// node keeps its key's prefix and size inline, next to its links.
+template <typename Comparator, typename Key, typename = void>
+struct HasKeyPrefix : std::false_type {};
+template <typename Comparator, typename Key>
+struct HasKeyPrefix<Comparator, Key,
+                    std::void_t<decltype(std::declval<Comparator const &>().GetKeyPrefix(
+                        std::declval<Key const &>(), std::declval<uint64_t *>(), std::declval<uint32_t *>()))>>
+    : std::true_type {};
+
+template <bool kEnabled>
+struct SkipListKeyPrefix {
+    uint64_t prefix{0};
+    uint32_t size{0};
+};
+// Without GetKeyPrefix() nodes carry nothing extra (empty base).
+template <>
+struct SkipListKeyPrefix<false> {};
+
 template <typename Key, typename Comparator>
 class SkipList {
 private:
     struct Node;
 
 public:
-    explicit SkipList(Comparator cmp, ns_memory::Arena *arena);
+    explicit SkipList(Comparator cmp, ns_memory::Allocator *arena);
     SkipList(SkipList const &) = delete;
     SkipList(SkipList &&) = delete;
     SkipList &operator=(SkipList const &) = delete;
     SkipList &operator=(SkipList &&) = delete;
 
+    // REQUIRES: external synchronization with other inserts, nothing equal
+    // to key is in the list.
     void Insert(Key const &key);
+    // Same as Insert(), but may run concurrently with other calls of
+    // InsertConcurrently() (not with Insert()).  Nodes are linked bottom-up
+    // with compare-and-swap, so readers never see a node at a level before
+    // it is reachable at all the levels below.
+    // REQUIRES: the allocator is thread-safe (e.g. ConcurrentArena),
+    // nothing equal to key is in the list.
+    void InsertConcurrently(Key const &key);
+
+    // Search position kept between inserts: the nodes a key went between
+    // at every level.  A key that lands in the same or a neighbouring gap
+    // (e.g. the next key of an ascending run) is inserted after a few
+    // comparisons instead of a search from the top of the list.
+    class Splice {
+    public:
+        Splice() :
+            height_(0) {
+        }
+
+    private:
+        friend class SkipList;
+        // Levels [0, height_) are filled in; prev_[height_] is head_ and
+        // next_[height_] nullptr so that the search can always widen.
+        int32_t height_;
+        Node *prev_[kMaxHeight + 1];
+        Node *next_[kMaxHeight + 1];
+    };
+
+    // Same as Insert(), but starts the search from splice and leaves it
+    // right after key.  Any key order is correct, ascending keys are fast.
+    // REQUIRES: external synchronization with other inserts, splice is only
+    // used with this list.
+    void Insert(Key const &key, Splice *splice);
     bool Contains(Key const &key) const;
+    // Number of nodes linked at level, for checking the list's structure.
+    uint64_t CountAtLevel(int32_t level) const;
 
     class Iterator {
     public:
@@ -39,30 +106,55 @@ public:
         void SeekToLast();
 
     private:
+        friend class SkipList;
         SkipList const *list_;
         Node *node_;
     };
 
+    // Same as iters[i]->Seek(targets[i]) for i in [0, n), but walks up to
+    // kSeekGroupSize searches in lockstep: every step of a search prefetches
+    // the node its next step reads, and the other searches run while it
+    // loads, so their cache misses overlap.
+    // REQUIRES: iters[i] iterate over this list.
+    void MultiSeek(Key const *targets, uint64_t n, Iterator *const *iters) const;
+    static constexpr uint64_t kSeekGroupSize = 16;
+
 private:
+    static constexpr bool kHasKeyPrefix = HasKeyPrefix<Comparator, Key>::value;
+    using KeyPrefix = SkipListKeyPrefix<kHasKeyPrefix>;
+
     int32_t GetMaxHeight() const;
-    Node *NewNode(Key const &key, int32_t height);
+    Node *NewNode(Key const &key, KeyPrefix const &prefix, int32_t height);
+    KeyPrefix MakeKeyPrefix(Key const &key) const;
+    // Compare the key of n with key, whose prefix is key_prefix.
+    int32_t CompareNode(Node *n, Key const &key, KeyPrefix const &key_prefix) const;
     int32_t RandomHeight();
+    // Same as RandomHeight(), but safe to call from several threads.
+    static int32_t RandomHeightConcurrently();
     bool Equal(Key const &a, Key const &b) const;
-    bool KeyIsAfterNode(Key const &key, Node *n) const;
+    bool KeyIsAfterNode(Key const &key, KeyPrefix const &key_prefix, Node *n) const;
     Node *FindGreaterOrEqual(Key const &key, Node **prev) const;
     Node *FindLessThan(Key const &key) const;
     Node *FindLast() const;
+    // Starting at before, find the nodes at level that key goes between.
+    // REQUIRES: before is head_ or a node before key.
+    // Stops early at after, a node known not to be before key (may be
+    // nullptr).
+    void FindSpliceForLevel(Key const &key, KeyPrefix const &key_prefix, Node *before, Node *after, int32_t level,
+                            Node **out_prev, Node **out_next) const;
+    // Whether key still goes between the nodes splice holds at level.
+    bool SpliceHoldsKey(Splice const *splice, int32_t level, Key const &key, KeyPrefix const &key_prefix) const;
     Comparator const compare_;
-    ns_memory::Arena *const arena_;
+    ns_memory::Allocator *const arena_;
     Node *const head_;
     std::atomic<int32_t> max_height_;
     ns_algorithm::Random rnd_;
 };
 
 template <typename Key, typename Comparator>
-struct SkipList<Key, Comparator>::Node {
-    explicit Node(Key const &k) :
-        key(k) {
+struct SkipList<Key, Comparator>::Node : public KeyPrefix {
+    Node(Key const &k, KeyPrefix const &p) :
+        KeyPrefix(p), key(k) {
     }
     Key const key;
 
@@ -82,6 +174,12 @@ struct SkipList<Key, Comparator>::Node {
         assert(n >= 0 && n < kMaxHeight);
         next_[n].store(x, std::memory_order_relaxed);
     }
+    // Link x after this node at level n if its successor there is still
+    // expected.  Release so that readers see x fully initialized.
+    bool CASNext(int32_t n, Node *expected, Node *x) {
+        assert(n >= 0 && n < kMaxHeight);
+        return next_[n].compare_exchange_strong(expected, x, std::memory_order_release, std::memory_order_relaxed);
+    }
 
 private:
     std::atomic<Node *> next_[1]; // 柔性数组
@@ -90,10 +188,10 @@ private:
  * SkipList Impl
  */
 template <typename Key, typename Comparator>
-SkipList<Key, Comparator>::SkipList(Comparator cmp, ns_memory::Arena *arena) :
+SkipList<Key, Comparator>::SkipList(Comparator cmp, ns_memory::Allocator *arena) :
     compare_(cmp),
     arena_(arena),
-    head_(NewNode(0, kMaxHeight)),
+    head_(NewNode(0, KeyPrefix(), kMaxHeight)),
     max_height_(1),
     rnd_(0xDEADBEEFU) {
     for (int32_t i = 0; i < kMaxHeight; i++) {
@@ -105,6 +203,7 @@ void SkipList<Key, Comparator>::Insert(Key const &key) {
     Node *prev[kMaxHeight];
     Node *x = FindGreaterOrEqual(key, prev);
     assert(x == nullptr || !Equal(key, x->key));
+    KeyPrefix const key_prefix = MakeKeyPrefix(key);
     int32_t height = RandomHeight();
     if (height > GetMaxHeight()) {
         for (int32_t i = GetMaxHeight(); i < height; i++) {
@@ -112,13 +211,94 @@ void SkipList<Key, Comparator>::Insert(Key const &key) {
         }
         max_height_.store(height, std::memory_order_relaxed);
     }
-    x = NewNode(key, height);
+    x = NewNode(key, key_prefix, height);
     for (int32_t i = 0; i < height; i++) {
         x->NoBarrier_SetNext(i, prev[i]->NoBarrier_Next(i));
         prev[i]->SetNext(i, x);
     }
 }
 template <typename Key, typename Comparator>
+void SkipList<Key, Comparator>::Insert(Key const &key, Splice *splice) {
+    KeyPrefix const key_prefix = MakeKeyPrefix(key);
+    int32_t const height = RandomHeight();
+    int32_t max_height = GetMaxHeight();
+    if (height > max_height) {
+        max_height_.store(height, std::memory_order_relaxed);
+        max_height = height;
+    }
+
+    // x is linked from the splice at every level below height, so all of
+    // those gaps must still hold key, not just the lowest one.  Levels below
+    // the lowest gap that starts an unbroken run of good gaps up to height
+    // are searched again, starting from that gap.
+    int32_t level = height;
+    if (splice->height_ < max_height) {
+        // The list grew taller than the splice, start over.
+        splice->height_ = max_height;
+        level = max_height;
+    } else {
+        for (int32_t i = height - 1; i >= 0 && SpliceHoldsKey(splice, i, key, key_prefix); i--) {
+            level = i;
+        }
+        // The gap right below height is stale: widen from above it.
+        while (level >= height && level < max_height && !SpliceHoldsKey(splice, level, key, key_prefix)) {
+            level++;
+        }
+    }
+    splice->prev_[splice->height_] = head_;
+    splice->next_[splice->height_] = nullptr;
+    for (int32_t i = level - 1; i >= 0; i--) {
+        FindSpliceForLevel(key, key_prefix, splice->prev_[i + 1], splice->next_[i + 1], i, &splice->prev_[i],
+                           &splice->next_[i]);
+    }
+    assert(splice->next_[0] == nullptr || !Equal(key, splice->next_[0]->key));
+
+    Node *x = NewNode(key, key_prefix, height);
+    for (int32_t i = 0; i < height; i++) {
+        x->NoBarrier_SetNext(i, splice->next_[i]);
+        splice->prev_[i]->SetNext(i, x);
+        // The next ascending key goes right after x.
+        splice->prev_[i] = x;
+    }
+}
+template <typename Key, typename Comparator>
+void SkipList<Key, Comparator>::InsertConcurrently(Key const &key) {
+    KeyPrefix const key_prefix = MakeKeyPrefix(key);
+    int32_t const height = RandomHeightConcurrently();
+    int32_t max_height = GetMaxHeight();
+    while (height > max_height) {
+        // On failure max_height is reloaded, and the loop ends as soon as
+        // anyone raised it to at least height.
+        if (max_height_.compare_exchange_weak(max_height, height, std::memory_order_relaxed)) {
+            max_height = height;
+            break;
+        }
+    }
+
+    // Splice at every level, found top-down from the highest level in use.
+    Node *prev[kMaxHeight];
+    Node *next[kMaxHeight];
+    Node *before = head_;
+    for (int32_t i = max_height - 1; i >= 0; i--) {
+        FindSpliceForLevel(key, key_prefix, before, nullptr, i, &prev[i], &next[i]);
+        before = prev[i];
+    }
+    assert(next[0] == nullptr || !Equal(key, next[0]->key));
+
+    Node *x = NewNode(key, key_prefix, height);
+    for (int32_t i = 0; i < height; i++) {
+        while (true) {
+            x->NoBarrier_SetNext(i, next[i]);
+            if (prev[i]->CASNext(i, next[i], x)) {
+                break;
+            }
+            // Another writer linked a node into this gap; the new splice is
+            // after prev[i] since nodes are never removed.
+            FindSpliceForLevel(key, key_prefix, prev[i], nullptr, i, &prev[i], &next[i]);
+        }
+    }
+}
+template <typename Key, typename Comparator>
 bool SkipList<Key, Comparator>::Contains(Key const &key) const {
     Node *x = FindGreaterOrEqual(key, nullptr);
     if (x != nullptr && Equal(key, x->key)) {
@@ -127,15 +307,45 @@ bool SkipList<Key, Comparator>::Contains(Key const &key) const {
     return false;
 }
 template <typename Key, typename Comparator>
+uint64_t SkipList<Key, Comparator>::CountAtLevel(int32_t level) const {
+    assert(level >= 0 && level < kMaxHeight);
+    uint64_t count = 0;
+    for (Node *x = head_->Next(level); x != nullptr; x = x->Next(level)) {
+        count++;
+    }
+    return count;
+}
+template <typename Key, typename Comparator>
 int32_t SkipList<Key, Comparator>::GetMaxHeight() const {
     return max_height_.load(std::memory_order_relaxed);
 }
 template <typename Key, typename Comparator>
-typename SkipList<Key, Comparator>::Node *SkipList<Key, Comparator>::NewNode(Key const &key, int32_t height) {
+typename SkipList<Key, Comparator>::Node *SkipList<Key, Comparator>::NewNode(Key const &key, KeyPrefix const &prefix,
+                                                                           int32_t height) {
     // 总高度是height，需要height个Node指针，由于Node本身有一个Node* next_[0]， 所以需要height - 1个Node指针
     uint8_t *const node_memory = arena_->AllocateAligned(sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1));
     // 将分配的内存node_memory直接作为new的内存，不需要new再分配，且node_memory经过内存对齐，效率更高
-    return new (node_memory) Node(key);
+    return new (node_memory) Node(key, prefix);
+}
+template <typename Key, typename Comparator>
+typename SkipList<Key, Comparator>::KeyPrefix SkipList<Key, Comparator>::MakeKeyPrefix(Key const &key) const {
+    KeyPrefix result;
+    if constexpr (kHasKeyPrefix) {
+        compare_.GetKeyPrefix(key, &result.prefix, &result.size);
+    }
+    return result;
+}
+template <typename Key, typename Comparator>
+int32_t SkipList<Key, Comparator>::CompareNode(Node *n, Key const &key, KeyPrefix const &key_prefix) const {
+    if constexpr (kHasKeyPrefix) {
+        if (n->prefix != key_prefix.prefix) {
+            return n->prefix < key_prefix.prefix ? -1 : 1;
+        }
+        if (n->size != key_prefix.size && n->size <= 8 && key_prefix.size <= 8) {
+            return n->size < key_prefix.size ? -1 : 1;
+        }
+    }
+    return compare_(n->key, key);
 }
 template <typename Key, typename Comparator>
 int32_t SkipList<Key, Comparator>::RandomHeight() {
@@ -148,20 +358,38 @@ int32_t SkipList<Key, Comparator>::RandomHeight() {
     return height;
 }
 template <typename Key, typename Comparator>
+int32_t SkipList<Key, Comparator>::RandomHeightConcurrently() {
+    static constexpr uint32_t kBranching{4U};
+    static std::atomic<uint32_t> seed{0xDEADBEEFU};
+    thread_local ns_algorithm::Random rnd(seed.fetch_add(0x9E3779B9U, std::memory_order_relaxed));
+    int32_t height{1};
+    while (height < kMaxHeight && rnd.OneIn(kBranching)) {
+        height++;
+    }
+    assert(height > 0 && height <= kMaxHeight);
+    return height;
+}
+template <typename Key, typename Comparator>
 bool SkipList<Key, Comparator>::Equal(Key const &a, Key const &b) const {
     return compare_(a, b) == 0;
 }
 template <typename Key, typename Comparator>
-bool SkipList<Key, Comparator>::KeyIsAfterNode(Key const &key, Node *n) const {
-    return (n != nullptr) && (compare_(n->key, key) < 0);
+bool SkipList<Key, Comparator>::KeyIsAfterNode(Key const &key, KeyPrefix const &key_prefix, Node *n) const {
+    return (n != nullptr) && (CompareNode(n, key, key_prefix) < 0);
 }
 template <typename Key, typename Comparator>
 typename SkipList<Key, Comparator>::Node *SkipList<Key, Comparator>::FindGreaterOrEqual(Key const &key, Node **prev) const {
+    KeyPrefix const key_prefix = MakeKeyPrefix(key);
     Node *x = head_;
     int32_t level = GetMaxHeight() - 1;
     while (true) {
         Node *next = x->Next(level);
-        if(next != nullptr && compare_(next->key, key) < 0) {
+        if (next != nullptr) {
+            // Where the search goes if it moves to next; loads while next
+            // is compared.
+            __builtin_prefetch(next->NoBarrier_Next(level));
+        }
+        if(next != nullptr && CompareNode(next, key, key_prefix) < 0) {
           x = next;
         } else {
             if(prev != nullptr) {
@@ -177,13 +405,57 @@ typename SkipList<Key, Comparator>::Node *SkipList<Key, Comparator>::FindGreater
     return nullptr;
 }
 template <typename Key, typename Comparator>
+void SkipList<Key, Comparator>::MultiSeek(Key const *targets, uint64_t n, Iterator *const *iters) const {
+    struct Search {
+        KeyPrefix key_prefix;
+        Node *x;
+        int32_t level; // -1 once done
+    };
+    Search searches[kSeekGroupSize];
+    for (uint64_t begin = 0; begin < n; begin += kSeekGroupSize) {
+        uint64_t const group_size = std::min(kSeekGroupSize, n - begin);
+        int32_t const top_level = GetMaxHeight() - 1;
+        for (uint64_t i = 0; i < group_size; i++) {
+            searches[i].key_prefix = MakeKeyPrefix(targets[begin + i]);
+            searches[i].x = head_;
+            searches[i].level = top_level;
+        }
+        uint64_t active = group_size;
+        while (active > 0) {
+            for (uint64_t i = 0; i < group_size; i++) {
+                Search &search = searches[i];
+                if (search.level < 0) {
+                    continue;
+                }
+                // Same steps as FindGreaterOrEqual(), one per round.
+                Node *next = search.x->Next(search.level);
+                if (next != nullptr && CompareNode(next, targets[begin + i], search.key_prefix) < 0) {
+                    search.x = next;
+                } else if (search.level == 0) {
+                    iters[begin + i]->node_ = next;
+                    search.level = -1;
+                    active--;
+                    continue;
+                } else {
+                    search.level--;
+                }
+                __builtin_prefetch(search.x->NoBarrier_Next(search.level));
+            }
+        }
+    }
+}
+template <typename Key, typename Comparator>
 typename SkipList<Key, Comparator>::Node *SkipList<Key, Comparator>::FindLessThan(Key const &key) const {
+    KeyPrefix const key_prefix = MakeKeyPrefix(key);
     Node *x = head_;
     int32_t level = GetMaxHeight() - 1;
     while (true) {
         assert(x == head_ || compare_(x->key, key) < 0);
         Node *next = x->Next(level);
-        if (next == nullptr || compare_(next->key, key) >= 0) {
+        if (next != nullptr) {
+            __builtin_prefetch(next->NoBarrier_Next(level));
+        }
+        if (next == nullptr || CompareNode(next, key, key_prefix) >= 0) {
             if (level == 0) {
                 return x;
             } else {
@@ -213,6 +485,28 @@ typename SkipList<Key, Comparator>::Node *SkipList<Key, Comparator>::FindLast()
     }
     return nullptr;
 }
+template <typename Key, typename Comparator>
+void SkipList<Key, Comparator>::FindSpliceForLevel(Key const &key, KeyPrefix const &key_prefix, Node *before,
+                                                   Node *after, int32_t level, Node **out_prev, Node **out_next) const {
+    while (true) {
+        Node *next = before->Next(level);
+        if (next == after || !KeyIsAfterNode(key, key_prefix, next)) {
+            *out_prev = before;
+            *out_next = next;
+            return;
+        }
+        before = next;
+    }
+}
+template <typename Key, typename Comparator>
+bool SkipList<Key, Comparator>::SpliceHoldsKey(Splice const *splice, int32_t level, Key const &key,
+                                               KeyPrefix const &key_prefix) const {
+    Node *prev = splice->prev_[level];
+    Node *next = splice->next_[level];
+    return prev->NoBarrier_Next(level) == next                         // no other insert went in between
+           && (prev == head_ || CompareNode(prev, key, key_prefix) < 0) // key is not before the gap
+           && !KeyIsAfterNode(key, key_prefix, next);                   // key is not after the gap
+}
 /**
  * SkipList::Iterator Impl
  */
@@ -56,7 +56,7 @@ public:
         if(ret == 0) {
             if(size() < b.size()) {
                 ret = -1;
-            } else {
+            } else if(size() > b.size()) {
                 ret = 1;
             }
         }
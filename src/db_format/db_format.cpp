@@ -12,7 +12,7 @@ uint64_t PackSequenceAndType(uint64_t seq, ValueType const &t) {
 }
 
 void AppendInternalKey(std::string *result, ParsedInternalKey const &key) {
-    result->append(reinterpret_cast<char const *>(key.user_key.data()));
+    result->append(reinterpret_cast<char const *>(key.user_key.data()), key.user_key.size());
     ns_util::PutFixed64(result, PackSequenceAndType(key.sequence, key.type));
 }
 
@@ -40,7 +40,7 @@ int32_t InternalKeyComparator::Compare(ns_data_structure::Slice const &a_key, ns
         uint64_t const bnum = ns_util::DecodeFixed64(b_key.data() + b_key.size() - 8);
         if (anum > bnum) {
             ret = -1;
-        } else {
+        } else if (anum < bnum) {
             ret = 1;
         }
     }
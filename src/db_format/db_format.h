@@ -12,10 +12,18 @@ using SequenceNumber = uint64_t;
 
 enum ValueType {
     kTypeDeletion = 0x0,
-    kTypeValue = 0x1
+    kTypeValue = 0x1,
+    // Deletes the user keys in [key, value) written before it.  Kept apart
+    // from point entries, see MemTable::Add().
+    kTypeRangeDeletion = 0x2,
+    // An operand for the merge operator, applied to the older value of the
+    // key at read time.
+    kTypeMerge = 0x3
 };
 static constexpr SequenceNumber kMaxSequenceNumber{(0x1ULL << 56) - 1};
-static constexpr ValueType kValueTypeForSeek{kTypeValue};
+// Sequence numbers sort in decreasing order and the type is the low 8 bits
+// of the tag, so seeking to a sequence number takes the highest type.
+static constexpr ValueType kValueTypeForSeek{kTypeMerge};
 
 struct ParsedInternalKey {
     ns_data_structure::Slice user_key;
@@ -46,7 +54,7 @@ inline bool ParseInternalKey(ns_data_structure::Slice const &internal_key, Parse
     result->sequence = num >> 8;
     result->type = static_cast<ValueType>(c);
     result->user_key = ns_data_structure::Slice(internal_key.data(), n - 8);
-    return c <= static_cast<uint8_t>(kTypeValue);
+    return c <= static_cast<uint8_t>(kTypeMerge);
 }
 
 class InternalKey {
@@ -127,6 +135,9 @@ public:
     ns_data_structure::Slice user_key() const {
         return ns_data_structure::Slice(kstart_, end_ - kstart_ - 8);
     }
+    SequenceNumber sequence() const {
+        return ns_util::DecodeFixed64(end_ - 8) >> 8;
+    }
 
 private:
     // We construct a char array of the form:
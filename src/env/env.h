@@ -219,6 +219,17 @@ private:
     Env *target_;
 };
 
+// A utility routine: write "data" to the named file.
+ns_util::Status WriteStringToFile(Env *env, ns_data_structure::Slice const &data,
+                                  std::string const &fname, bool should_sync);
+
+// A utility routine: write "data" to the named file and Sync() it.
+ns_util::Status WriteStringToFileSync(Env *env, ns_data_structure::Slice const &data,
+                                      std::string const &fname, bool should_sync);
+
+// A utility routine: read contents of named file into *data
+ns_util::Status ReadFileToString(Env *env, std::string const &fname, std::string *data);
+
 void Log(Logger *info_log, char const *format, ...)
 #if defined(__GNUC__) || defined(__clang__)
     __attribute__((__format__(__printf__, 2, 3)))
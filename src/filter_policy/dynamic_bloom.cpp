@@ -0,0 +1,75 @@
+#include "dynamic_bloom.h"
+#include "hash.h"
+
+#include <cassert>
+#include <new>
+
+namespace ns_filter_policy {
+
+namespace {
+
+uint32_t BloomHash(ns_data_structure::Slice const &key) {
+    return ns_util::Hash(key.data(), key.size(), 0x6f9b3c1d);
+}
+
+constexpr uint64_t kCacheLineSize = 64;
+
+} // anonymous namespace
+
+DynamicBloom::DynamicBloom(ns_memory::Allocator *allocator, uint64_t total_bits, uint32_t num_probes) :
+    num_blocks_(static_cast<uint32_t>((total_bits + kWordsPerBlock * 64 - 1) / (kWordsPerBlock * 64))),
+    num_probes_(num_probes),
+    data_(nullptr) {
+    assert(num_blocks_ > 0);
+    // Align blocks to cache lines.
+    uint64_t const bytes = static_cast<uint64_t>(num_blocks_) * kWordsPerBlock * sizeof(uint64_t);
+    uint8_t *raw = allocator->AllocateAligned(bytes + kCacheLineSize);
+    uintptr_t const offset = reinterpret_cast<uintptr_t>(raw) % kCacheLineSize;
+    raw += offset == 0 ? 0 : kCacheLineSize - offset;
+    data_ = reinterpret_cast<std::atomic<uint64_t> *>(raw);
+    for (uint64_t i = 0; i < static_cast<uint64_t>(num_blocks_) * kWordsPerBlock; i++) {
+        new (&data_[i]) std::atomic<uint64_t>(0);
+    }
+}
+
+std::atomic<uint64_t> *DynamicBloom::Block(uint32_t h) const {
+    // Multiply-shift maps h onto [0, num_blocks_) without a division.
+    return &data_[((static_cast<uint64_t>(h) * num_blocks_) >> 32) * kWordsPerBlock];
+}
+
+uint32_t DynamicBloom::NextProbe(uint32_t *h, uint32_t delta) {
+    *h += delta;
+    // The top 9 bits pick one of the 512 bits of the block.
+    return *h >> 23;
+}
+
+void DynamicBloom::Add(ns_data_structure::Slice const &key) {
+    uint32_t h = BloomHash(key);
+    std::atomic<uint64_t> *block = Block(h);
+    // The high bits of h picked the block; remix them with the low bits
+    // so that the bits picked in the block are independent of it.
+    h *= 0x9e3779b9U;
+    uint32_t const delta = (h >> 17) | (h << 15); // Rotate right 17 bits
+    for (uint32_t i = 0; i < num_probes_; i++) {
+        uint32_t const bit = NextProbe(&h, delta);
+        // Only the writer stores, so no read-modify-write is needed.
+        std::atomic<uint64_t> &word = block[bit / 64];
+        word.store(word.load(std::memory_order_relaxed) | (uint64_t{1} << (bit % 64)), std::memory_order_relaxed);
+    }
+}
+
+bool DynamicBloom::MayContain(ns_data_structure::Slice const &key) const {
+    uint32_t h = BloomHash(key);
+    std::atomic<uint64_t> const *block = Block(h);
+    h *= 0x9e3779b9U;
+    uint32_t const delta = (h >> 17) | (h << 15);
+    for (uint32_t i = 0; i < num_probes_; i++) {
+        uint32_t const bit = NextProbe(&h, delta);
+        if ((block[bit / 64].load(std::memory_order_relaxed) & (uint64_t{1} << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // ns_filter_policy
@@ -0,0 +1,47 @@
+#ifndef _LEVEL_DB_XY_DYNAMIC_BLOOM_H_
+#define _LEVEL_DB_XY_DYNAMIC_BLOOM_H_
+
+#include "allocator.h"
+#include "slice.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace ns_filter_policy {
+
+// A bloom filter that keys are added to one at a time, for memtables,
+// unlike the filters FilterPolicy builds over a finished set of keys.  All
+// probes of a key fall into one 64-byte block, so a lookup costs at most one
+// cache miss.
+//
+// Add() requires external synchronization; MayContain() may run
+// concurrently with one Add().
+class DynamicBloom {
+public:
+    // A filter of at least total_bits bits (rounded up to whole blocks),
+    // allocated from allocator, setting num_probes bits per key.
+    // REQUIRES: allocator outlives the filter, total_bits > 0.
+    DynamicBloom(ns_memory::Allocator *allocator, uint64_t total_bits, uint32_t num_probes);
+
+    DynamicBloom(DynamicBloom const &) = delete;
+    DynamicBloom &operator=(DynamicBloom const &) = delete;
+
+    void Add(ns_data_structure::Slice const &key);
+    // False if key was certainly never added.
+    bool MayContain(ns_data_structure::Slice const &key) const;
+
+private:
+    static constexpr uint32_t kWordsPerBlock = 8;
+
+    // The block of h, and the bit in it of each probe of h, in turn.
+    std::atomic<uint64_t> *Block(uint32_t h) const;
+    static uint32_t NextProbe(uint32_t *h, uint32_t delta);
+
+    uint32_t const num_blocks_;
+    uint32_t const num_probes_;
+    std::atomic<uint64_t> *data_;
+};
+
+} // ns_filter_policy
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _LEVEL_DB_XY_ALLOCATOR_H_
+#define _LEVEL_DB_XY_ALLOCATOR_H_
+
+#include <cstdint>
+
+namespace ns_memory {
+
+// Interface of the arenas that memtable structures carve their nodes from.
+// Memory is only released when the allocator is destroyed.
+class Allocator {
+public:
+    Allocator() = default;
+    Allocator(Allocator const &) = delete;
+    Allocator &operator=(Allocator const &) = delete;
+    virtual ~Allocator() = default;
+
+    // Return a pointer to a newly allocated memory block of "bytes" bytes.
+    virtual uint8_t *Allocate(uint64_t bytes) = 0;
+    // Allocate memory with the normal alignment guarantees provided by malloc.
+    virtual uint8_t *AllocateAligned(uint64_t bytes) = 0;
+    // Returns an estimate of the total memory usage of data allocated
+    // by the allocator.
+    virtual uint64_t MemoryUsage() const = 0;
+};
+
+} // ns_memory
+
+#endif
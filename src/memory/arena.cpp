@@ -1,19 +1,41 @@
 #include "arena.h"
+#include "arena_block_pool.h"
 #include "log.h"
 #include <cassert>
+#include <sys/mman.h>
 
 namespace ns_memory {
 
 static constexpr int32_t kBlockSize{4096};
 
-Arena::Arena() {
+Arena::Arena() :
+    Arena(kBlockSize, false) {
+}
+Arena::Arena(uint64_t block_size, bool huge_pages) :
+    Arena(block_size, huge_pages, nullptr) {
+}
+Arena::Arena(uint64_t block_size, bool huge_pages, ArenaBlockPool *block_pool) :
+    block_size_(huge_pages ? (block_size + kHugePageSize - 1) / kHugePageSize * kHugePageSize : block_size),
+    huge_pages_(huge_pages),
+    block_pool_(block_pool) {
+    assert(block_size > 0);
     alloc_ptr_ = nullptr;
     alloc_bytes_remaining_ = 0UL;
     memory_usage_ = 0UL;
 }
 Arena::~Arena() {
     for (uint64_t i = 0UL; i < blocks_.size(); i++) {
-        delete[] blocks_[i];
+        switch (blocks_[i].source) {
+        case BlockSource::kHeap:
+            delete[] blocks_[i].data;
+            break;
+        case BlockSource::kMapped:
+            munmap(blocks_[i].data, blocks_[i].size);
+            break;
+        case BlockSource::kPool:
+            block_pool_->Return(blocks_[i].data, blocks_[i].size);
+            break;
+        }
     }
 }
 uint8_t *Arena::Allocate(uint64_t bytes) {
@@ -48,12 +70,20 @@ uint64_t Arena::MemoryUsage() const {
     return memory_usage_.load(std::memory_order_relaxed);
 }
 uint8_t *Arena::AllocateFallback(uint64_t bytes) {
-    if (bytes > (kBlockSize >> 2)) {
+    if (bytes > (block_size_ >> 2)) {
+        // Object is more than a quarter of our block size.  Allocate it
+        // separately to avoid wasting too much space in leftover bytes.
         uint8_t *result = AllocateNewBlock(bytes);
         return result;
     }
-    alloc_ptr_ = AllocateNewBlock(kBlockSize);
-    alloc_bytes_remaining_ = kBlockSize;
+    uint8_t *block = huge_pages_ ? MapHugePageBlock() : nullptr;
+    if (block == nullptr && block_pool_ != nullptr) {
+        block = block_pool_->Take(block_size_);
+        blocks_.push_back(Block{block, block_size_, BlockSource::kPool});
+        memory_usage_.fetch_add(block_size_ + sizeof(Block), std::memory_order_relaxed);
+    }
+    alloc_ptr_ = (block != nullptr) ? block : AllocateNewBlock(block_size_);
+    alloc_bytes_remaining_ = block_size_;
     uint8_t *result = alloc_ptr_;
     alloc_ptr_ += bytes;
     alloc_bytes_remaining_ -= bytes;
@@ -61,9 +91,37 @@ uint8_t *Arena::AllocateFallback(uint64_t bytes) {
 }
 uint8_t *Arena::AllocateNewBlock(uint64_t block_bytes) {
     uint8_t *result = new uint8_t[block_bytes];
-    blocks_.emplace_back(result);
-    memory_usage_.fetch_add(block_bytes + sizeof(uint8_t*), std::memory_order_relaxed);
+    blocks_.push_back(Block{result, block_bytes, BlockSource::kHeap});
+    memory_usage_.fetch_add(block_bytes + sizeof(Block), std::memory_order_relaxed);
+    return result;
+}
+uint8_t *Arena::MapHugePageBlock() {
+    void *mem = mmap(nullptr, block_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem == MAP_FAILED) {
+        // No reserved huge pages.  Map twice the alignment so that a
+        // kHugePageSize-aligned range can be cut out of it, since the kernel
+        // only uses transparent huge pages for aligned 2 MB ranges.
+        uint64_t const map_size = block_size_ + kHugePageSize;
+        void *raw = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            return nullptr;
+        }
+        uintptr_t const start = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t const aligned = (start + kHugePageSize - 1) & ~(kHugePageSize - 1);
+        if (aligned > start) {
+            munmap(raw, aligned - start);
+        }
+        uint64_t const tail = start + map_size - (aligned + block_size_);
+        if (tail > 0) {
+            munmap(reinterpret_cast<void *>(aligned + block_size_), tail);
+        }
+        mem = reinterpret_cast<void *>(aligned);
+        madvise(mem, block_size_, MADV_HUGEPAGE);
+    }
+    uint8_t *result = reinterpret_cast<uint8_t *>(mem);
+    blocks_.push_back(Block{result, block_size_, BlockSource::kMapped});
+    memory_usage_.fetch_add(block_size_ + sizeof(Block), std::memory_order_relaxed);
     return result;
 }
 
-} // ns_memory
\ No newline at end of file
+} // ns_memory
@@ -1,31 +1,74 @@
 #ifndef _LEVEL_DB_XY_ARENA_H_
 #define _LEVEL_DB_XY_ARENA_H_
 
+#include "allocator.h"
 #include <cstdint>
 #include <vector>
 #include <atomic>
 
 namespace ns_memory {
 
-class Arena {
+class ArenaBlockPool;
+
+// Bump allocator over a list of blocks.  Not thread-safe; see
+// ConcurrentArena for one that is.
+class Arena : public Allocator {
 public:
+    // Size of the huge pages that back blocks in huge-page mode.
+    static constexpr uint64_t kHugePageSize = 2 * 1024 * 1024;
+
     Arena();
-    ~Arena();
+    // Carve allocations out of blocks of block_size bytes.  If huge_pages is
+    // true, block_size is rounded up to a multiple of kHugePageSize and each
+    // block is mapped with MAP_HUGETLB, or, when no huge pages are reserved,
+    // mapped normally and marked with madvise(MADV_HUGEPAGE) so that
+    // transparent huge pages can back it.  Fewer, larger blocks mean fewer
+    // TLB misses when walking structures spread over the arena.
+    Arena(uint64_t block_size, bool huge_pages);
+    // Same as above, but regular blocks are taken from block_pool and given
+    // back to it when the arena is destroyed, instead of new[]/delete[].
+    // Huge-page blocks and oversized allocations bypass the pool.
+    // REQUIRES: block_pool outlives the arena.
+    Arena(uint64_t block_size, bool huge_pages, ArenaBlockPool *block_pool);
+    ~Arena() override;
 
-    uint8_t *Allocate(uint64_t bytes);
-    uint8_t *AllocateAligned(uint64_t bytes);
-    uint64_t MemoryUsage() const;
+    uint8_t *Allocate(uint64_t bytes) override;
+    uint8_t *AllocateAligned(uint64_t bytes) override;
+    // Bytes of memory held by the arena, counting whole blocks (mapped
+    // blocks included) whether or not they have been handed out yet.
+    uint64_t MemoryUsage() const override;
+    uint64_t BlockSize() const {
+        return block_size_;
+    }
 
 private:
+    // Where a block came from, and so how to release it.
+    enum class BlockSource {
+        kHeap,   // delete[]
+        kMapped, // munmap()
+        kPool,   // ArenaBlockPool::Return()
+    };
+
+    struct Block {
+        uint8_t *data;
+        uint64_t size;
+        BlockSource source;
+    };
+
     uint8_t *AllocateFallback(uint64_t bytes);
     uint8_t *AllocateNewBlock(uint64_t block_bytes);
+    // Map a huge-page block of block_size_ bytes, nullptr on failure.
+    uint8_t *MapHugePageBlock();
 
+    uint64_t const block_size_;
+    bool const huge_pages_;
+    ArenaBlockPool *const block_pool_;
     uint8_t *alloc_ptr_{nullptr};
     uint64_t alloc_bytes_remaining_{0UL};
-    std::vector<uint8_t *> blocks_;
+    std::vector<Block> blocks_;
     std::atomic<uint64_t> memory_usage_;
 };
 
 } // ns_memory
 
-#endif
\ No newline at end of file
+#endif
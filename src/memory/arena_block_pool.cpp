@@ -0,0 +1,83 @@
+#include "arena_block_pool.h"
+#include <algorithm>
+#include <unistd.h>
+
+namespace ns_memory {
+
+ArenaBlockPool::ArenaBlockPool(uint64_t max_retained_bytes) :
+    max_retained_bytes_(max_retained_bytes), retained_bytes_(0) {
+}
+
+ArenaBlockPool::~ArenaBlockPool() {
+    for (auto &blocks : free_blocks_) {
+        for (uint8_t *block : blocks.second) {
+            delete[] block;
+        }
+    }
+}
+
+uint8_t *ArenaBlockPool::Take(uint64_t block_size) {
+    {
+        std::unique_lock<std::mutex> lck(mutex_);
+        auto iter = free_blocks_.find(block_size);
+        if (iter != free_blocks_.end() && !iter->second.empty()) {
+            uint8_t *block = iter->second.back();
+            iter->second.pop_back();
+            retained_bytes_ -= block_size;
+            return block;
+        }
+    }
+    return new uint8_t[block_size];
+}
+
+void ArenaBlockPool::Return(uint8_t *block, uint64_t block_size) {
+    {
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (retained_bytes_ + block_size <= max_retained_bytes_) {
+            free_blocks_[block_size].push_back(block);
+            retained_bytes_ += block_size;
+            return;
+        }
+    }
+    delete[] block;
+}
+
+void ArenaBlockPool::Prefill(uint64_t block_size, uint64_t bytes) {
+    uint64_t const page_size = sysconf(_SC_PAGESIZE);
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (retained_bytes_ + block_size > std::min(bytes, max_retained_bytes_)) {
+                return;
+            }
+        }
+        uint8_t *block = new uint8_t[block_size];
+        for (uint64_t offset = 0; offset < block_size; offset += page_size) {
+            block[offset] = 0;
+        }
+        Return(block, block_size);
+    }
+}
+
+void ArenaBlockPool::SetMaxRetainedBytes(uint64_t max_retained_bytes) {
+    std::unique_lock<std::mutex> lck(mutex_);
+    max_retained_bytes_ = max_retained_bytes;
+    TrimLocked();
+}
+
+uint64_t ArenaBlockPool::RetainedBytes() const {
+    std::unique_lock<std::mutex> lck(mutex_);
+    return retained_bytes_;
+}
+
+void ArenaBlockPool::TrimLocked() {
+    for (auto iter = free_blocks_.begin(); iter != free_blocks_.end() && retained_bytes_ > max_retained_bytes_; ++iter) {
+        while (!iter->second.empty() && retained_bytes_ > max_retained_bytes_) {
+            delete[] iter->second.back();
+            iter->second.pop_back();
+            retained_bytes_ -= iter->first;
+        }
+    }
+}
+
+} // ns_memory
@@ -0,0 +1,49 @@
+#ifndef _LEVEL_DB_XY_ARENA_BLOCK_POOL_H_
+#define _LEVEL_DB_XY_ARENA_BLOCK_POOL_H_
+
+#include "thread_annotation.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace ns_memory {
+
+// Keeps the blocks of destroyed arenas for the next arena, so that a DB
+// that keeps replacing its memtable does not free and re-fault the same
+// memory over and over.  Shared by any number of arenas, typically one
+// pool per DB or per process.  Thread-safe.
+class ArenaBlockPool {
+public:
+    // Retain at most max_retained_bytes of returned blocks; blocks returned
+    // beyond that are freed.
+    explicit ArenaBlockPool(uint64_t max_retained_bytes);
+    ArenaBlockPool(ArenaBlockPool const &) = delete;
+    ArenaBlockPool &operator=(ArenaBlockPool const &) = delete;
+    ~ArenaBlockPool();
+
+    // Return a block of block_size bytes, a retained one if there is any.
+    uint8_t *Take(uint64_t block_size);
+    // Hand a block obtained from Take() back to the pool.
+    void Return(uint8_t *block, uint64_t block_size);
+    // Allocate blocks of block_size bytes until the pool retains bytes
+    // bytes (capped by the retention limit), writing to every page so that
+    // the first memtable does not pay the page faults.
+    void Prefill(uint64_t block_size, uint64_t bytes);
+    // Change the retention limit; frees retained blocks beyond the new one.
+    void SetMaxRetainedBytes(uint64_t max_retained_bytes);
+    uint64_t RetainedBytes() const;
+
+private:
+    void TrimLocked() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+    mutable std::mutex mutex_;
+    uint64_t max_retained_bytes_ GUARDED_BY(mutex_);
+    uint64_t retained_bytes_ GUARDED_BY(mutex_);
+    // Retained blocks by size.
+    std::map<uint64_t, std::vector<uint8_t *>> free_blocks_ GUARDED_BY(mutex_);
+};
+
+} // ns_memory
+
+#endif
@@ -0,0 +1,103 @@
+#include "concurrent_arena.h"
+#include <cassert>
+#include <functional>
+#include <sched.h>
+#include <thread>
+
+namespace ns_memory {
+
+namespace {
+
+// Memtables written by many threads are large; use bigger blocks than Arena.
+static constexpr uint64_t kDefaultBlockSize = 64 * 1024;
+
+// Upper bound of a shard chunk, so that many cores do not hold on to much
+// unused memory in a small memtable.
+static constexpr uint64_t kMaxShardChunkSize = 128 * 1024;
+
+static constexpr uint64_t kAlign = (sizeof(void *) > 8) ? sizeof(void *) : 8;
+
+uint32_t ShardCount() {
+    uint32_t const cores = std::max(1U, std::thread::hardware_concurrency());
+    uint32_t count = 1;
+    while (count < cores) {
+        count *= 2;
+    }
+    return count;
+}
+
+} // anonymous namespace
+
+ConcurrentArena::ConcurrentArena() :
+    ConcurrentArena(kDefaultBlockSize, false) {
+}
+
+ConcurrentArena::ConcurrentArena(uint64_t block_size, bool huge_pages) :
+    arena_(block_size, huge_pages),
+    // A chunk must stay below a quarter block, or Arena would give every
+    // refill a block of its own.
+    shard_chunk_size_(std::min(kMaxShardChunkSize, arena_.BlockSize() / 8)),
+    shard_mask_(ShardCount() - 1),
+    shards_(new Shard[shard_mask_ + 1]) {
+}
+
+uint8_t *ConcurrentArena::Allocate(uint64_t bytes) {
+    return AllocateImpl(bytes, false);
+}
+
+uint8_t *ConcurrentArena::AllocateAligned(uint64_t bytes) {
+    return AllocateImpl(bytes, true);
+}
+
+uint64_t ConcurrentArena::MemoryUsage() const {
+    // Arena keeps its usage in an atomic, so this needs no lock.
+    return arena_.MemoryUsage();
+}
+
+uint8_t *ConcurrentArena::AllocateImpl(uint64_t bytes, bool aligned) {
+    assert(bytes > 0);
+    if (bytes > shard_chunk_size_ / 4) {
+        std::unique_lock<std::mutex> lck(arena_mutex_);
+        return aligned ? arena_.AllocateAligned(bytes) : arena_.Allocate(bytes);
+    }
+    Shard *shard = CurrentShard();
+    std::unique_lock<std::mutex> lck(shard->mutex);
+    uint64_t slop = 0;
+    if (aligned) {
+        uint64_t const current_mod = reinterpret_cast<uintptr_t>(shard->free_begin) & (kAlign - 1);
+        slop = (current_mod == 0 ? 0 : kAlign - current_mod);
+    }
+    if (shard->free_begin == nullptr || static_cast<uint64_t>(shard->free_end - shard->free_begin) < bytes + slop) {
+        // Refill.  The rest of the old chunk is given up; it is at most a
+        // quarter chunk since larger requests never get here.
+        uint8_t *chunk;
+        {
+            std::unique_lock<std::mutex> arena_lck(arena_mutex_);
+            chunk = arena_.AllocateAligned(shard_chunk_size_);
+        }
+        shard->free_begin = chunk;
+        shard->free_end = chunk + shard_chunk_size_;
+        slop = 0;
+    }
+    uint8_t *result;
+    if (aligned) {
+        result = shard->free_begin + slop;
+        shard->free_begin = result + bytes;
+    } else {
+        shard->free_end -= bytes;
+        result = shard->free_end;
+    }
+    assert(!aligned || (reinterpret_cast<uintptr_t>(result) & (kAlign - 1)) == 0);
+    return result;
+}
+
+ConcurrentArena::Shard *ConcurrentArena::CurrentShard() {
+    int32_t const cpu = sched_getcpu();
+    if (cpu >= 0) {
+        return &shards_[cpu & shard_mask_];
+    }
+    static thread_local uint32_t const thread_hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return &shards_[thread_hash & shard_mask_];
+}
+
+} // ns_memory
@@ -0,0 +1,54 @@
+#ifndef _LEVEL_DB_XY_CONCURRENT_ARENA_H_
+#define _LEVEL_DB_XY_CONCURRENT_ARENA_H_
+
+#include "arena.h"
+#include "thread_annotation.h"
+#include <memory>
+#include <mutex>
+
+namespace ns_memory {
+
+// A thread-safe arena for memtables that several writers insert into at
+// once.  Every CPU core gets a shard holding a small reserved chunk; an
+// allocation is carved from the chunk of the core the caller runs on, under
+// that shard's own (almost always uncontended) lock.  Only refilling a chunk,
+// or an allocation too large for one, takes the lock of the shared Arena
+// behind the shards.
+class ConcurrentArena : public Allocator {
+public:
+    ConcurrentArena();
+    // block_size and huge_pages configure the shared Arena, see Arena.
+    ConcurrentArena(uint64_t block_size, bool huge_pages);
+    ~ConcurrentArena() override = default;
+
+    uint8_t *Allocate(uint64_t bytes) override;
+    uint8_t *AllocateAligned(uint64_t bytes) override;
+    // Memory held by the shared Arena, which includes the unused tails of
+    // the shard chunks.  Safe to call concurrently with allocations.
+    uint64_t MemoryUsage() const override;
+
+private:
+    // Padded to a cache line so that cores do not share shard state.
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        // Free range of the current chunk.  Aligned allocations are taken
+        // from the front, unaligned ones from the back, so neither wastes
+        // bytes on the other's padding.
+        uint8_t *free_begin GUARDED_BY(mutex){nullptr};
+        uint8_t *free_end GUARDED_BY(mutex){nullptr};
+    };
+
+    uint8_t *AllocateImpl(uint64_t bytes, bool aligned);
+    Shard *CurrentShard();
+
+    std::mutex arena_mutex_;
+    Arena arena_ GUARDED_BY(arena_mutex_);
+    // Size of the chunk a shard reserves from arena_ at a time.
+    uint64_t const shard_chunk_size_;
+    uint32_t const shard_mask_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
+} // ns_memory
+
+#endif
@@ -0,0 +1,64 @@
+#include "slab_allocator.h"
+
+#include <cassert>
+
+namespace ns_memory {
+
+SlabAllocator::SlabAllocator() :
+    memory_usage_(0) {
+    for (uint64_t i = 0; i < kNumClasses; i++) {
+        free_lists_[i] = nullptr;
+    }
+}
+
+SlabAllocator::~SlabAllocator() {
+    for (uint64_t i = 0; i < slabs_.size(); i++) {
+        delete[] slabs_[i];
+    }
+}
+
+uint8_t *SlabAllocator::Allocate(uint64_t bytes) {
+    assert(bytes > 0);
+    if (bytes > kMaxClassSize) {
+        memory_usage_ += bytes;
+        return new uint8_t[bytes];
+    }
+    uint64_t const size_class = SizeClass(bytes);
+    if (free_lists_[size_class] == nullptr) {
+        Refill(size_class);
+    }
+    FreeObject *result = free_lists_[size_class];
+    free_lists_[size_class] = result->next;
+    return reinterpret_cast<uint8_t *>(result);
+}
+
+void SlabAllocator::Free(uint8_t *p, uint64_t bytes) {
+    assert(bytes > 0);
+    if (bytes > kMaxClassSize) {
+        memory_usage_ -= bytes;
+        delete[] p;
+        return;
+    }
+    uint64_t const size_class = SizeClass(bytes);
+    FreeObject *object = reinterpret_cast<FreeObject *>(p);
+    object->next = free_lists_[size_class];
+    free_lists_[size_class] = object;
+}
+
+void SlabAllocator::Refill(uint64_t size_class) {
+    uint64_t const object_size = (size_class + 1) * kClassGranularity;
+    uint8_t *slab = new uint8_t[kSlabSize];
+    slabs_.emplace_back(slab);
+    memory_usage_ += kSlabSize;
+    // Thread the new objects onto the free list in address order.
+    FreeObject *head = free_lists_[size_class];
+    for (uint64_t offset = (kSlabSize / object_size) * object_size; offset > 0;) {
+        offset -= object_size;
+        FreeObject *object = reinterpret_cast<FreeObject *>(slab + offset);
+        object->next = head;
+        head = object;
+    }
+    free_lists_[size_class] = head;
+}
+
+} // ns_memory
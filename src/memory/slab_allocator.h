@@ -0,0 +1,56 @@
+#ifndef _LEVEL_DB_XY_SLAB_ALLOCATOR_H_
+#define _LEVEL_DB_XY_SLAB_ALLOCATOR_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace ns_memory {
+
+// Hands out small objects from per-size-class slabs so that a steady stream
+// of allocate/free pairs never reaches the global heap.
+//
+// Requests are rounded up to a multiple of kClassGranularity.  Freed objects
+// go to the free list of their class and are reused by the next request of
+// that class; slabs are only returned when the allocator is destroyed.
+// Requests larger than kMaxClassSize fall through to new[].
+//
+// Not thread-safe; callers provide their own synchronization.
+class SlabAllocator {
+public:
+    SlabAllocator();
+    ~SlabAllocator();
+
+    SlabAllocator(SlabAllocator const &) = delete;
+    SlabAllocator &operator=(SlabAllocator const &) = delete;
+
+    uint8_t *Allocate(uint64_t bytes);
+    // REQUIRES: p was returned by Allocate(bytes) with the same bytes.
+    void Free(uint8_t *p, uint64_t bytes);
+    // Bytes currently reserved from the heap, including unused slab space.
+    uint64_t MemoryUsage() const {
+        return memory_usage_;
+    }
+
+private:
+    static constexpr uint64_t kClassGranularity = 16;
+    static constexpr uint64_t kMaxClassSize = 512;
+    static constexpr uint64_t kNumClasses = kMaxClassSize / kClassGranularity;
+    static constexpr uint64_t kSlabSize = 16 * 1024;
+
+    struct FreeObject {
+        FreeObject *next;
+    };
+
+    static uint64_t SizeClass(uint64_t bytes) {
+        return (bytes + kClassGranularity - 1) / kClassGranularity - 1;
+    }
+    void Refill(uint64_t size_class);
+
+    FreeObject *free_lists_[kNumClasses];
+    std::vector<uint8_t *> slabs_;
+    uint64_t memory_usage_;
+};
+
+} // ns_memory
+
+#endif
@@ -0,0 +1,102 @@
+#include "write_buffer_manager.h"
+#include "coding.h"
+#include <cassert>
+
+namespace ns_memory {
+
+namespace {
+
+void NoopDeleter(ns_data_structure::Slice const &key, void *value, void *arg) {
+}
+
+} // anonymous namespace
+
+WriteBufferManager::WriteBufferManager(uint64_t buffer_size) :
+    WriteBufferManager(buffer_size, nullptr) {
+}
+
+WriteBufferManager::WriteBufferManager(uint64_t buffer_size, ns_cache::Cache *cache) :
+    buffer_size_(buffer_size),
+    mutable_limit_(buffer_size * 7 / 8),
+    memory_used_(0),
+    memory_active_(0),
+    cache_(cache),
+    cache_id_(cache != nullptr ? cache->NewId() : 0),
+    next_dummy_(0) {
+}
+
+WriteBufferManager::~WriteBufferManager() {
+    std::unique_lock<std::mutex> lck(cache_mutex_);
+    for (DummyEntry const &entry : dummies_) {
+        EraseDummy(entry);
+    }
+}
+
+uint64_t WriteBufferManager::dummy_entries_in_cache_usage() const {
+    std::unique_lock<std::mutex> lck(cache_mutex_);
+    return dummies_.size() * kDummyEntrySize;
+}
+
+bool WriteBufferManager::ShouldFlush() const {
+    if (!enabled()) {
+        return false;
+    }
+    uint64_t const active = mutable_memtable_memory_usage();
+    if (active > mutable_limit_) {
+        return true;
+    }
+    return memory_usage() >= buffer_size_ && active >= buffer_size_ / 2;
+}
+
+void WriteBufferManager::ReserveMem(uint64_t mem) {
+    memory_used_.fetch_add(mem, std::memory_order_relaxed);
+    memory_active_.fetch_add(mem, std::memory_order_relaxed);
+    if (cache_ != nullptr) {
+        std::unique_lock<std::mutex> lck(cache_mutex_);
+        UpdateCacheCharge();
+    }
+}
+
+void WriteBufferManager::ScheduleFreeMem(uint64_t mem) {
+    assert(memory_active_.load(std::memory_order_relaxed) >= mem);
+    memory_active_.fetch_sub(mem, std::memory_order_relaxed);
+}
+
+void WriteBufferManager::FreeMem(uint64_t mem) {
+    assert(memory_used_.load(std::memory_order_relaxed) >= mem);
+    memory_used_.fetch_sub(mem, std::memory_order_relaxed);
+    if (cache_ != nullptr) {
+        std::unique_lock<std::mutex> lck(cache_mutex_);
+        UpdateCacheCharge();
+    }
+}
+
+std::string WriteBufferManager::DummyKey(uint64_t number) const {
+    std::string key;
+    ns_util::PutFixed64(&key, cache_id_);
+    ns_util::PutFixed64(&key, number);
+    return key;
+}
+
+void WriteBufferManager::UpdateCacheCharge() {
+    uint64_t const used = memory_used_.load(std::memory_order_relaxed);
+    while (dummies_.size() * kDummyEntrySize < used) {
+        uint64_t const number = next_dummy_++;
+        dummies_.push_back({number, cache_->Insert(DummyKey(number), nullptr, kDummyEntrySize, NoopDeleter, nullptr)});
+    }
+    // Give memory back only once usage dropped well below the charge, so
+    // that usage hovering around a boundary does not churn dummy entries.
+    while (!dummies_.empty() && used < (dummies_.size() - 1) * kDummyEntrySize * 3 / 4) {
+        EraseDummy(dummies_.back());
+        dummies_.pop_back();
+    }
+}
+
+void WriteBufferManager::EraseDummy(DummyEntry const &entry) {
+    // Released alone, the entry would keep its charge until evicted, after
+    // the blocks used more recently.
+    cache_->Release(entry.handle);
+    cache_->Erase(DummyKey(entry.number));
+}
+
+} // ns_memory
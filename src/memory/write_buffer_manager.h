@@ -0,0 +1,98 @@
+#ifndef _LEVEL_DB_XY_WRITE_BUFFER_MANAGER_H_
+#define _LEVEL_DB_XY_WRITE_BUFFER_MANAGER_H_
+
+#include "cache.h"
+#include "thread_annotation.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ns_memory {
+
+// Tracks the memory of all live memtables of any number of DBs that share
+// it, so that their combined size can be capped: once ShouldFlush() returns
+// true the owner should switch to a new memtable and flush the old one.
+//
+// Memtables report their arena usage through ReserveMem(), announce with
+// ScheduleFreeMem() that they became immutable (a flush will free them),
+// and hand their memory back with FreeMem() when they are destroyed.
+//
+// Optionally the same memory is charged against a Cache, as pinned dummy
+// entries, so that the block cache shrinks while memtables are large and
+// both stay within one memory budget.
+//
+// Thread-safe.
+class WriteBufferManager {
+public:
+    // Charge granularity of the dummy cache entries.
+    static constexpr uint64_t kDummyEntrySize = 256 * 1024;
+
+    // buffer_size is the combined memtable limit; 0 disables the limit but
+    // still counts usage.
+    explicit WriteBufferManager(uint64_t buffer_size);
+    // Same as above, and charge memtable memory against cache.
+    // REQUIRES: cache outlives the manager.
+    WriteBufferManager(uint64_t buffer_size, ns_cache::Cache *cache);
+    WriteBufferManager(WriteBufferManager const &) = delete;
+    WriteBufferManager &operator=(WriteBufferManager const &) = delete;
+    ~WriteBufferManager();
+
+    bool enabled() const {
+        return buffer_size_ > 0;
+    }
+    uint64_t buffer_size() const {
+        return buffer_size_;
+    }
+    // Memory of all tracked memtables.
+    uint64_t memory_usage() const {
+        return memory_used_.load(std::memory_order_relaxed);
+    }
+    // Memory of the memtables that are still written to.
+    uint64_t mutable_memtable_memory_usage() const {
+        return memory_active_.load(std::memory_order_relaxed);
+    }
+    // Charge currently held in the cache by dummy entries.
+    uint64_t dummy_entries_in_cache_usage() const;
+
+    // Whether the owner of the largest mutable memtable should flush it:
+    // either mutable memtables use most of the budget, or the budget is
+    // used up and flushing the mutable ones would free a good part of it.
+    bool ShouldFlush() const;
+
+    void ReserveMem(uint64_t mem);
+    void ScheduleFreeMem(uint64_t mem);
+    void FreeMem(uint64_t mem);
+
+private:
+    // A dummy entry, pinned in cache_ under the key DummyKey(number).
+    struct DummyEntry {
+        uint64_t number;
+        ns_cache::Cache::Handle *handle;
+    };
+
+    std::string DummyKey(uint64_t number) const;
+    // Insert or erase dummy entries to match memory_used_.
+    void UpdateCacheCharge() EXCLUSIVE_LOCKS_REQUIRED(cache_mutex_);
+    // Unpin entry and drop it from cache_.
+    void EraseDummy(DummyEntry const &entry) EXCLUSIVE_LOCKS_REQUIRED(cache_mutex_);
+
+    uint64_t const buffer_size_;
+    // Flush once mutable memtables use this much.
+    uint64_t const mutable_limit_;
+    std::atomic<uint64_t> memory_used_;
+    std::atomic<uint64_t> memory_active_;
+
+    ns_cache::Cache *const cache_;
+    mutable std::mutex cache_mutex_;
+    // Prefix of the dummy entry keys, unique within cache_.
+    uint64_t const cache_id_;
+    uint64_t next_dummy_ GUARDED_BY(cache_mutex_);
+    // Their charges add up to dummies_.size() * kDummyEntrySize.
+    std::vector<DummyEntry> dummies_ GUARDED_BY(cache_mutex_);
+};
+
+} // ns_memory
+
+#endif
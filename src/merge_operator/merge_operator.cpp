@@ -0,0 +1,76 @@
+#include "merge_operator.h"
+#include "coding.h"
+
+namespace ns_merge_operator {
+
+namespace {
+
+class UInt64AddOperator : public MergeOperator {
+public:
+    char const *Name() const override {
+        return "leveldb.UInt64AddOperator";
+    }
+
+    bool FullMerge(ns_data_structure::Slice const &key, ns_data_structure::Slice const *existing_value,
+                   std::vector<ns_data_structure::Slice> const &operands, std::string *new_value) const override {
+        uint64_t sum = 0;
+        if (existing_value != nullptr) {
+            if (existing_value->size() != sizeof(uint64_t)) {
+                return false;
+            }
+            sum = ns_util::DecodeFixed64(existing_value->data());
+        }
+        for (ns_data_structure::Slice const &operand : operands) {
+            if (operand.size() != sizeof(uint64_t)) {
+                return false;
+            }
+            sum += ns_util::DecodeFixed64(operand.data());
+        }
+        new_value->clear();
+        ns_util::PutFixed64(new_value, sum);
+        return true;
+    }
+};
+
+class StringAppendOperator : public MergeOperator {
+public:
+    explicit StringAppendOperator(char delimiter) :
+        delimiter_(delimiter) {
+    }
+
+    char const *Name() const override {
+        return "leveldb.StringAppendOperator";
+    }
+
+    bool FullMerge(ns_data_structure::Slice const &key, ns_data_structure::Slice const *existing_value,
+                   std::vector<ns_data_structure::Slice> const &operands, std::string *new_value) const override {
+        new_value->clear();
+        bool first = existing_value == nullptr || existing_value->empty();
+        if (!first) {
+            new_value->assign(reinterpret_cast<char const *>(existing_value->data()), existing_value->size());
+        }
+        for (ns_data_structure::Slice const &operand : operands) {
+            if (!first) {
+                new_value->push_back(delimiter_);
+            }
+            first = false;
+            new_value->append(reinterpret_cast<char const *>(operand.data()), operand.size());
+        }
+        return true;
+    }
+
+private:
+    char const delimiter_;
+};
+
+} // anonymous namespace
+
+MergeOperator const *NewUInt64AddOperator() {
+    return new UInt64AddOperator();
+}
+
+MergeOperator const *NewStringAppendOperator(char delimiter) {
+    return new StringAppendOperator(delimiter);
+}
+
+} // ns_merge_operator
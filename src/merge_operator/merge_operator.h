@@ -0,0 +1,48 @@
+#ifndef _LEVEL_DB_XY_MERGE_OPERATOR_H_
+#define _LEVEL_DB_XY_MERGE_OPERATOR_H_
+
+#include "slice.h"
+
+#include <string>
+#include <vector>
+
+namespace ns_merge_operator {
+
+// Turns a stack of merge operands (see WriteBatch::Merge()) into a value,
+// so that read-modify-write updates such as counters need no read: writers
+// only record the operand, and reads apply the operands to the value they
+// were written on top of.
+class MergeOperator {
+public:
+    virtual ~MergeOperator() = default;
+    // Return the name of this operator.  Data merged by one operator must
+    // not be read with another, so it must change whenever the meaning of
+    // operands does.
+    virtual char const *Name() const = 0;
+    // Apply operands, oldest first, to the value of key, existing_value
+    // (nullptr if key has none or was deleted), and store the result in
+    // *new_value.  Return false if operands or existing_value are
+    // malformed; the read then fails with Corruption.
+    virtual bool FullMerge(ns_data_structure::Slice const &key, ns_data_structure::Slice const *existing_value,
+                           std::vector<ns_data_structure::Slice> const &operands, std::string *new_value) const = 0;
+};
+
+// Return a merge operator for counters: values and operands are 64-bit
+// unsigned integers encoded with PutFixed64(), and operands add to the
+// value (wrapping on overflow).  A missing value counts as 0.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+MergeOperator const *NewUInt64AddOperator();
+
+// Return a merge operator for append-lists: each operand is appended to the
+// value, separated by delimiter.  A missing or empty value counts as an empty
+// list.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+MergeOperator const *NewStringAppendOperator(char delimiter);
+
+} // ns_merge_operator
+
+#endif
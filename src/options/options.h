@@ -5,6 +5,10 @@
 #include "env.h"
 #include "cache.h"
 #include "filter_policy.h"
+#include "arena_block_pool.h"
+#include "write_buffer_manager.h"
+#include "mem_table_rep.h"
+#include "merge_operator.h"
 
 namespace ns_options {
 
@@ -25,6 +29,52 @@ struct Options {
 
     uint64_t write_buffer_size{4 * 1024 * 1024};
 
+    // Size of the arena blocks memtables allocate their entries from.
+    uint64_t arena_block_size{4 * 1024};
+
+    // If true, memtable arena blocks are backed by 2 MB huge pages and
+    // arena_block_size is rounded up to a multiple of 2 MB.  Cuts TLB misses
+    // on large memtables at the cost of reserving memory 2 MB at a time.
+    bool memtable_use_huge_pages{false};
+
+    // If non-null, memtable arena blocks are recycled through this pool
+    // instead of being freed with the memtable.  Its retention limit caps
+    // the memory kept around between memtables.
+    ns_memory::ArenaBlockPool *arena_block_pool{nullptr};
+
+    // If non-null, memtables report their memory to this manager, which may
+    // be shared by several DBs to cap their combined memtable memory (and,
+    // if it was given a cache, to charge that memory to the block cache).
+    ns_memory::WriteBufferManager *write_buffer_manager{nullptr};
+
+    // Creates the index of every new memtable; nullptr for a skiplist.  See
+    // NewVectorRepFactory() for bulk loads.
+    ns_data_structure::MemTableRepFactory const *memtable_rep_factory{nullptr};
+
+    // If positive, every memtable keeps a bloom filter of
+    // write_buffer_size * memtable_bloom_size_ratio bytes in its arena, so
+    // that Get() skips the memtable for most keys never written to it.
+    // About 10 bits per entry keep false positives near 1%.
+    double memtable_bloom_size_ratio{0};
+
+    // If positive, the memtable bloom filter holds the first
+    // memtable_bloom_prefix_length bytes of user keys (all of a shorter
+    // key) instead of whole keys, and a memtable prefix iterator Seek() to
+    // a prefix never written becomes invalid without searching the rep.
+    uint64_t memtable_bloom_prefix_length{0};
+
+    // If true, a Put() of a key whose newest memtable entry is a value with
+    // room for the new one overwrites that value in place instead of adding
+    // an entry, unless a snapshot still sees it (see
+    // MemTable::SetNewestSnapshot()).  Memtables of a few hot keys then grow
+    // with the number of keys rather than of updates.  Memtable reads take a
+    // per-key lock, and memtable iterators may see a value mid-update.
+    bool memtable_inplace_update_support{false};
+
+    // Required to write merges (WriteBatch::Merge()) and to read keys that
+    // have some.
+    ns_merge_operator::MergeOperator const *merge_operator{nullptr};
+
     int32_t max_open_files{1000};
 
     ns_cache::Cache *block_cache{nullptr};
@@ -8,6 +8,12 @@ void PutVarint32(std::string* dst, uint32_t value) {
     dst->append(reinterpret_cast<char*>(buf), ptr - buf);
 }
 
+void PutVarint64(std::string *dst, uint64_t value) {
+    uint8_t buf[10];
+    uint8_t *ptr = EncodeVarint64(buf, value);
+    dst->append(reinterpret_cast<char *>(buf), ptr - buf);
+}
+
 void PutFixed32(std::string* dst, uint32_t value) {
     uint8_t buf[sizeof(value)];
     EncodeFixed32(buf, value);
@@ -83,6 +89,16 @@ uint8_t *EncodeVarint32(uint8_t *dst, uint32_t value) {
     return dst;
 }
 
+uint8_t *EncodeVarint64(uint8_t *dst, uint64_t value) {
+    static constexpr uint8_t B = 1 << 7;
+    while (value >= B) {
+        *(dst++) = value | B;
+        value >>= 7;
+    }
+    *(dst++) = static_cast<uint8_t>(value);
+    return dst;
+}
+
 uint8_t const *GetVarint32Ptr(uint8_t const *p, uint8_t const *limit, uint32_t *value) {
     uint32_t result{0U};
     static constexpr uint8_t B = 1 << 7;
@@ -23,6 +23,20 @@ void WriteBatch::Delete(ns_data_structure::Slice const &key) {
     ns_util::PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::DeleteRange(ns_data_structure::Slice const &begin_key, ns_data_structure::Slice const &end_key) {
+    WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+    rep_.push_back(static_cast<char>(ns_db_format::ValueType::kTypeRangeDeletion));
+    ns_util::PutLengthPrefixedSlice(&rep_, begin_key);
+    ns_util::PutLengthPrefixedSlice(&rep_, end_key);
+}
+
+void WriteBatch::Merge(ns_data_structure::Slice const &key, ns_data_structure::Slice const &value) {
+    WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+    rep_.push_back(static_cast<char>(ns_db_format::ValueType::kTypeMerge));
+    ns_util::PutLengthPrefixedSlice(&rep_, key);
+    ns_util::PutLengthPrefixedSlice(&rep_, value);
+}
+
 void WriteBatch::Clear() {
     rep_.clear();
     rep_.resize(kHeader);
@@ -65,6 +79,22 @@ ns_util::Status WriteBatch::Iterate(Handler *handler) const {
             }
             break;
         }
+        case ns_db_format::ValueType::kTypeRangeDeletion: {
+            if (ns_util::GetLengthPrefixedSlice(&input, &key) && ns_util::GetLengthPrefixedSlice(&input, &value)) {
+                handler->DeleteRange(key, value);
+            } else {
+                return ns_util::Status::Corruption("bad WriteBatch DeleteRange");
+            }
+            break;
+        }
+        case ns_db_format::ValueType::kTypeMerge: {
+            if (ns_util::GetLengthPrefixedSlice(&input, &key) && ns_util::GetLengthPrefixedSlice(&input, &value)) {
+                handler->Merge(key, value);
+            } else {
+                return ns_util::Status::Corruption("bad WriteBatch Merge");
+            }
+            break;
+        }
         default: {
             return ns_util::Status::Corruption("unknown WriteBatch tag");
         }
@@ -112,6 +142,16 @@ public:
         mem_->Add(sequence_, ns_db_format::ValueType::kTypeDeletion, key, ns_data_structure::Slice());
         sequence_++;
     }
+
+    void DeleteRange(ns_data_structure::Slice const &begin_key, ns_data_structure::Slice const &end_key) override {
+        mem_->Add(sequence_, ns_db_format::ValueType::kTypeRangeDeletion, begin_key, end_key);
+        sequence_++;
+    }
+
+    void Merge(ns_data_structure::Slice const &key, ns_data_structure::Slice const &value) override {
+        mem_->Add(sequence_, ns_db_format::ValueType::kTypeMerge, key, value);
+        sequence_++;
+    }
 };
 } // namespace
 
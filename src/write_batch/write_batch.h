@@ -12,6 +12,8 @@ public:
         virtual ~Handler() = default;
         virtual void Put(ns_data_structure::Slice const &key, ns_data_structure::Slice const &value) = 0;
         virtual void Delete(ns_data_structure::Slice const &key) = 0;
+        virtual void DeleteRange(ns_data_structure::Slice const &begin_key, ns_data_structure::Slice const &end_key) = 0;
+        virtual void Merge(ns_data_structure::Slice const &key, ns_data_structure::Slice const &value) = 0;
     };
 
     WriteBatch();
@@ -22,6 +24,12 @@ public:
 
     void Put(ns_data_structure::Slice const &key, ns_data_structure::Slice const &value);
     void Delete(ns_data_structure::Slice const &key);
+    // Delete every key in [begin_key, end_key), as one record however many
+    // keys that is.
+    void DeleteRange(ns_data_structure::Slice const &begin_key, ns_data_structure::Slice const &end_key);
+    // Record value as a merge operand for key; reads apply it to the older
+    // value of key with the merge operator (see ns_options::Options).
+    void Merge(ns_data_structure::Slice const &key, ns_data_structure::Slice const &value);
     void Clear();
     uint64_t ApproximateSize() const;
     void Append(WriteBatch const &source);
@@ -35,7 +43,9 @@ private:
     //    data: record[count]
     // record :=
     //    kTypeValue varstring varstring         |
-    //    kTypeDeletion varstring
+    //    kTypeDeletion varstring                |
+    //    kTypeRangeDeletion varstring varstring |
+    //    kTypeMerge varstring varstring
     // varstring :=
     //    len: varint32
     //    data: uint8[len]
@@ -0,0 +1,176 @@
+#include "adaptive_radix_tree.h"
+#include "arena.h"
+#include "log.h"
+#include "random.h"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ns_data_structure;
+using namespace ns_memory;
+using namespace ns_algorithm;
+using namespace std;
+
+namespace {
+
+// A random prefix-free key: up to max_size bytes out of the first alphabet
+// bytes, then 0xff, which no key has anywhere else.
+string RandomKey(Random *rnd, uint32_t alphabet, uint32_t max_size) {
+    string key;
+    uint32_t const size = rnd->Uniform(max_size + 1);
+    for (uint32_t i = 0; i < size; i++) {
+        key.push_back(static_cast<char>(rnd->Uniform(alphabet)));
+    }
+    key.push_back('\xff');
+    return key;
+}
+
+// Checks tree against model, the keys in it (with themselves as values).
+void CheckTree(AdaptiveRadixTree const &tree, set<string> const &model) {
+    AdaptiveRadixTree::Iterator iter(&tree);
+    iter.SeekToFirst();
+    for (string const &key : model) {
+        ASSERT_TRUE(iter.Valid());
+        ASSERT_EQ(key, iter.key().ToString());
+        ASSERT_EQ(key, *static_cast<string const *>(iter.value()));
+        ASSERT_EQ(iter.value(), tree.Get(key));
+        iter.Next();
+    }
+    ASSERT_TRUE(!iter.Valid());
+    iter.SeekToLast();
+    for (auto it = model.rbegin(); it != model.rend(); ++it) {
+        ASSERT_TRUE(iter.Valid());
+        ASSERT_EQ(*it, iter.key().ToString());
+        iter.Prev();
+    }
+    ASSERT_TRUE(!iter.Valid());
+}
+
+} // anonymous namespace
+
+TEST(ArtTest, Empty) {
+    Arena arena;
+    AdaptiveRadixTree tree(&arena);
+    ASSERT_EQ(nullptr, tree.Get("a"));
+    AdaptiveRadixTree::Iterator iter(&tree);
+    ASSERT_TRUE(!iter.Valid());
+    iter.SeekToFirst();
+    ASSERT_TRUE(!iter.Valid());
+    iter.SeekToLast();
+    ASSERT_TRUE(!iter.Valid());
+    iter.Seek("a");
+    ASSERT_TRUE(!iter.Valid());
+}
+
+TEST(ArtTest, InsertAndLookup) {
+    // A small alphabet makes long shared prefixes and prefix splits, a full
+    // one makes wide nodes.
+    for (uint32_t alphabet : {3U, 255U}) {
+        Arena arena;
+        AdaptiveRadixTree tree(&arena);
+        set<string> model;
+        Random rnd(301);
+        for (int i = 0; i < 5000; i++) {
+            string const key = RandomKey(&rnd, alphabet, 12);
+            auto it = model.insert(key).first;
+            if (tree.Get(key) == nullptr) {
+                tree.Insert(key, const_cast<string *>(&*it));
+            }
+        }
+        CheckTree(tree, model);
+
+        AdaptiveRadixTree::Iterator iter(&tree);
+        for (int i = 0; i < 5000; i++) {
+            // Targets need not be prefix-free.
+            string target = RandomKey(&rnd, alphabet, 12);
+            if (i % 2 == 0) {
+                target.pop_back();
+            }
+            if (model.count(target) == 0) {
+                ASSERT_EQ(nullptr, tree.Get(target));
+            }
+            iter.Seek(target);
+            auto model_iter = model.lower_bound(target);
+            if (model_iter == model.end()) {
+                ASSERT_TRUE(!iter.Valid());
+                continue;
+            }
+            ASSERT_TRUE(iter.Valid());
+            ASSERT_EQ(*model_iter, iter.key().ToString());
+            if (model_iter != model.begin()) {
+                iter.Prev();
+                ASSERT_TRUE(iter.Valid());
+                ASSERT_EQ(*--model_iter, iter.key().ToString());
+            }
+        }
+    }
+}
+
+TEST(ArtTest, NodeGrowth) {
+    // A node for every size on the way to 256 children, at the root and
+    // below a shared prefix.
+    Arena arena;
+    AdaptiveRadixTree tree(&arena);
+    set<string> model;
+    for (string const &prefix : {string(), string("shared")}) {
+        for (int32_t b = 254; b >= 0; b -= 3) {
+            for (int32_t c : {0, 1}) {
+                string key = prefix;
+                key.push_back(static_cast<char>(b));
+                key.push_back(static_cast<char>(c));
+                key.push_back('\xff');
+                tree.Insert(key, const_cast<string *>(&*model.insert(key).first));
+                if (b % 48 == 0) {
+                    CheckTree(tree, model);
+                }
+            }
+        }
+    }
+    CheckTree(tree, model);
+}
+
+TEST(ArtTest, ConcurrentReads) {
+    static constexpr int kNumKeys = 100000;
+    Arena arena;
+    AdaptiveRadixTree tree(&arena);
+    set<string> model;
+    vector<string const *> keys;
+    Random rnd(301);
+    for (int i = 0; i < kNumKeys; i++) {
+        auto inserted = model.insert(RandomKey(&rnd, 16, 8));
+        if (inserted.second) {
+            keys.push_back(&*inserted.first);
+        }
+    }
+    std::atomic<bool> done(false);
+    // Readers only ever see sorted keys, and every key they find has its
+    // value, while the writer is running.
+    std::thread reader([&tree, &done]() {
+        while (!done.load()) {
+            AdaptiveRadixTree::Iterator iter(&tree);
+            string last;
+            for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+                ASSERT_LT(last, iter.key().ToString());
+                ASSERT_EQ(iter.key().ToString(), *static_cast<string const *>(iter.value()));
+                last = iter.key().ToString();
+            }
+        }
+    });
+    for (string const *key : keys) {
+        tree.Insert(*key, const_cast<string *>(key));
+    }
+    done.store(true);
+    reader.join();
+    CheckTree(tree, model);
+}
+
+int main(int argc, char **argv) {
+    PRINT_INFO("Running main() from %s\n", __FILE__);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,4 +1,11 @@
 #include "arena.h"
+#include "concurrent_arena.h"
+#include "arena_block_pool.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <thread>
+#include <vector>
 using namespace ns_memory;
 
 void check1() {
@@ -8,7 +15,97 @@ void check1() {
     }
 }
 
+void check2() {
+    Arena arena(1, true);
+    for (int32_t i = 0; i < 100000; i++) {
+        uint8_t *p = arena.AllocateAligned(64);
+        p[0] = p[63] = static_cast<uint8_t>(i);
+    }
+    // 6.4 MB of small allocations fit in four huge-page blocks.
+    assert(arena.MemoryUsage() >= 4 * Arena::kHugePageSize);
+    assert(arena.MemoryUsage() < 5 * Arena::kHugePageSize);
+}
+
+// Threads fill their allocations with their own id; any overlap between
+// allocations of different threads shows up as a wrong byte afterwards.
+void check3() {
+    static constexpr int32_t kThreads = 4;
+    static constexpr int32_t kAllocations = 20000;
+    ConcurrentArena arena;
+    std::vector<std::vector<std::pair<uint8_t *, uint64_t>>> allocated(kThreads);
+    std::vector<std::thread> threads;
+    for (int32_t t = 0; t < kThreads; t++) {
+        threads.emplace_back([&arena, &allocated, t]() {
+            for (int32_t i = 0; i < kAllocations; i++) {
+                uint64_t const bytes = 1 + (i % 97);
+                uint8_t *p = (i % 2 == 0) ? arena.AllocateAligned(bytes) : arena.Allocate(bytes);
+                if (i % 2 == 0) {
+                    assert((reinterpret_cast<uintptr_t>(p) & 7) == 0);
+                }
+                memset(p, t, bytes);
+                allocated[t].emplace_back(p, bytes);
+            }
+            // Large enough to bypass the per-core chunks.
+            uint8_t *p = arena.Allocate(100000);
+            memset(p, t, 100000);
+            allocated[t].emplace_back(p, 100000);
+        });
+    }
+    uint64_t total = 0;
+    for (int32_t t = 0; t < kThreads; t++) {
+        threads[t].join();
+    }
+    for (int32_t t = 0; t < kThreads; t++) {
+        for (auto const &a : allocated[t]) {
+            for (uint64_t b = 0; b < a.second; b++) {
+                assert(a.first[b] == t);
+            }
+            total += a.second;
+        }
+    }
+    assert(arena.MemoryUsage() >= total);
+    assert(arena.MemoryUsage() < total * 2);
+}
+
+void check4() {
+    static constexpr uint64_t kBlockSize = 4096;
+    ArenaBlockPool pool(4 * kBlockSize);
+    std::vector<uint8_t *> first_blocks;
+    {
+        Arena arena(kBlockSize, false, &pool);
+        for (int32_t i = 0; i < 8; i++) {
+            // Each allocation takes most of a block.
+            first_blocks.push_back(arena.Allocate(kBlockSize / 4));
+            arena.Allocate(kBlockSize / 4 * 3);
+        }
+        assert(pool.RetainedBytes() == 0);
+    }
+    // Only four of the eight blocks are kept.
+    assert(pool.RetainedBytes() == 4 * kBlockSize);
+    {
+        Arena arena(kBlockSize, false, &pool);
+        uint8_t *p = arena.Allocate(16);
+        assert(std::find(first_blocks.begin(), first_blocks.end(), p) != first_blocks.end());
+        assert(pool.RetainedBytes() == 3 * kBlockSize);
+        // Oversized allocations do not come from the pool.
+        arena.Allocate(kBlockSize);
+        assert(pool.RetainedBytes() == 3 * kBlockSize);
+    }
+    assert(pool.RetainedBytes() == 4 * kBlockSize);
+    pool.SetMaxRetainedBytes(kBlockSize);
+    assert(pool.RetainedBytes() == kBlockSize);
+
+    ArenaBlockPool warm(8 * kBlockSize);
+    warm.Prefill(kBlockSize, 3 * kBlockSize);
+    assert(warm.RetainedBytes() == 3 * kBlockSize);
+    warm.Prefill(kBlockSize, 100 * kBlockSize);
+    assert(warm.RetainedBytes() == 8 * kBlockSize);
+}
+
 int main() {
     check1();
+    check2();
+    check3();
+    check4();
     return 0;
 }
\ No newline at end of file
@@ -2,14 +2,26 @@
 #include "log.h"
 #include "comparator.h"
 #include "cache.h"
+#include "frequency_sketch.h"
+#include "handle_table.h"
+#include "hash.h"
+#include "random.h"
 #include <gtest/gtest.h>
 #include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <limits>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 using namespace ns_db_format;
 using namespace ns_comparator;
 using namespace ns_data_structure;
 using namespace ns_util;
 using namespace ns_cache;
+using namespace ns_algorithm;
 
 static std::string EncodeKey(int32_t k) {
     std::string result;
@@ -32,7 +44,7 @@ static int32_t DecodeValue(void *v) {
 
 class CacheTest : public testing::Test {
 public:
-    static void Deleter(Slice const &key, void *v) {
+    static void Deleter(Slice const &key, void *v, void *arg) {
         currrent_->deleted_keys_.push_back(DecodeKey(key));
         currrent_->deleted_values_.push_back(DecodeValue(v));
     };
@@ -61,11 +73,11 @@ public:
     }
 
     void Insert(int32_t key, int32_t value, int32_t charge = 1) {
-        cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge, CacheTest::Deleter));
+        cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge, CacheTest::Deleter, nullptr));
     }
 
     Cache::Handle *InsertAndReturnHandle(int32_t key, int32_t value, int32_t charge = 1) {
-        return cache_->Insert(EncodeKey(key), EncodeValue(value), charge, CacheTest::Deleter);
+        return cache_->Insert(EncodeKey(key), EncodeValue(value), charge, CacheTest::Deleter, nullptr);
     }
 
     void Erase(int32_t key) {
@@ -160,6 +172,491 @@ TEST_F(CacheTest, EvictionPolicy) {
     cache_->Release(h);
 }
 
+TEST_F(CacheTest, ScanFlushesPlainLRU) {
+    Insert(100, 101);
+    ASSERT_EQ(101, Lookup(100));
+    for (int32_t i = 0; i < kCacheSize * 2; i++) {
+        Insert(1000 + i, 2000 + i);
+    }
+    ASSERT_EQ(-1, Lookup(100));
+}
+
+TEST_F(CacheTest, HitEntriesSurviveScan) {
+    delete cache_;
+    cache_ = NewLRUCache(kCacheSize, 0.5);
+    // Hot entries are hit once after insertion, which promotes them to the
+    // high-priority pool.
+    for (int32_t i = 0; i < 10; i++) {
+        Insert(100 + i, 200 + i);
+        ASSERT_EQ(200 + i, Lookup(100 + i));
+    }
+    // A scan only touches every entry once.
+    for (int32_t i = 0; i < kCacheSize * 2; i++) {
+        Insert(1000 + i, 2000 + i);
+    }
+    for (int32_t i = 0; i < 10; i++) {
+        ASSERT_EQ(200 + i, Lookup(100 + i));
+    }
+    ASSERT_EQ(-1, Lookup(1000));
+}
+
+TEST_F(CacheTest, HighPriorityInsertSurvivesScan) {
+    delete cache_;
+    cache_ = NewLRUCache(kCacheSize, 0.5);
+    cache_->Release(cache_->Insert(EncodeKey(100), EncodeValue(101), 1, CacheTest::Deleter, nullptr, Cache::Priority::kHigh));
+    cache_->Release(cache_->Insert(EncodeKey(200), EncodeValue(201), 1, CacheTest::Deleter, nullptr, Cache::Priority::kLow));
+    for (int32_t i = 0; i < kCacheSize * 2; i++) {
+        Insert(1000 + i, 2000 + i);
+    }
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(-1, Lookup(200));
+}
+
+TEST_F(CacheTest, HighPriorityPoolIsBounded) {
+    delete cache_;
+    cache_ = NewLRUCache(kCacheSize, 0.5);
+    // Promote far more entries than the high-priority pool can hold; the
+    // oldest of them must fall back into the low-priority pool and get evicted.
+    for (int32_t i = 0; i < kCacheSize * 2; i++) {
+        Insert(1000 + i, 2000 + i);
+        ASSERT_EQ(2000 + i, Lookup(1000 + i));
+    }
+    ASSERT_EQ(-1, Lookup(1000));
+    ASSERT_EQ(2000 + kCacheSize * 2 - 1, Lookup(1000 + kCacheSize * 2 - 1));
+    ASSERT_LE(cache_->TotalCharge(), static_cast<uint64_t>(kCacheSize + 16));
+}
+
+TEST(FrequencySketchTest, CountsAndSaturates) {
+    FrequencySketch sketch(64);
+    ASSERT_EQ(0, sketch.Frequency(1));
+    for (int32_t i = 0; i < 5; i++) {
+        sketch.Increment(1);
+    }
+    ASSERT_GE(sketch.Frequency(1), 5U);
+    for (int32_t i = 0; i < 100; i++) {
+        sketch.Increment(2);
+    }
+    ASSERT_EQ(15, sketch.Frequency(2));
+}
+
+TEST(FrequencySketchTest, Aging) {
+    FrequencySketch sketch(64);
+    for (int32_t i = 0; i < 8; i++) {
+        sketch.Increment(1);
+    }
+    uint32_t const before = sketch.Frequency(1);
+    // Enough distinct accesses to complete a sample and halve all counters.
+    for (uint32_t i = 0; i < 64 * 10; i++) {
+        sketch.Increment(1000 + i);
+    }
+    ASSERT_LT(sketch.Frequency(1), before);
+}
+
+TEST_F(CacheTest, AdmissionFilterKeepsHotEntries) {
+    delete cache_;
+    LRUCacheOptions options;
+    options.capacity = kCacheSize;
+    options.use_admission_filter = true;
+    options.estimated_entry_charge = 1;
+    cache_ = NewLRUCache(options);
+
+    static constexpr int32_t kNumHot = kCacheSize / 2;
+    for (int32_t i = 0; i < kNumHot; i++) {
+        ASSERT_EQ(-1, Lookup(i));
+        Insert(i, 1000 + i);
+        for (int32_t j = 0; j < 3; j++) {
+            ASSERT_EQ(1000 + i, Lookup(i));
+        }
+    }
+    // One-hit wonders: every key is missed and inserted exactly once.
+    for (int32_t i = 0; i < kCacheSize * 2; i++) {
+        ASSERT_EQ(-1, Lookup(10000 + i));
+        Insert(10000 + i, 20000 + i);
+    }
+    // The sketch is probabilistic: a cold key whose counters all collide
+    // with hot keys may still get in, so allow a few losses.
+    int32_t hot_hits = 0;
+    for (int32_t i = 0; i < kNumHot; i++) {
+        if (Lookup(i) == 1000 + i) {
+            hot_hits++;
+        }
+    }
+    ASSERT_GE(hot_hits, kNumHot * 95 / 100);
+    uint64_t admitted, rejected;
+    cache_->GetAdmissionStats(&admitted, &rejected);
+    ASSERT_GT(rejected, 0U);
+    ASSERT_GE(admitted, static_cast<uint64_t>(kNumHot));
+    ASSERT_EQ(static_cast<uint64_t>(kNumHot + kCacheSize * 2), admitted + rejected);
+}
+
+TEST_F(CacheTest, AdmissionFilterAcceptsUpdates) {
+    delete cache_;
+    LRUCacheOptions options;
+    options.capacity = kCacheSize;
+    options.use_admission_filter = true;
+    options.estimated_entry_charge = 1;
+    cache_ = NewLRUCache(options);
+
+    for (int32_t i = 0; i < kCacheSize * 2; i++) {
+        Lookup(i);
+        Lookup(i);
+        Insert(i, 1000 + i);
+    }
+    for (int32_t i = 0; i < kCacheSize * 2; i++) {
+        if (Lookup(i) != -1) {
+            Insert(i, 5000 + i);
+            ASSERT_EQ(5000 + i, Lookup(i));
+        }
+    }
+}
+
+TEST_F(CacheTest, NoAdmissionStatsWithoutFilter) {
+    Insert(100, 101);
+    uint64_t admitted, rejected;
+    cache_->GetAdmissionStats(&admitted, &rejected);
+    ASSERT_EQ(0, admitted);
+    ASSERT_EQ(0, rejected);
+}
+
+TEST_F(CacheTest, MultiLookup) {
+    static constexpr int32_t kNumKeys = 200;
+    // Even keys are cached, odd ones are not.
+    for (int32_t i = 0; i < kNumKeys; i += 2) {
+        Insert(i, 1000 + i);
+    }
+    std::vector<std::string> key_data;
+    for (int32_t i = 0; i < kNumKeys; i++) {
+        key_data.push_back(EncodeKey(i));
+    }
+    std::vector<Slice> keys(key_data.begin(), key_data.end());
+    std::vector<Cache::Handle *> handles(kNumKeys);
+    cache_->MultiLookup(keys.data(), kNumKeys, handles.data());
+    for (int32_t i = 0; i < kNumKeys; i++) {
+        if (i % 2 == 0) {
+            ASSERT_TRUE(handles[i] != nullptr);
+            ASSERT_EQ(1000 + i, DecodeValue(cache_->Value(handles[i])));
+        } else {
+            ASSERT_TRUE(handles[i] == nullptr);
+        }
+    }
+
+    // The returned handles pin their entries like Lookup() does.
+    Erase(0);
+    ASSERT_EQ(0, deleted_keys_.size());
+    cache_->MultiRelease(handles.data(), kNumKeys);
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(0, deleted_keys_[0]);
+    ASSERT_EQ(1002, Lookup(2));
+}
+
+static CacheShardStats SumShardStats(Cache *cache) {
+    std::vector<CacheShardStats> shards;
+    cache->GetShardStats(&shards);
+    EXPECT_EQ(16, shards.size());
+    CacheShardStats total;
+    for (CacheShardStats const &s : shards) {
+        total.capacity += s.capacity;
+        total.usage += s.usage;
+        total.pinned_usage += s.pinned_usage;
+        total.hits += s.hits;
+        total.misses += s.misses;
+        total.inserts += s.inserts;
+        total.evictions += s.evictions;
+        total.lock_waits += s.lock_waits;
+        total.lock_wait_nanos += s.lock_wait_nanos;
+    }
+    return total;
+}
+
+TEST_F(CacheTest, ShardStats) {
+    for (int32_t i = 0; i < kCacheSize * 2; i++) {
+        Insert(i, 1000 + i);
+    }
+    for (int32_t i = 0; i < kCacheSize * 2; i++) {
+        Lookup(i);
+    }
+    Cache::Handle *h = InsertAndReturnHandle(kCacheSize * 3, 0, 7);
+
+    CacheShardStats const total = SumShardStats(cache_);
+    ASSERT_GE(total.capacity, kCacheSize);
+    ASSERT_EQ(cache_->TotalCharge(), total.usage);
+    ASSERT_EQ(7, total.pinned_usage);
+    ASSERT_EQ(kCacheSize * 2 + 1, total.inserts);
+    ASSERT_EQ(kCacheSize * 2, total.hits + total.misses);
+    ASSERT_GT(total.hits, 0);
+    ASSERT_GT(total.misses, 0);
+    // Only charge-1 entries were evicted; the pinned one stays.
+    ASSERT_EQ(kCacheSize * 2 + 7 - total.usage, total.evictions);
+    ASSERT_EQ(0, total.lock_waits);
+    cache_->Release(h);
+}
+
+// Holds the shard mutex for a while: the deleter runs under it.
+static std::atomic<bool> slow_deleter_entered{false};
+static void SlowDeleter(Slice const &key, void *value, void *arg) {
+    slow_deleter_entered = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+TEST(CacheStatsTest, LockWait) {
+    Cache *cache = NewLRUCache(1000);
+    cache->Release(cache->Insert(EncodeKey(1), EncodeValue(1), 1, SlowDeleter, nullptr));
+    std::thread eraser([&]() { cache->Erase(EncodeKey(1)); });
+    while (!slow_deleter_entered) {
+        std::this_thread::yield();
+    }
+    // Same key, same shard: blocks until the deleter returns.
+    ASSERT_TRUE(cache->Lookup(EncodeKey(1)) == nullptr);
+    eraser.join();
+
+    CacheShardStats const total = SumShardStats(cache);
+    ASSERT_EQ(1, total.lock_waits);
+    ASSERT_GT(total.lock_wait_nanos, 0);
+    PRINT_INFO("waited %.1f ms for the shard mutex\n", total.lock_wait_nanos / 1e6);
+    delete cache;
+}
+
+static void NoopDeleter(Slice const &key, void *value, void *arg) {
+}
+
+// Replays trace against cache, inserting on every miss, and returns the hit
+// rate.
+static double ReplayTrace(Cache *cache, std::vector<int32_t> const &trace) {
+    int64_t hits = 0;
+    for (int32_t key : trace) {
+        Cache::Handle *h = cache->Lookup(EncodeKey(key));
+        if (h != nullptr) {
+            hits++;
+        } else {
+            h = cache->Insert(EncodeKey(key), EncodeValue(key), 1, NoopDeleter, nullptr);
+        }
+        cache->Release(h);
+    }
+    return static_cast<double>(hits) / trace.size();
+}
+
+static void CompareHitRates(char const *name, uint64_t capacity, std::vector<int32_t> const &trace, double *lru, double *arc) {
+    Cache *cache = NewLRUCache(capacity);
+    *lru = ReplayTrace(cache, trace);
+    delete cache;
+    cache = NewARCCache(capacity);
+    *arc = ReplayTrace(cache, trace);
+    delete cache;
+    PRINT_INFO("%s: LRU hit rate %.3f, ARC hit rate %.3f\n", name, *lru, *arc);
+}
+
+TEST(ARCCacheTest, MixedScanAndPointTrace) {
+    // Point lookups on a hot set that fits in the cache, interrupted by
+    // scans of cold keys that are each read once.
+    static constexpr int32_t kHotKeys = 600;
+    static constexpr int32_t kScanLength = 3000;
+    Random rnd(301);
+    std::vector<int32_t> trace;
+    int32_t next_cold = 1000000;
+    for (int32_t phase = 0; phase < 20; phase++) {
+        for (int32_t i = 0; i < 5000; i++) {
+            trace.push_back(rnd.Uniform(kHotKeys));
+        }
+        for (int32_t i = 0; i < kScanLength; i++) {
+            trace.push_back(next_cold++);
+        }
+    }
+    double lru, arc;
+    CompareHitRates("scan + point", 1000, trace, &lru, &arc);
+    ASSERT_GT(arc, lru + 0.05);
+}
+
+TEST(ARCCacheTest, SkewedTrace) {
+    Random rnd(301);
+    std::vector<int32_t> trace;
+    for (int32_t i = 0; i < 200000; i++) {
+        trace.push_back(rnd.Skewed(14));
+    }
+    double lru, arc;
+    CompareHitRates("skewed", 1000, trace, &lru, &arc);
+    ASSERT_GE(arc, lru);
+}
+
+TEST(ARCCacheTest, RecencyTrace) {
+    // A working set that slides forward: LRU is already the right policy,
+    // ARC must not lose much against it.
+    Random rnd(301);
+    std::vector<int32_t> trace;
+    for (int32_t i = 0; i < 200000; i++) {
+        trace.push_back(i / 100 + rnd.Uniform(500));
+    }
+    double lru, arc;
+    CompareHitRates("sliding window", 1000, trace, &lru, &arc);
+    ASSERT_GE(arc, lru - 0.02);
+}
+
+TEST(ARCCacheTest, Basics) {
+    Cache *cache = NewARCCache(1000);
+    ASSERT_TRUE(cache->Lookup(EncodeKey(100)) == nullptr);
+    cache->Release(cache->Insert(EncodeKey(100), EncodeValue(101), 1, NoopDeleter, nullptr));
+    cache->Release(cache->Insert(EncodeKey(100), EncodeValue(102), 1, NoopDeleter, nullptr));
+    Cache::Handle *h = cache->Lookup(EncodeKey(100));
+    ASSERT_EQ(102, DecodeValue(cache->Value(h)));
+    // Pinned entries survive any amount of churn.
+    for (int32_t i = 0; i < 10000; i++) {
+        cache->Release(cache->Insert(EncodeKey(1000 + i), EncodeValue(i), 1, NoopDeleter, nullptr));
+    }
+    ASSERT_LE(cache->TotalCharge(), 1000 + 16);
+    cache->Erase(EncodeKey(100));
+    ASSERT_EQ(102, DecodeValue(cache->Value(h)));
+    cache->Release(h);
+    ASSERT_TRUE(cache->Lookup(EncodeKey(100)) == nullptr);
+    cache->Prune();
+    ASSERT_EQ(0, cache->TotalCharge());
+    delete cache;
+}
+
+// Benchmarks are opt-in: run with --gtest_also_run_disabled_tests.
+TEST(CacheBenchmark, DISABLED_InsertCostAndOverhead) {
+    static constexpr int32_t kCapacity = 100000;
+    static constexpr int32_t kInserts = 1000000;
+    Cache *cache = NewLRUCache(kCapacity);
+    // Block cache keys are a fixed64 cache id followed by a fixed64 offset.
+    auto key = [](int32_t i) {
+        std::string result;
+        PutFixed64(&result, 1);
+        PutFixed64(&result, i);
+        return result;
+    };
+
+    // Heap usage is only known with glibc.
+    auto heap_usage = []() -> uint64_t {
+#ifdef __GLIBC__
+        return mallinfo2().uordblks;
+#else
+        return 0;
+#endif
+    };
+    uint64_t const heap_before = heap_usage();
+    for (int32_t i = 0; i < kCapacity; i++) {
+        cache->Release(cache->Insert(key(i), EncodeValue(i), 1, NoopDeleter, nullptr));
+    }
+    uint64_t const heap_after = heap_usage();
+
+    // Steady state: every insert evicts an entry.
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t i = kCapacity; i < kCapacity + kInserts; i++) {
+        cache->Release(cache->Insert(key(i), EncodeValue(i), 1, NoopDeleter, nullptr));
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    PRINT_INFO("LRUCache insert: %.1f ns/op, %.1f heap bytes/entry\n",
+               elapsed.count() / kInserts, static_cast<double>(heap_after - heap_before) / kCapacity);
+    delete cache;
+}
+
+namespace {
+
+struct TestHandle {
+    std::string key_data;
+    uint32_t hash;
+    TestHandle *next_hash;
+
+    Slice key() const {
+        return key_data;
+    }
+};
+
+} // anonymous namespace
+
+TEST(HandleTableTest, IncrementalResize) {
+    static constexpr int32_t kNumHandles = 100000;
+    using Table = HandleTable<TestHandle>;
+    Table table;
+    std::vector<TestHandle> handles(kNumHandles);
+    for (int32_t i = 0; i < kNumHandles; i++) {
+        handles[i].key_data = EncodeKey(i);
+        handles[i].hash = Hash(reinterpret_cast<uint8_t const *>(handles[i].key_data.data()), handles[i].key_data.size(), 0);
+    }
+    int32_t resizes = 0;
+    for (int32_t i = 0; i < kNumHandles; i++) {
+        uint32_t const before = table.PendingMigration();
+        ASSERT_EQ(nullptr, table.Insert(&handles[i]));
+        uint32_t const after = table.PendingMigration();
+        if (after > before) {
+            // A resize started; the previous one had drained in time.
+            ASSERT_LE(before, Table::kMigrateBucketsPerCall);
+            resizes++;
+        } else {
+            // Every insert moves only a few buckets.
+            ASSERT_LE(before - after, Table::kMigrateBucketsPerCall);
+        }
+        // Entries in both arrays stay reachable.
+        if (i % 97 == 0) {
+            for (int32_t j = 0; j <= i; j += 13) {
+                ASSERT_EQ(&handles[j], table.Lookup(handles[j].key(), handles[j].hash));
+            }
+        }
+    }
+    ASSERT_GT(resizes, 10);
+    for (int32_t i = 0; i < kNumHandles; i++) {
+        uint32_t const before = table.PendingMigration();
+        ASSERT_EQ(&handles[i], table.Remove(handles[i].key(), handles[i].hash));
+        ASSERT_LE(before - table.PendingMigration(), Table::kMigrateBucketsPerCall);
+        ASSERT_EQ(nullptr, table.Lookup(handles[i].key(), handles[i].hash));
+    }
+    ASSERT_EQ(0U, table.PendingMigration());
+}
+
+// Bucket i counts inserts that took [2^i, 2^(i+1)) nanoseconds.
+static int32_t LatencyBucket(int64_t nanos) {
+    int32_t bucket = 0;
+    while (nanos > 1 && bucket < 39) {
+        nanos >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Timing only; HandleTableTest.IncrementalResize checks the bound on the
+// work per insert.
+TEST(CacheBenchmark, DISABLED_InsertLatencyWhileGrowing) {
+    static constexpr int32_t kInserts = 1000000;
+    static constexpr int32_t kRuns = 3;
+    std::vector<std::string> keys;
+    keys.reserve(kInserts);
+    for (int32_t i = 0; i < kInserts; i++) {
+        std::string key;
+        PutFixed64(&key, 1);
+        PutFixed64(&key, i);
+        keys.push_back(key);
+    }
+
+    // A rehash stall hits the same insert in every run while preemption by
+    // the scheduler does not, so keep the fastest time seen for each insert.
+    std::vector<int64_t> latency(kInserts, std::numeric_limits<int64_t>::max());
+    for (int32_t run = 0; run < kRuns; run++) {
+        // Large enough that nothing is evicted: every insert grows a hash table.
+        Cache *cache = NewLRUCache(kInserts);
+        for (int32_t i = 0; i < kInserts; i++) {
+            auto start = std::chrono::steady_clock::now();
+            cache->Release(cache->Insert(keys[i], EncodeValue(i), 1, NoopDeleter, nullptr));
+            int64_t const nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count();
+            latency[i] = std::min(latency[i], nanos);
+        }
+        delete cache;
+    }
+
+    std::vector<int64_t> histogram(40, 0);
+    int64_t max_nanos = 0;
+    for (int32_t i = 0; i < kInserts; i++) {
+        histogram[LatencyBucket(latency[i])]++;
+        max_nanos = std::max(max_nanos, latency[i]);
+    }
+    for (int32_t i = 0; i < static_cast<int32_t>(histogram.size()); i++) {
+        if (histogram[i] > 0) {
+            PRINT_INFO("[%10lld, %10lld) ns: %lld\n", 1LL << i, 1LL << (i + 1), static_cast<long long>(histogram[i]));
+        }
+    }
+    PRINT_INFO("max insert latency: %lld ns\n", static_cast<long long>(max_nanos));
+}
+
 int main(int argc, char **argv) {
     PRINT_INFO("Running main() from %s\n", __FILE__);
     testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,184 @@
+#include "log.h"
+#include "coding.h"
+#include "cache.h"
+#include "cache_dump.h"
+#include "env.h"
+#include "test_util.h"
+#include <gtest/gtest.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace ns_data_structure;
+using namespace ns_util;
+using namespace ns_cache;
+using namespace ns_env;
+
+static std::string EncodeKey(int32_t k) {
+    std::string result;
+    PutFixed32(&result, k);
+    return result;
+}
+
+static int32_t DecodeKey(Slice const &k) {
+    assert(k.size() == 4);
+    return DecodeFixed32(k.data());
+}
+
+static void NoopDeleter(Slice const &key, void *value, void *arg) {
+}
+
+class CacheDumpTest : public testing::Test {
+public:
+    static constexpr int32_t kNumKeys = 1000;
+    static constexpr int32_t kCacheSize = 100 * kNumKeys;
+
+    // Records the keys it is asked for and puts them into cache_.
+    static bool Loader(Slice const &key, uint64_t charge, void *arg) {
+        CacheDumpTest *test = reinterpret_cast<CacheDumpTest *>(arg);
+        test->loaded_.push_back(DecodeKey(key));
+        test->cache_->Release(test->cache_->Insert(key, nullptr, charge, NoopDeleter, nullptr));
+        return true;
+    }
+
+    CacheDumpTest() :
+        env_(Env::Default()), cache_(NewLRUCache(kCacheSize)) {
+        EXPECT_TRUE(env_->GetTestDirectory(&fname_).ok());
+        fname_ += "/cache_dump_test";
+    }
+
+    ~CacheDumpTest() {
+        delete cache_;
+        env_->RemoveFile(fname_);
+    }
+
+    void Fill() {
+        for (int32_t i = 0; i < kNumKeys; i++) {
+            cache_->Release(cache_->Insert(EncodeKey(i), nullptr, 1, NoopDeleter, nullptr));
+        }
+    }
+
+    // Replace the cache with an empty one, as after a restart.
+    void Restart() {
+        delete cache_;
+        cache_ = NewLRUCache(kCacheSize);
+    }
+
+    Status Reload(CacheReloadOptions const &options) {
+        return ReloadCacheKeys(env_, cache_, fname_, options, Loader, this);
+    }
+
+    Env *env_;
+    Cache *cache_;
+    std::string fname_;
+    std::vector<int32_t> loaded_;
+};
+
+TEST_F(CacheDumpTest, ReloadsHottestFirst) {
+    static constexpr int32_t kNumHot = 400;
+    Fill();
+    // Keys [0, kNumHot) become the most recently used ones.
+    for (int32_t i = 0; i < kNumHot; i++) {
+        cache_->Release(cache_->Lookup(EncodeKey(i)));
+    }
+    ASSERT_LEVELDB_OK(SaveCacheKeys(env_, cache_, kNumKeys, fname_));
+
+    Restart();
+    ASSERT_LEVELDB_OK(Reload(CacheReloadOptions()));
+    ASSERT_EQ(kNumKeys, loaded_.size());
+    // Shards are interleaved, so only the head of the dump is exactly hot.
+    for (int32_t i = 0; i < kNumHot / 4; i++) {
+        ASSERT_LT(loaded_[i], kNumHot);
+    }
+    for (int32_t i = 0; i < kNumKeys; i++) {
+        Cache::Handle *handle = cache_->Lookup(EncodeKey(i));
+        ASSERT_TRUE(handle != nullptr);
+        cache_->Release(handle);
+    }
+}
+
+TEST_F(CacheDumpTest, SaveRespectsMaxCharge) {
+    Fill();
+    ASSERT_LEVELDB_OK(SaveCacheKeys(env_, cache_, 100, fname_));
+    Restart();
+    ASSERT_LEVELDB_OK(Reload(CacheReloadOptions()));
+    ASSERT_EQ(100, loaded_.size());
+}
+
+TEST_F(CacheDumpTest, SkipsCachedKeysAndStopsAtMaxBytes) {
+    Fill();
+    ASSERT_LEVELDB_OK(SaveCacheKeys(env_, cache_, kNumKeys, fname_));
+    // Everything is still cached: nothing to load.
+    ASSERT_LEVELDB_OK(Reload(CacheReloadOptions()));
+    ASSERT_EQ(0, loaded_.size());
+
+    Restart();
+    CacheReloadOptions options;
+    options.max_bytes = 10;
+    ASSERT_LEVELDB_OK(Reload(options));
+    ASSERT_EQ(10, loaded_.size());
+}
+
+TEST_F(CacheDumpTest, RateLimit) {
+    static constexpr int32_t kNumEntries = 20;
+    static constexpr uint64_t kCharge = 100;
+    for (int32_t i = 0; i < kNumEntries; i++) {
+        cache_->Release(cache_->Insert(EncodeKey(i), nullptr, kCharge, NoopDeleter, nullptr));
+    }
+    ASSERT_LEVELDB_OK(SaveCacheKeys(env_, cache_, kNumEntries * kCharge, fname_));
+    Restart();
+
+    // 2000 bytes at 10000 bytes/s take at least 200ms.
+    CacheReloadOptions options;
+    options.bytes_per_second = 10000;
+    uint64_t const start = env_->NowMicros();
+    ASSERT_LEVELDB_OK(Reload(options));
+    ASSERT_EQ(kNumEntries, loaded_.size());
+    ASSERT_GE(env_->NowMicros() - start, 200000U);
+}
+
+TEST_F(CacheDumpTest, RejectsCorruptDump) {
+    Fill();
+    ASSERT_LEVELDB_OK(SaveCacheKeys(env_, cache_, kNumKeys, fname_));
+    std::string contents;
+    ASSERT_LEVELDB_OK(ReadFileToString(env_, fname_, &contents));
+    contents[contents.size() / 2] ^= 0x01;
+    ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, fname_, false));
+
+    Restart();
+    ASSERT_TRUE(Reload(CacheReloadOptions()).IsCorruption());
+    ASSERT_EQ(0, loaded_.size());
+}
+
+TEST_F(CacheDumpTest, ScheduledReload) {
+    Fill();
+    ASSERT_LEVELDB_OK(SaveCacheKeys(env_, cache_, kNumKeys, fname_));
+    Restart();
+
+    struct Done {
+        std::mutex mu;
+        std::condition_variable cv;
+        bool finished{false};
+        Status status;
+    } done;
+    ScheduleCacheReload(env_, cache_, fname_, CacheReloadOptions(), Loader, this,
+                        [](Status const &s, void *arg) {
+                            Done *d = reinterpret_cast<Done *>(arg);
+                            std::unique_lock<std::mutex> lck(d->mu);
+                            d->status = s;
+                            d->finished = true;
+                            d->cv.notify_all();
+                        },
+                        &done);
+    std::unique_lock<std::mutex> lck(done.mu);
+    done.cv.wait(lck, [&]() { return done.finished; });
+    ASSERT_LEVELDB_OK(done.status);
+    ASSERT_EQ(kNumKeys, loaded_.size());
+}
+
+int main(int argc, char **argv) {
+    PRINT_INFO("Running main() from %s\n", __FILE__);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
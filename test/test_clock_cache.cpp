@@ -0,0 +1,241 @@
+#include "log.h"
+#include "coding.h"
+#include "cache.h"
+#include "random.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace ns_data_structure;
+using namespace ns_util;
+using namespace ns_cache;
+using namespace ns_algorithm;
+
+static std::string EncodeKey(int32_t k) {
+    std::string result;
+    PutFixed32(&result, k);
+    return result;
+}
+
+static int32_t DecodeKey(Slice const &k) {
+    assert(k.size() == 4);
+    return DecodeFixed32(k.data());
+}
+
+static void *EncodeValue(uintptr_t v) {
+    return reinterpret_cast<void *>(v);
+}
+
+static int32_t DecodeValue(void *v) {
+    return reinterpret_cast<uintptr_t>(v);
+}
+
+class ClockCacheTest : public testing::Test {
+public:
+    static void Deleter(Slice const &key, void *v, void *arg) {
+        currrent_->deleted_keys_.push_back(DecodeKey(key));
+        currrent_->deleted_values_.push_back(DecodeValue(v));
+    };
+
+    static constexpr int32_t kCacheSize = 1000;
+    std::vector<int32_t> deleted_keys_;
+    std::vector<int32_t> deleted_values_;
+    Cache *cache_;
+
+    ClockCacheTest() :
+        cache_(NewClockCache(kCacheSize, 1)) {
+        currrent_ = this;
+    }
+
+    ~ClockCacheTest() {
+        delete cache_;
+    }
+
+    int32_t Lookup(int32_t key) {
+        Cache::Handle *handle = cache_->Lookup(EncodeKey(key));
+        int32_t const r = (handle == nullptr) ? -1 : DecodeValue(cache_->Value(handle));
+        if (handle != nullptr) {
+            cache_->Release(handle);
+        }
+        return r;
+    }
+
+    void Insert(int32_t key, int32_t value, int32_t charge = 1) {
+        cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge, ClockCacheTest::Deleter, nullptr));
+    }
+
+    void Erase(int32_t key) {
+        cache_->Erase(EncodeKey(key));
+    }
+
+    static ClockCacheTest *currrent_;
+};
+
+ClockCacheTest *ClockCacheTest::currrent_;
+
+TEST_F(ClockCacheTest, HitAndMiss) {
+    ASSERT_EQ(-1, Lookup(100));
+
+    Insert(100, 101);
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(-1, Lookup(200));
+    ASSERT_EQ(-1, Lookup(300));
+
+    Insert(200, 201);
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(-1, Lookup(300));
+
+    Insert(100, 102);
+    ASSERT_EQ(102, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(-1, Lookup(300));
+
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+}
+
+TEST_F(ClockCacheTest, Erase) {
+    Erase(200);
+    ASSERT_EQ(0, deleted_keys_.size());
+
+    Insert(100, 101);
+    Insert(200, 201);
+    Erase(100);
+    ASSERT_EQ(-1, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+
+    Erase(100);
+    ASSERT_EQ(-1, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(1, deleted_keys_.size());
+}
+
+TEST_F(ClockCacheTest, EntireArePinned) {
+    Insert(100, 101);
+    Cache::Handle *h1 = cache_->Lookup(EncodeKey(100));
+    ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+    Insert(100, 102);
+    Cache::Handle *h2 = cache_->Lookup(EncodeKey(100));
+    ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+    ASSERT_EQ(0, deleted_keys_.size());
+
+    cache_->Release(h1);
+    ASSERT_EQ(1, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+
+    Erase(100);
+    ASSERT_EQ(-1, Lookup(100));
+    ASSERT_EQ(1, deleted_keys_.size());
+
+    cache_->Release(h2);
+    ASSERT_EQ(2, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[1]);
+    ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST_F(ClockCacheTest, EvictionPolicy) {
+    Insert(100, 101);
+    Insert(200, 201);
+    Insert(300, 301);
+    Cache::Handle *h = cache_->Lookup(EncodeKey(300));
+    // CLOCK only approximates LRU, so push enough entries through every shard
+    // for the hand to sweep all of it.
+    for (int32_t i = 0; i < kCacheSize * 4; i++) {
+        Insert(1000 + i, 2000 + i);
+        ASSERT_EQ(2000 + i, Lookup(1000 + i));
+        ASSERT_EQ(101, Lookup(100));
+    }
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(-1, Lookup(200));
+    ASSERT_EQ(301, Lookup(300));
+    cache_->Release(h);
+}
+
+TEST_F(ClockCacheTest, UseExceedsCacheSize) {
+    // Overfill the cache, keeping handles on all inserted entries.
+    std::vector<Cache::Handle *> h;
+    for (int32_t i = 0; i < kCacheSize + 100; i++) {
+        h.push_back(cache_->Insert(EncodeKey(1000 + i), EncodeValue(2000 + i), 1, ClockCacheTest::Deleter, nullptr));
+    }
+    // Check that all the entries can still be read back.
+    for (uint64_t i = 0; i < h.size(); i++) {
+        ASSERT_EQ(2000 + static_cast<int32_t>(i), DecodeValue(cache_->Value(h[i])));
+    }
+    for (uint64_t i = 0; i < h.size(); i++) {
+        cache_->Release(h[i]);
+    }
+    ASSERT_LE(cache_->TotalCharge(), static_cast<uint64_t>(kCacheSize + 100));
+}
+
+TEST_F(ClockCacheTest, ZeroSizeCache) {
+    delete cache_;
+    cache_ = NewClockCache(0);
+    Insert(1, 100);
+    ASSERT_EQ(-1, Lookup(1));
+    ASSERT_EQ(1, deleted_keys_.size());
+}
+
+static void NoopDeleter(Slice const &key, void *value, void *arg) {
+}
+
+// Benchmarks are opt-in: run with --gtest_also_run_disabled_tests.
+// Measures lookup throughput of concurrent readers that always hit.
+static double MeasureLookups(Cache *cache, int32_t num_threads, int32_t num_keys, int32_t lookups_per_thread) {
+    for (int32_t i = 0; i < num_keys; i++) {
+        cache->Release(cache->Insert(EncodeKey(i), EncodeValue(i), 1, NoopDeleter, nullptr));
+    }
+    std::atomic<int64_t> misses{0};
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t]() {
+            Random rnd(301 + t);
+            for (int32_t i = 0; i < lookups_per_thread; i++) {
+                Cache::Handle *h = cache->Lookup(EncodeKey(rnd.Uniform(num_keys)));
+                if (h == nullptr) {
+                    misses.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    cache->Release(h);
+                }
+            }
+        });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(0, misses.load());
+    return static_cast<double>(num_threads) * lookups_per_thread / elapsed.count();
+}
+
+TEST(ClockCacheBenchmark, DISABLED_MultiThreadedLookup) {
+    static constexpr int32_t kNumKeys = 10000;
+    static constexpr int32_t kLookupsPerThread = 200000;
+    int32_t const num_threads = std::max(4U, std::thread::hardware_concurrency());
+
+    Cache *lru = NewLRUCache(kNumKeys * 2);
+    double const lru_ops = MeasureLookups(lru, num_threads, kNumKeys, kLookupsPerThread);
+    delete lru;
+
+    Cache *clock = NewClockCache(kNumKeys * 2, 1);
+    double const clock_ops = MeasureLookups(clock, num_threads, kNumKeys, kLookupsPerThread);
+    delete clock;
+
+    PRINT_INFO("%d threads, LRUCache: %.0f lookups/s, ClockCache: %.0f lookups/s (%.2fx)\n",
+               num_threads, lru_ops, clock_ops, clock_ops / lru_ops);
+}
+
+int main(int argc, char **argv) {
+    PRINT_INFO("Running main() from %s\n", __FILE__);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
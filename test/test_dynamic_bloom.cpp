@@ -0,0 +1,56 @@
+#include "dynamic_bloom.h"
+#include "arena.h"
+#include "coding.h"
+#include "log.h"
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+
+using namespace ns_filter_policy;
+using namespace ns_memory;
+using namespace ns_data_structure;
+
+namespace {
+
+std::string Key(uint32_t i) {
+    std::string key;
+    ns_util::PutFixed32(&key, i);
+    return key;
+}
+
+} // anonymous namespace
+
+TEST(DynamicBloomTest, Empty) {
+    Arena arena;
+    DynamicBloom bloom(&arena, 100, 6);
+    ASSERT_FALSE(bloom.MayContain("hello"));
+    ASSERT_FALSE(bloom.MayContain(""));
+}
+
+TEST(DynamicBloomTest, VaryingLengths) {
+    // Filters of about 10 bits per key, from less than a block to many.
+    for (uint32_t n : {1U, 10U, 100U, 1000U, 10000U}) {
+        Arena arena;
+        DynamicBloom bloom(&arena, n * 10, 6);
+        for (uint32_t i = 0; i < n; i++) {
+            bloom.Add(Key(i));
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            ASSERT_TRUE(bloom.MayContain(Key(i))) << "n " << n << " key " << i;
+        }
+        uint32_t false_positives = 0;
+        for (uint32_t i = 0; i < 10000; i++) {
+            false_positives += bloom.MayContain(Key(i + 1000000000));
+        }
+        double const rate = false_positives / 10000.0;
+        PRINT_INFO("%u keys: false positive rate %.2f%%\n", n, rate * 100.0);
+        ASSERT_LE(rate, 0.03) << "n " << n;
+    }
+}
+
+int main(int argc, char **argv) {
+    PRINT_INFO("Running main() from %s\n", __FILE__);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
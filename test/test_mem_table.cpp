@@ -0,0 +1,813 @@
+#include "log.h"
+#include "db_format.h"
+#include "mem_table.h"
+#include "options.h"
+#include "iterator.h"
+#include "random.h"
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ns_db_format;
+using namespace ns_data_structure;
+using namespace ns_comparator;
+using namespace ns_iterator;
+using namespace ns_algorithm;
+using namespace ns_util;
+
+namespace {
+
+// Orders user keys backwards, so that inline prefixes must not be used.
+class ReverseComparator : public Comparator {
+public:
+    int32_t Compare(Slice const &a, Slice const &b) const override {
+        return BytewiseComparator()->Compare(b, a);
+    }
+    uint8_t const *Name() const override {
+        return reinterpret_cast<uint8_t const *>("test.ReverseComparator");
+    }
+    void FindShortestSeparator(std::string *start, Slice const &limit) const override {
+    }
+    void FindShortSuccessor(std::string *key) const override {
+    }
+};
+
+// Keys whose order hinges on bytes past the prefix, zero bytes inside the
+// prefix and sizes around 8.
+std::vector<std::string> const kTrickyKeys = {
+    std::string(), "a", std::string("a\0", 2), std::string("a\0\0", 3), "abcdefg", "abcdefgh",
+    std::string("abcdefgh\0", 9), "abcdefghi", "abcdefghj", "abcdefgi", std::string(8, '\xff'),
+    std::string(9, '\xff'), "b",
+};
+
+// Iterates mem and checks that its entries are in cmp order.
+void CheckOrder(MemTable *mem, InternalKeyComparator const &cmp, uint64_t expected_count) {
+    Iterator *iter = mem->NewIterator();
+    std::string last;
+    uint64_t count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        if (count > 0) {
+            ASSERT_LT(cmp.Compare(last, iter->key()), 0);
+        }
+        last = iter->key().ToString();
+        count++;
+    }
+    ASSERT_EQ(expected_count, count);
+    delete iter;
+}
+
+void FillTricky(MemTable *mem) {
+    SequenceNumber seq = 1;
+    for (int32_t round = 0; round < 2; round++) {
+        for (std::string const &key : kTrickyKeys) {
+            mem->Add(seq, kTypeValue, key, std::to_string(seq));
+            seq++;
+        }
+    }
+}
+
+} // anonymous namespace
+
+TEST(MemTableTest, InlinePrefixOrder) {
+    InternalKeyComparator cmp(BytewiseComparator());
+    MemTable *mem = new MemTable(cmp);
+    mem->Ref();
+    FillTricky(mem);
+    CheckOrder(mem, cmp, 2 * kTrickyKeys.size());
+    for (uint64_t i = 0; i < kTrickyKeys.size(); i++) {
+        std::string value;
+        Status s;
+        LookupKey lkey(kTrickyKeys[i], kMaxSequenceNumber);
+        ASSERT_TRUE(mem->Get(lkey, &value, &s));
+        ASSERT_EQ(std::to_string(kTrickyKeys.size() + i + 1), value);
+    }
+    mem->Unref();
+}
+
+TEST(MemTableTest, NonBytewiseComparator) {
+    ReverseComparator reverse;
+    InternalKeyComparator cmp(&reverse);
+    MemTable *mem = new MemTable(cmp);
+    mem->Ref();
+    FillTricky(mem);
+    CheckOrder(mem, cmp, 2 * kTrickyKeys.size());
+    Iterator *iter = mem->NewIterator();
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(std::string(9, '\xff'), ExtractUserKey(iter->key()).ToString());
+    delete iter;
+    mem->Unref();
+}
+
+TEST(MemTableTest, MultiGet) {
+    InternalKeyComparator cmp(BytewiseComparator());
+    MemTable *mem = new MemTable(cmp);
+    mem->Ref();
+    SequenceNumber seq = 1;
+    for (int32_t i = 0; i < 1000; i += 2) {
+        mem->Add(seq++, kTypeValue, std::to_string(i), std::to_string(i));
+    }
+    for (int32_t i = 0; i < 1000; i += 10) {
+        mem->Add(seq++, kTypeDeletion, std::to_string(i), Slice());
+    }
+
+    // Present, deleted and missing keys.
+    std::vector<std::unique_ptr<LookupKey>> lkeys;
+    std::vector<LookupKey const *> lkey_ptrs;
+    for (int32_t i = 0; i < 100; i++) {
+        lkeys.emplace_back(new LookupKey(std::to_string(i * 7), kMaxSequenceNumber));
+        lkey_ptrs.push_back(lkeys.back().get());
+    }
+    std::vector<std::string> values(lkeys.size());
+    std::vector<Status> statuses(lkeys.size());
+    std::unique_ptr<bool[]> found(new bool[lkeys.size()]);
+    mem->MultiGet(lkey_ptrs.data(), lkeys.size(), values.data(), statuses.data(), found.get());
+    for (uint64_t i = 0; i < lkeys.size(); i++) {
+        std::string value;
+        Status s;
+        ASSERT_EQ(mem->Get(*lkeys[i], &value, &s), found[i]);
+        ASSERT_EQ(value, values[i]);
+        ASSERT_EQ(s.IsNotFound(), statuses[i].IsNotFound());
+    }
+    mem->Unref();
+}
+
+TEST(MemTableTest, VectorRep) {
+    static constexpr int32_t kNumKeys = 1000;
+    std::unique_ptr<MemTableRepFactory> factory(NewVectorRepFactory());
+    ns_options::Options options;
+    options.memtable_rep_factory = factory.get();
+    InternalKeyComparator cmp(BytewiseComparator());
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    FillTricky(mem);
+    Random rnd(301);
+    for (int32_t i = 0; i < kNumKeys; i++) {
+        mem->Add(1000 + i, kTypeValue, std::to_string(rnd.Next()), std::to_string(i));
+    }
+    uint64_t const count = 2 * kTrickyKeys.size() + kNumKeys;
+    // Reads while mutable see the unsorted vector ...
+    CheckOrder(mem, cmp, count);
+    std::string value;
+    Status s;
+    ASSERT_TRUE(mem->Get(LookupKey("abcdefgh", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ(std::to_string(kTrickyKeys.size() + 6), value);
+    ASSERT_FALSE(mem->Get(LookupKey("abcdefgh0", kMaxSequenceNumber), &value, &s));
+    // ... and after it was sorted.
+    mem->MarkImmutable();
+    CheckOrder(mem, cmp, count);
+    ASSERT_TRUE(mem->Get(LookupKey("abcdefgh", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ(std::to_string(kTrickyKeys.size() + 6), value);
+    ASSERT_FALSE(mem->Get(LookupKey("abcdefgh0", kMaxSequenceNumber), &value, &s));
+    Iterator *iter = mem->NewIterator();
+    iter->SeekToLast();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(std::string(9, '\xff'), ExtractUserKey(iter->key()).ToString());
+    // Older version of the same key.
+    iter->Prev();
+    ASSERT_EQ(std::string(9, '\xff'), ExtractUserKey(iter->key()).ToString());
+    iter->Prev();
+    ASSERT_EQ(std::string(8, '\xff'), ExtractUserKey(iter->key()).ToString());
+    iter->Seek(LookupKey("abcdefgh", kMaxSequenceNumber).internal_key());
+    ASSERT_EQ("abcdefgh", ExtractUserKey(iter->key()).ToString());
+    delete iter;
+    mem->Unref();
+}
+
+TEST(MemTableTest, ArtRep) {
+    static constexpr int32_t kNumKeys = 1000;
+    std::unique_ptr<MemTableRepFactory> factory(NewArtRepFactory());
+    ns_options::Options options;
+    options.memtable_rep_factory = factory.get();
+    InternalKeyComparator cmp(BytewiseComparator());
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    // Tricky keys hold the zero bytes the tree key escapes.
+    FillTricky(mem);
+    Random rnd(301);
+    for (int32_t i = 0; i < kNumKeys; i++) {
+        mem->Add(1000 + i, kTypeValue, std::to_string(rnd.Next()), std::to_string(i));
+    }
+    CheckOrder(mem, cmp, 2 * kTrickyKeys.size() + kNumKeys);
+    std::string value;
+    Status s;
+    for (uint64_t i = 0; i < kTrickyKeys.size(); i++) {
+        ASSERT_TRUE(mem->Get(LookupKey(kTrickyKeys[i], kMaxSequenceNumber), &value, &s));
+        ASSERT_EQ(std::to_string(kTrickyKeys.size() + i + 1), value);
+        // An older snapshot sees the older version.
+        ASSERT_TRUE(mem->Get(LookupKey(kTrickyKeys[i], kTrickyKeys.size()), &value, &s));
+        ASSERT_EQ(std::to_string(i + 1), value);
+    }
+    ASSERT_FALSE(mem->Get(LookupKey("abcdefgh0", kMaxSequenceNumber), &value, &s));
+    ASSERT_FALSE(mem->Get(LookupKey("a", 0), &value, &s));
+    Iterator *iter = mem->NewIterator();
+    iter->SeekToLast();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(std::string(9, '\xff'), ExtractUserKey(iter->key()).ToString());
+    iter->Prev();
+    iter->Prev();
+    ASSERT_EQ(std::string(8, '\xff'), ExtractUserKey(iter->key()).ToString());
+    iter->Seek(LookupKey(std::string("a\0", 2), kMaxSequenceNumber).internal_key());
+    ASSERT_EQ(std::string("a\0", 2), ExtractUserKey(iter->key()).ToString());
+    iter->Prev();
+    iter->Prev();
+    ASSERT_EQ("a", ExtractUserKey(iter->key()).ToString());
+    delete iter;
+    mem->Unref();
+
+    // Other comparators get a skiplist.
+    ReverseComparator reverse;
+    InternalKeyComparator reverse_cmp(&reverse);
+    mem = new MemTable(reverse_cmp, options);
+    mem->Ref();
+    FillTricky(mem);
+    CheckOrder(mem, reverse_cmp, 2 * kTrickyKeys.size());
+    mem->Unref();
+}
+
+// A key of tenant t: the 4-byte tenant id, then the id of the row.
+static std::string TenantKey(uint32_t tenant, uint32_t row) {
+    char key[32];
+    std::snprintf(key, sizeof(key), "%04x%08x", tenant, row);
+    return std::string(key, 12);
+}
+
+TEST(MemTableTest, HashSkipListRep) {
+    static constexpr uint32_t kNumTenants = 50;
+    static constexpr uint32_t kRowsPerTenant = 40;
+    // Fewer buckets than tenants, so that tenants share buckets.
+    std::unique_ptr<MemTableRepFactory> factory(NewHashSkipListRepFactory(4, 16));
+    ns_options::Options options;
+    options.memtable_rep_factory = factory.get();
+    InternalKeyComparator cmp(BytewiseComparator());
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    // Tricky keys are shorter than or as long as the prefix, too.
+    FillTricky(mem);
+    SequenceNumber seq = 1000;
+    for (uint32_t row = 0; row < kRowsPerTenant; row++) {
+        for (uint32_t tenant = 0; tenant < kNumTenants; tenant++) {
+            mem->Add(seq++, kTypeValue, TenantKey(tenant, row), TenantKey(tenant, row));
+        }
+    }
+    CheckOrder(mem, cmp, 2 * kTrickyKeys.size() + kNumTenants * kRowsPerTenant);
+
+    std::string value;
+    Status s;
+    for (uint64_t i = 0; i < kTrickyKeys.size(); i++) {
+        ASSERT_TRUE(mem->Get(LookupKey(kTrickyKeys[i], kMaxSequenceNumber), &value, &s));
+        ASSERT_EQ(std::to_string(kTrickyKeys.size() + i + 1), value);
+    }
+    ASSERT_TRUE(mem->Get(LookupKey(TenantKey(7, 3), kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ(TenantKey(7, 3), value);
+    ASSERT_FALSE(mem->Get(LookupKey(TenantKey(7, kRowsPerTenant), kMaxSequenceNumber), &value, &s));
+    ASSERT_FALSE(mem->Get(LookupKey(TenantKey(kNumTenants, 0), kMaxSequenceNumber), &value, &s));
+
+    // Every row of a tenant, in order, from the middle and from the start.
+    Iterator *iter = mem->NewPrefixIterator();
+    for (uint32_t tenant = 0; tenant < kNumTenants; tenant++) {
+        uint32_t row = 5;
+        iter->Seek(LookupKey(TenantKey(tenant, row), kMaxSequenceNumber).internal_key());
+        for (; iter->Valid() && ExtractUserKey(iter->key()).starts_with(TenantKey(tenant, 0).substr(0, 4)); iter->Next()) {
+            ASSERT_EQ(TenantKey(tenant, row), ExtractUserKey(iter->key()).ToString());
+            row++;
+        }
+        ASSERT_EQ(kRowsPerTenant, row);
+    }
+    iter->Seek(LookupKey(TenantKey(kNumTenants, 0), kMaxSequenceNumber).internal_key());
+    ASSERT_TRUE(!iter->Valid() || !ExtractUserKey(iter->key()).starts_with(TenantKey(kNumTenants, 0).substr(0, 4)));
+    // Without a target it iterates in full order.
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("", ExtractUserKey(iter->key()).ToString());
+    delete iter;
+    mem->Unref();
+}
+
+TEST(MemTableTest, BloomFilter) {
+    ns_options::Options options;
+    options.write_buffer_size = 64 * 1024;
+    options.memtable_bloom_size_ratio = 0.1;
+    InternalKeyComparator cmp(BytewiseComparator());
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    FillTricky(mem);
+    mem->Add(1000, kTypeDeletion, "deleted", "");
+    std::string value;
+    Status s;
+    for (uint64_t i = 0; i < kTrickyKeys.size(); i++) {
+        ASSERT_TRUE(mem->Get(LookupKey(kTrickyKeys[i], kMaxSequenceNumber), &value, &s));
+        ASSERT_EQ(std::to_string(kTrickyKeys.size() + i + 1), value);
+    }
+    // Deletions pass the filter.
+    ASSERT_TRUE(mem->Get(LookupKey("deleted", kMaxSequenceNumber), &value, &s));
+    ASSERT_TRUE(s.IsNotFound());
+    ASSERT_FALSE(mem->Get(LookupKey("abcdefgh0", kMaxSequenceNumber), &value, &s));
+
+    LookupKey const hit("abcdefgh", kMaxSequenceNumber);
+    LookupKey const miss("missing", kMaxSequenceNumber);
+    LookupKey const *keys[] = {&miss, &hit, &miss};
+    std::string values[3];
+    Status statuses[3];
+    bool found[3];
+    mem->MultiGet(keys, 3, values, statuses, found);
+    ASSERT_FALSE(found[0]);
+    ASSERT_TRUE(found[1]);
+    ASSERT_EQ(std::to_string(kTrickyKeys.size() + 6), values[1]);
+    ASSERT_FALSE(found[2]);
+    mem->Unref();
+}
+
+TEST(MemTableTest, PrefixBloomFilter) {
+    static constexpr uint32_t kNumTenants = 50;
+    static constexpr uint32_t kRowsPerTenant = 20;
+    ns_options::Options options;
+    options.memtable_bloom_size_ratio = 0.1;
+    options.memtable_bloom_prefix_length = 4;
+    InternalKeyComparator cmp(BytewiseComparator());
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    // Only even tenants have rows.
+    SequenceNumber seq = 1;
+    for (uint32_t tenant = 0; tenant < kNumTenants; tenant += 2) {
+        for (uint32_t row = 0; row < kRowsPerTenant; row++) {
+            mem->Add(seq++, kTypeValue, TenantKey(tenant, row), TenantKey(tenant, row));
+        }
+    }
+    mem->Add(seq++, kTypeValue, "ab", "short");
+    std::string value;
+    Status s;
+    ASSERT_TRUE(mem->Get(LookupKey(TenantKey(4, 7), kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ(TenantKey(4, 7), value);
+    ASSERT_FALSE(mem->Get(LookupKey(TenantKey(4, kRowsPerTenant), kMaxSequenceNumber), &value, &s));
+    // Keys shorter than the prefix are filtered as a whole.
+    ASSERT_TRUE(mem->Get(LookupKey("ab", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("short", value);
+
+    Iterator *iter = mem->NewPrefixIterator();
+    uint32_t filtered_out = 0;
+    for (uint32_t tenant = 0; tenant < kNumTenants; tenant++) {
+        iter->Seek(LookupKey(TenantKey(tenant, 0), kMaxSequenceNumber).internal_key());
+        if (tenant % 2 == 0) {
+            ASSERT_TRUE(iter->Valid());
+            ASSERT_EQ(TenantKey(tenant, 0), ExtractUserKey(iter->key()).ToString());
+        } else {
+            filtered_out += !iter->Valid();
+            // Past the prefix, the iterator may only ever land on other ones.
+            ASSERT_TRUE(!iter->Valid() || !ExtractUserKey(iter->key()).starts_with(TenantKey(tenant, 0).substr(0, 4)));
+        }
+    }
+    // Most empty tenants are skipped without a search.
+    ASSERT_GE(filtered_out, kNumTenants / 2 - 2);
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(TenantKey(0, 0), ExtractUserKey(iter->key()).ToString());
+    delete iter;
+    mem->Unref();
+}
+
+TEST(MemTableTest, RangeDeletion) {
+    InternalKeyComparator cmp(BytewiseComparator());
+    ns_options::Options options;
+    // Covered keys never written must be found deleted past the filter.
+    options.memtable_bloom_size_ratio = 0.1;
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    SequenceNumber seq = 1;
+    for (char c = 'a'; c <= 'z'; c++) {
+        mem->Add(seq++, kTypeValue, std::string(1, c), std::string(1, c));
+    }
+    // Overlapping tombstones, the older one added last: [c, k)@100,
+    // [k, m)@100,50 and [m, p)@50.
+    mem->Add(100, kTypeRangeDeletion, "c", "m");
+    mem->Add(101, kTypeValue, "e", "e2");
+    mem->Add(50, kTypeRangeDeletion, "k", "p");
+    // Empty ranges delete nothing.
+    mem->Add(102, kTypeRangeDeletion, "y", "x");
+
+    std::string value;
+    Status s;
+    ASSERT_TRUE(mem->Get(LookupKey("a", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("a", value);
+    s = Status::OK();
+    ASSERT_TRUE(mem->Get(LookupKey("d", kMaxSequenceNumber), &value, &s));
+    ASSERT_TRUE(s.IsNotFound());
+    // Snapshots before a tombstone still see what it deleted.
+    ASSERT_TRUE(mem->Get(LookupKey("d", 99), &value, &s));
+    ASSERT_EQ("d", value);
+    ASSERT_TRUE(mem->Get(LookupKey("e", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("e2", value);
+    s = Status::OK();
+    ASSERT_TRUE(mem->Get(LookupKey("n", kMaxSequenceNumber), &value, &s));
+    ASSERT_TRUE(s.IsNotFound());
+    ASSERT_TRUE(mem->Get(LookupKey("n", 49), &value, &s));
+    ASSERT_EQ("n", value);
+    ASSERT_TRUE(mem->Get(LookupKey("p", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("p", value);
+    s = Status::OK();
+    ASSERT_TRUE(mem->Get(LookupKey("cc", kMaxSequenceNumber), &value, &s));
+    ASSERT_TRUE(s.IsNotFound());
+    ASSERT_FALSE(mem->Get(LookupKey("cc", 99), &value, &s));
+    ASSERT_FALSE(mem->Get(LookupKey("zz", kMaxSequenceNumber), &value, &s));
+
+    LookupKey const d("d", kMaxSequenceNumber);
+    LookupKey const e("e", kMaxSequenceNumber);
+    LookupKey const zz("zz", kMaxSequenceNumber);
+    LookupKey const *keys[] = {&d, &e, &zz};
+    std::string values[3];
+    Status statuses[3];
+    bool found[3];
+    mem->MultiGet(keys, 3, values, statuses, found);
+    ASSERT_TRUE(found[0]);
+    ASSERT_TRUE(statuses[0].IsNotFound());
+    ASSERT_TRUE(found[1]);
+    ASSERT_EQ("e2", values[1]);
+    ASSERT_FALSE(found[2]);
+
+    // Iterators skip deleted entries both ways.
+    auto visible = [mem](Iterator *iter, bool backward) {
+        std::string result;
+        if (backward) {
+            for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+                result.insert(0, iter->value().ToString() + " ");
+            }
+        } else {
+            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                result.append(iter->value().ToString() + " ");
+            }
+        }
+        delete iter;
+        return result;
+    };
+    std::string const latest = "a b e2 p q r s t u v w x y z ";
+    ASSERT_EQ(latest, visible(mem->NewIterator(kMaxSequenceNumber), false));
+    ASSERT_EQ(latest, visible(mem->NewIterator(kMaxSequenceNumber), true));
+    std::string const at_60 = "a b c d e2 e f g h i j p q r s t u v w x y z ";
+    ASSERT_EQ(at_60, visible(mem->NewIterator(60), false));
+    ASSERT_EQ(at_60, visible(mem->NewIterator(60), true));
+    Iterator *iter = mem->NewIterator(kMaxSequenceNumber);
+    iter->Seek(LookupKey("f", kMaxSequenceNumber).internal_key());
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("p", ExtractUserKey(iter->key()).ToString());
+    delete iter;
+    iter = mem->NewPrefixIterator(kMaxSequenceNumber);
+    iter->Seek(LookupKey("f", kMaxSequenceNumber).internal_key());
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("p", ExtractUserKey(iter->key()).ToString());
+    delete iter;
+    // Unless asked to, iterators keep every entry, for a flush to write.
+    std::string const all = "a b c d e2 e f g h i j k l m n o p q r s t u v w x y z ";
+    ASSERT_EQ(all, visible(mem->NewIterator(), false));
+    ASSERT_EQ(all, visible(mem->NewPrefixIterator(), false));
+
+    iter = mem->NewRangeTombstoneIterator();
+    std::string fragments;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ParsedInternalKey ikey;
+        ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+        ASSERT_EQ(kTypeRangeDeletion, ikey.type);
+        fragments += ikey.user_key.ToString() + "-" + iter->value().ToString() + "@" + std::to_string(ikey.sequence) + " ";
+    }
+    ASSERT_EQ("c-k@100 k-m@100 k-m@50 m-p@50 ", fragments);
+    iter->Seek(LookupKey("k", 60).internal_key());
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(InternalKey("k", 50, kTypeRangeDeletion).Encode().ToString(), iter->key().ToString());
+    iter->Prev();
+    ASSERT_EQ(InternalKey("k", 100, kTypeRangeDeletion).Encode().ToString(), iter->key().ToString());
+    iter->Seek(LookupKey("l", kMaxSequenceNumber).internal_key());
+    ASSERT_EQ(InternalKey("m", 50, kTypeRangeDeletion).Encode().ToString(), iter->key().ToString());
+    iter->SeekToLast();
+    ASSERT_EQ(InternalKey("m", 50, kTypeRangeDeletion).Encode().ToString(), iter->key().ToString());
+    iter->Next();
+    ASSERT_FALSE(iter->Valid());
+    delete iter;
+    mem->Unref();
+}
+
+TEST(MemTableTest, Merge) {
+    InternalKeyComparator cmp(BytewiseComparator());
+    std::unique_ptr<ns_merge_operator::MergeOperator const> op(ns_merge_operator::NewStringAppendOperator(','));
+    ns_options::Options options;
+    options.merge_operator = op.get();
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    mem->Add(1, kTypeValue, "a", "a1");
+    mem->Add(2, kTypeMerge, "a", "a2");
+    mem->Add(3, kTypeMerge, "a", "a3");
+    mem->Add(4, kTypeValue, "b", "b1");
+    mem->Add(5, kTypeDeletion, "b", Slice());
+    mem->Add(6, kTypeMerge, "b", "b2");
+    mem->Add(7, kTypeMerge, "c", "c1");
+    mem->Add(8, kTypeMerge, "c", "c2");
+    mem->Add(9, kTypeValue, "d", "d1");
+    mem->Add(10, kTypeRangeDeletion, "d", "e");
+    mem->Add(11, kTypeMerge, "d", "d2");
+
+    std::string value;
+    Status s;
+    ASSERT_TRUE(mem->Get(LookupKey("a", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("a1,a2,a3", value);
+    ASSERT_TRUE(mem->Get(LookupKey("a", 2), &value, &s));
+    ASSERT_EQ("a1,a2", value);
+    ASSERT_TRUE(mem->Get(LookupKey("a", 1), &value, &s));
+    ASSERT_EQ("a1", value);
+    // Deletions and range tombstones leave no value to merge into.
+    ASSERT_TRUE(mem->Get(LookupKey("b", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("b2", value);
+    ASSERT_TRUE(mem->Get(LookupKey("d", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("d2", value);
+    ASSERT_TRUE(s.ok());
+    ASSERT_TRUE(mem->Get(LookupKey("d", 10), &value, &s));
+    ASSERT_TRUE(s.IsNotFound());
+    s = Status::OK();
+    // Nothing older in the memtable.
+    ASSERT_TRUE(mem->Get(LookupKey("c", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("c1,c2", value);
+
+    // Older data may follow: operands pile up, newest first.
+    std::vector<std::string> merge_operands = {"c4", "c3"};
+    ASSERT_FALSE(mem->Get(LookupKey("c", kMaxSequenceNumber), &value, &s, &merge_operands));
+    ASSERT_EQ(std::vector<std::string>({"c4", "c3", "c2", "c1"}), merge_operands);
+    merge_operands = {"a4"};
+    ASSERT_TRUE(mem->Get(LookupKey("a", kMaxSequenceNumber), &value, &s, &merge_operands));
+    ASSERT_EQ("a1,a2,a3,a4", value);
+    merge_operands = {"x1"};
+    ASSERT_FALSE(mem->Get(LookupKey("x", kMaxSequenceNumber), &value, &s, &merge_operands));
+    ASSERT_EQ(std::vector<std::string>({"x1"}), merge_operands);
+
+    LookupKey const a("a", kMaxSequenceNumber);
+    LookupKey const c("c", kMaxSequenceNumber);
+    LookupKey const x("x", kMaxSequenceNumber);
+    LookupKey const *keys[] = {&a, &c, &x};
+    std::string values[3];
+    Status statuses[3];
+    bool found[3];
+    mem->MultiGet(keys, 3, values, statuses, found);
+    ASSERT_TRUE(found[0]);
+    ASSERT_EQ("a1,a2,a3", values[0]);
+    ASSERT_TRUE(found[1]);
+    ASSERT_EQ("c1,c2", values[1]);
+    ASSERT_FALSE(found[2]);
+    mem->Unref();
+
+    // Merges cannot be read without a merge operator.
+    mem = new MemTable(cmp);
+    mem->Ref();
+    mem->Add(1, kTypeMerge, "a", "a1");
+    ASSERT_TRUE(mem->Get(LookupKey("a", kMaxSequenceNumber), &value, &s));
+    ASSERT_TRUE(s.IsInvalidArgument());
+    mem->Unref();
+}
+
+// The number of entries an iterator over mem visits.
+static uint64_t CountEntries(MemTable *mem) {
+    Iterator *iter = mem->NewIterator();
+    uint64_t count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+    }
+    delete iter;
+    return count;
+}
+
+TEST(MemTableTest, InplaceUpdate) {
+    InternalKeyComparator cmp(BytewiseComparator());
+    ns_options::Options options;
+    options.memtable_inplace_update_support = true;
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    std::string value;
+    Status s;
+    mem->Add(1, kTypeValue, "k", "12345");
+    // No larger values overwrite the entry.
+    mem->Add(2, kTypeValue, "k", "abcde");
+    mem->Add(3, kTypeValue, "k", "abc");
+    ASSERT_EQ(1U, CountEntries(mem));
+    ASSERT_TRUE(mem->Get(LookupKey("k", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("abc", value);
+    // Larger ones do not; the room of the entry is its current value.
+    mem->Add(4, kTypeValue, "k", "abcdef");
+    ASSERT_EQ(2U, CountEntries(mem));
+    ASSERT_TRUE(mem->Get(LookupKey("k", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("abcdef", value);
+
+    // Snapshots keep the values they see.
+    mem->SetNewestSnapshot(4);
+    mem->Add(5, kTypeValue, "k", "x");
+    ASSERT_EQ(3U, CountEntries(mem));
+    ASSERT_TRUE(mem->Get(LookupKey("k", 4), &value, &s));
+    ASSERT_EQ("abcdef", value);
+    mem->Add(6, kTypeValue, "k", "y");
+    ASSERT_EQ(3U, CountEntries(mem));
+    ASSERT_TRUE(mem->Get(LookupKey("k", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("y", value);
+
+    // Deleted values are not overwritten.
+    mem->Add(7, kTypeDeletion, "k", Slice());
+    mem->Add(8, kTypeValue, "k", "z");
+    ASSERT_TRUE(mem->Get(LookupKey("k", 7), &value, &s));
+    ASSERT_TRUE(s.IsNotFound());
+    s = Status::OK();
+    mem->Add(9, kTypeRangeDeletion, "a", "m");
+    mem->Add(10, kTypeValue, "k", "w");
+    ASSERT_TRUE(mem->Get(LookupKey("k", kMaxSequenceNumber), &value, &s));
+    ASSERT_EQ("w", value);
+    ASSERT_TRUE(mem->Get(LookupKey("k", 9), &value, &s));
+    ASSERT_TRUE(s.IsNotFound());
+    mem->Unref();
+}
+
+TEST(MemTableTest, ConcurrentInplaceUpdate) {
+    InternalKeyComparator cmp(BytewiseComparator());
+    ns_options::Options options;
+    options.memtable_inplace_update_support = true;
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    mem->Add(1, kTypeValue, "k", std::string(100, 'a'));
+    std::atomic<bool> done(false);
+    // Readers never see half of an update: values are one repeated byte.
+    std::thread reader([mem, &done]() {
+        std::string value;
+        Status s;
+        while (!done.load()) {
+            ASSERT_TRUE(mem->Get(LookupKey("k", kMaxSequenceNumber), &value, &s));
+            ASSERT_FALSE(value.empty());
+            ASSERT_EQ(std::string(value.size(), value[0]), value);
+        }
+    });
+    for (SequenceNumber seq = 2; seq < 100000; seq++) {
+        mem->Add(seq, kTypeValue, "k", std::string(100, static_cast<char>('a' + seq % 26)));
+    }
+    done.store(true);
+    reader.join();
+    ASSERT_EQ(1U, CountEntries(mem));
+    mem->Unref();
+}
+
+// Benchmarks are opt-in: run with --gtest_also_run_disabled_tests.
+// Time of adding kNumEntries random entries to a memtable configured by
+// options and marking it immutable, in nanoseconds per entry.
+static double MeasureBulkLoad(ns_options::Options const &options) {
+    static constexpr int32_t kNumEntries = 1000000;
+    InternalKeyComparator cmp(BytewiseComparator());
+    MemTable *mem = new MemTable(cmp, options);
+    mem->Ref();
+    Random rnd(301);
+    char key[32];
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < kNumEntries; i++) {
+        std::snprintf(key, sizeof(key), "%08x%08x", rnd.Next(), i);
+        mem->Add(i + 1, kTypeValue, Slice(key, 16), Slice(key, 8));
+    }
+    mem->MarkImmutable();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    mem->Unref();
+    return elapsed.count() / kNumEntries;
+}
+
+TEST(MemTableBenchmark, DISABLED_BulkLoad) {
+    ns_options::Options options;
+    double const skip_list_ns = MeasureBulkLoad(options);
+    std::unique_ptr<MemTableRepFactory> factory(NewVectorRepFactory());
+    options.memtable_rep_factory = factory.get();
+    double const vector_ns = MeasureBulkLoad(options);
+    PRINT_INFO("Bulk load: skiplist %.1f ns/op, vector %.1f ns/op\n", skip_list_ns, vector_ns);
+}
+
+TEST(MemTableBenchmark, DISABLED_ArtRep) {
+    static constexpr int32_t kNumEntries = 1000000;
+    static constexpr int32_t kNumReads = 1000000;
+    std::unique_ptr<MemTableRepFactory> factory(NewArtRepFactory());
+    InternalKeyComparator cmp(BytewiseComparator());
+    for (uint64_t key_size : {16, 64}) {
+        for (bool use_art : {false, true}) {
+            ns_options::Options options;
+            options.memtable_rep_factory = use_art ? factory.get() : nullptr;
+            MemTable *mem = new MemTable(cmp, options);
+            mem->Ref();
+            // Random 16-hex-digit heads, padded with a shared tail (snprintf()
+            // overwrites its first byte with the terminator).
+            Random rnd(301);
+            std::string key(key_size, 'k');
+            auto start = std::chrono::steady_clock::now();
+            for (int32_t i = 0; i < kNumEntries; i++) {
+                std::snprintf(&key[0], 17, "%08x%08x", rnd.Next(), i);
+                if (key_size > 16) {
+                    key[16] = 'k';
+                }
+                mem->Add(i + 1, kTypeValue, key, Slice(key.data(), 8));
+            }
+            std::chrono::duration<double, std::nano> add_elapsed = std::chrono::steady_clock::now() - start;
+
+            std::vector<std::unique_ptr<LookupKey>> lkeys;
+            Random read_rnd(301);
+            for (int32_t i = 0; i < kNumReads; i++) {
+                std::snprintf(&key[0], 17, "%08x%08x", read_rnd.Next(), i);
+                if (key_size > 16) {
+                    key[16] = 'k';
+                }
+                lkeys.emplace_back(new LookupKey(key, kMaxSequenceNumber));
+            }
+            std::string value;
+            Status s;
+            uint64_t found = 0;
+            start = std::chrono::steady_clock::now();
+            for (std::unique_ptr<LookupKey> const &lkey : lkeys) {
+                found += mem->Get(*lkey, &value, &s);
+            }
+            std::chrono::duration<double, std::nano> get_elapsed = std::chrono::steady_clock::now() - start;
+            ASSERT_EQ(static_cast<uint64_t>(kNumReads), found);
+
+            Iterator *iter = mem->NewIterator();
+            uint64_t scanned = 0;
+            start = std::chrono::steady_clock::now();
+            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                scanned++;
+            }
+            std::chrono::duration<double, std::nano> scan_elapsed = std::chrono::steady_clock::now() - start;
+            ASSERT_EQ(static_cast<uint64_t>(kNumEntries), scanned);
+            PRINT_INFO("%llu-byte keys, %s rep: Add %.1f ns/op, Get %.1f ns/op, Next %.1f ns/op, memory %llu bytes\n",
+                       static_cast<unsigned long long>(key_size), use_art ? "art" : "skiplist",
+                       add_elapsed.count() / kNumEntries, get_elapsed.count() / kNumReads,
+                       scan_elapsed.count() / kNumEntries, static_cast<unsigned long long>(mem->ApproximateMemoryUsage()));
+            delete iter;
+            mem->Unref();
+        }
+    }
+}
+
+TEST(MemTableBenchmark, DISABLED_RandomSeek) {
+    static constexpr int32_t kNumEntries = 10000000;
+    static constexpr int32_t kNumSeeks = 1000000;
+    InternalKeyComparator cmp(BytewiseComparator());
+    MemTable *mem = new MemTable(cmp);
+    mem->Ref();
+    Random rnd(301);
+    char key[32];
+    for (int32_t i = 0; i < kNumEntries; i++) {
+        std::snprintf(key, sizeof(key), "%08x%08x", rnd.Next(), i);
+        mem->Add(i + 1, kTypeValue, Slice(key, 16), Slice(key, 8));
+    }
+    Iterator *iter = mem->NewIterator();
+    uint64_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < kNumSeeks; i++) {
+        std::snprintf(key, sizeof(key), "%08x", rnd.Next());
+        LookupKey lkey(Slice(key, 8), kMaxSequenceNumber);
+        iter->Seek(lkey.internal_key());
+        found += iter->Valid();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_GT(found, 0U);
+    PRINT_INFO("Seek on %d entries: %.1f ns/op, memory %llu bytes\n", kNumEntries, elapsed.count() / kNumSeeks,
+               static_cast<unsigned long long>(mem->ApproximateMemoryUsage()));
+
+    // Point lookups, one by one and in groups.
+    static constexpr uint64_t kGroupSize = 16;
+    std::vector<std::unique_ptr<LookupKey>> lkeys;
+    for (int32_t i = 0; i < kNumSeeks; i++) {
+        std::snprintf(key, sizeof(key), "%08x%08x", rnd.Next(), rnd.Uniform(kNumEntries));
+        lkeys.emplace_back(new LookupKey(Slice(key, 16), kMaxSequenceNumber));
+    }
+    std::string value;
+    Status s;
+    uint64_t get_found = 0;
+    start = std::chrono::steady_clock::now();
+    for (std::unique_ptr<LookupKey> const &lkey : lkeys) {
+        get_found += mem->Get(*lkey, &value, &s);
+    }
+    std::chrono::duration<double, std::nano> get_elapsed = std::chrono::steady_clock::now() - start;
+
+    LookupKey const *group[kGroupSize];
+    std::string values[kGroupSize];
+    Status statuses[kGroupSize];
+    bool found_in_group[kGroupSize];
+    uint64_t multi_get_found = 0;
+    start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < kNumSeeks; i += kGroupSize) {
+        for (uint64_t j = 0; j < kGroupSize; j++) {
+            group[j] = lkeys[i + j].get();
+        }
+        mem->MultiGet(group, kGroupSize, values, statuses, found_in_group);
+        for (uint64_t j = 0; j < kGroupSize; j++) {
+            multi_get_found += found_in_group[j];
+        }
+    }
+    std::chrono::duration<double, std::nano> multi_get_elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(get_found, multi_get_found);
+    PRINT_INFO("Get %.1f ns/op, MultiGet (groups of %llu) %.1f ns/op\n", get_elapsed.count() / kNumSeeks,
+               static_cast<unsigned long long>(kGroupSize), multi_get_elapsed.count() / kNumSeeks);
+    delete iter;
+    mem->Unref();
+}
+
+int main(int argc, char **argv) {
+    PRINT_INFO("Running main() from %s\n", __FILE__);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
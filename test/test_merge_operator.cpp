@@ -0,0 +1,67 @@
+#include "merge_operator.h"
+#include "coding.h"
+#include "log.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace ns_merge_operator;
+using namespace ns_data_structure;
+using namespace ns_util;
+
+namespace {
+
+std::string Fixed64(uint64_t value) {
+    std::string result;
+    PutFixed64(&result, value);
+    return result;
+}
+
+} // anonymous namespace
+
+TEST(MergeOperatorTest, UInt64Add) {
+    std::unique_ptr<MergeOperator const> op(NewUInt64AddOperator());
+    std::string const one = Fixed64(1);
+    std::string const two = Fixed64(2);
+    std::string const base = Fixed64(40);
+    std::vector<Slice> const operands = {one, two};
+    std::string value;
+    ASSERT_TRUE(op->FullMerge("k", nullptr, operands, &value));
+    ASSERT_EQ(Fixed64(3), value);
+    Slice const existing(base);
+    ASSERT_TRUE(op->FullMerge("k", &existing, operands, &value));
+    ASSERT_EQ(Fixed64(43), value);
+    // Sums wrap.
+    std::string const max = Fixed64(~uint64_t{0});
+    Slice const existing_max(max);
+    ASSERT_TRUE(op->FullMerge("k", &existing_max, operands, &value));
+    ASSERT_EQ(Fixed64(2), value);
+    // Values and operands must be 8 bytes.
+    Slice const short_value("1234567");
+    ASSERT_FALSE(op->FullMerge("k", &short_value, operands, &value));
+    ASSERT_FALSE(op->FullMerge("k", nullptr, {one, Slice("123456789")}, &value));
+}
+
+TEST(MergeOperatorTest, StringAppend) {
+    std::unique_ptr<MergeOperator const> op(NewStringAppendOperator(','));
+    std::string value;
+    ASSERT_TRUE(op->FullMerge("k", nullptr, {Slice("a")}, &value));
+    ASSERT_EQ("a", value);
+    ASSERT_TRUE(op->FullMerge("k", nullptr, {Slice("a"), Slice("b")}, &value));
+    ASSERT_EQ("a,b", value);
+    Slice const existing("x");
+    ASSERT_TRUE(op->FullMerge("k", &existing, {Slice("a"), Slice("b")}, &value));
+    ASSERT_EQ("x,a,b", value);
+    // An empty value is an empty list, not an empty first element.
+    Slice const empty;
+    ASSERT_TRUE(op->FullMerge("k", &empty, {Slice("a")}, &value));
+    ASSERT_EQ("a", value);
+}
+
+int main(int argc, char **argv) {
+    PRINT_INFO("Running main() from %s\n", __FILE__);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,191 @@
+#include "log.h"
+#include "coding.h"
+#include "cache.h"
+#include "secondary_cache.h"
+#include "compression.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+using namespace ns_data_structure;
+using namespace ns_util;
+using namespace ns_cache;
+using namespace ns_compression;
+
+static std::string EncodeKey(int32_t k) {
+    std::string result;
+    PutFixed32(&result, k);
+    return result;
+}
+
+// A compressible block-like value for key k.
+static std::string MakeValue(int32_t k) {
+    std::string result;
+    for (int32_t i = 0; i < 100; i++) {
+        result.append("block-");
+        result.append(std::to_string(k));
+    }
+    return result;
+}
+
+static uint64_t StringSize(void *value) {
+    return reinterpret_cast<std::string *>(value)->size();
+}
+
+static void StringSaveTo(void *value, uint8_t *out) {
+    std::string const *s = reinterpret_cast<std::string *>(value);
+    std::memcpy(out, s->data(), s->size());
+}
+
+static bool StringCreate(Slice const &data, void **value, uint64_t *charge) {
+    std::string *s = new std::string(data.ToString());
+    *value = s;
+    *charge = s->size();
+    return true;
+}
+
+static void StringDeleter(Slice const &key, void *value, void *arg) {
+    delete reinterpret_cast<std::string *>(value);
+}
+
+static CacheItemHelper const kStringHelper = {StringSize, StringSaveTo, StringCreate, StringDeleter};
+
+class SecondaryCacheTest : public testing::Test {
+public:
+    static constexpr int32_t kNumKeys = 200;
+
+    void Open(CompressionType type) {
+        secondary_.reset(NewCompressedSecondaryCache(1 << 20, type));
+        LRUCacheOptions options;
+        // Room for only a fraction of the entries.
+        options.capacity = kNumKeys * MakeValue(0).size() / 4;
+        options.secondary_cache = secondary_.get();
+        primary_.reset(NewLRUCache(options));
+    }
+
+    void Insert(int32_t k) {
+        std::string *value = new std::string(MakeValue(k));
+        primary_->Release(primary_->Insert(EncodeKey(k), value, value->size(), &kStringHelper, Cache::Priority::kLow));
+    }
+
+    std::string Lookup(int32_t k) {
+        Cache::Handle *handle = primary_->Lookup(EncodeKey(k), &kStringHelper);
+        if (handle == nullptr) {
+            return "NOT_FOUND";
+        }
+        std::string const result = *reinterpret_cast<std::string *>(primary_->Value(handle));
+        primary_->Release(handle);
+        return result;
+    }
+
+    // Declared first so that it outlives primary_.
+    std::unique_ptr<SecondaryCache> secondary_;
+    std::unique_ptr<Cache> primary_;
+};
+
+TEST(CompressionTest, RoundTrip) {
+    std::string const input = MakeValue(42);
+    for (CompressionType type : {kNoCompression, kSnappyCompression, kZstdCompression}) {
+        std::string compressed, uncompressed;
+        if (!CompressionTypeSupported(type)) {
+            ASSERT_FALSE(Compress(type, input, &compressed));
+            continue;
+        }
+        ASSERT_TRUE(Compress(type, input, &compressed));
+        if (type != kNoCompression) {
+            ASSERT_LT(compressed.size(), input.size());
+        }
+        ASSERT_TRUE(Uncompress(type, compressed, &uncompressed));
+        ASSERT_EQ(input, uncompressed);
+    }
+}
+
+TEST_F(SecondaryCacheTest, EvictedEntriesComeBack) {
+    for (CompressionType type : {kNoCompression, kSnappyCompression, kZstdCompression}) {
+        Open(type);
+        for (int32_t i = 0; i < kNumKeys; i++) {
+            Insert(i);
+        }
+        ASSERT_GT(secondary_->TotalCharge(), 0U);
+        for (int32_t i = 0; i < kNumKeys; i++) {
+            ASSERT_EQ(MakeValue(i), Lookup(i));
+        }
+        if (CompressionTypeSupported(type) && type != kNoCompression) {
+            // Saved entries are compressed.
+            ASSERT_LT(secondary_->TotalCharge(), kNumKeys * MakeValue(0).size() / 2);
+        }
+    }
+}
+
+TEST_F(SecondaryCacheTest, LookupWithoutHelperMisses) {
+    Open(kNoCompression);
+    for (int32_t i = 0; i < kNumKeys; i++) {
+        Insert(i);
+    }
+    Cache::Handle *handle = primary_->Lookup(EncodeKey(0));
+    ASSERT_TRUE(handle == nullptr);
+    ASSERT_EQ(MakeValue(0), Lookup(0));
+}
+
+TEST_F(SecondaryCacheTest, EraseAndUpdateDropSavedCopy) {
+    Open(kNoCompression);
+    for (int32_t i = 0; i < kNumKeys; i++) {
+        Insert(i);
+    }
+    // Key 0 was evicted to the secondary cache by now.
+    primary_->Erase(EncodeKey(0));
+    ASSERT_EQ("NOT_FOUND", Lookup(0));
+
+    // Overwrite key 1 in the primary cache; the stale copy must not come back.
+    std::string *value = new std::string("new-value");
+    primary_->Release(primary_->Insert(EncodeKey(1), value, value->size(), &kStringHelper, Cache::Priority::kLow));
+    primary_->Erase(EncodeKey(1));
+    ASSERT_EQ("NOT_FOUND", Lookup(1));
+
+    // Evicting the new version of key 2 replaces the saved old one.
+    value = new std::string("new-value");
+    primary_->Release(primary_->Insert(EncodeKey(2), value, value->size(), &kStringHelper, Cache::Priority::kLow));
+    for (int32_t i = 3; i < kNumKeys; i++) {
+        Insert(i);
+    }
+    ASSERT_EQ("new-value", Lookup(2));
+
+    // A new version that leaves through Prune() never reaches the secondary
+    // cache, which must not hand out the old one instead.
+    Insert(3);
+    for (int32_t i = 4; i < kNumKeys; i++) {
+        Insert(i);
+    }
+    value = new std::string("new-value");
+    primary_->Release(primary_->Insert(EncodeKey(3), value, value->size(), &kStringHelper, Cache::Priority::kLow));
+    primary_->Prune();
+    ASSERT_EQ("NOT_FOUND", Lookup(3));
+
+    // Nor does a new version without a helper, when evicted.
+    Insert(4);
+    for (int32_t i = 5; i < kNumKeys; i++) {
+        Insert(i);
+    }
+    value = new std::string("new-value");
+    primary_->Release(primary_->Insert(EncodeKey(4), value, value->size(), StringDeleter, nullptr));
+    for (int32_t i = 5; i < kNumKeys; i++) {
+        Insert(i);
+    }
+    ASSERT_EQ("NOT_FOUND", Lookup(4));
+}
+
+TEST_F(SecondaryCacheTest, EntriesWithoutHelperAreDropped) {
+    Open(kNoCompression);
+    for (int32_t i = 0; i < kNumKeys; i++) {
+        std::string *value = new std::string(MakeValue(i));
+        primary_->Release(primary_->Insert(EncodeKey(i), value, value->size(), StringDeleter, nullptr));
+    }
+    ASSERT_EQ(0, secondary_->TotalCharge());
+    ASSERT_EQ("NOT_FOUND", Lookup(0));
+}
+
+int main(int argc, char **argv) {
+    PRINT_INFO("Running main() from %s\n", __FILE__);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,8 +1,13 @@
 #include "skip_list.h"
+#include "arena.h"
+#include "concurrent_arena.h"
 #include "random.h"
 #include <set>
 #include <gtest/gtest.h>
 #include <cstdint>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 using namespace ns_data_structure;
 using namespace ns_memory;
@@ -118,6 +123,274 @@ TEST(SkipTest, InsertAndLookup) {
     }
 }
 
+TEST(SkipTest, InsertWithSplice) {
+    Random rnd(301);
+    Arena arena;
+    Comparator cmp;
+    SkipList<Key, Comparator> list(cmp, &arena);
+    SkipList<Key, Comparator>::Splice splice;
+    set<Key> keys;
+    auto insert = [&](Key key, bool use_splice) {
+        if (keys.insert(key).second) {
+            if (use_splice) {
+                list.Insert(key, &splice);
+            } else {
+                list.Insert(key);
+            }
+        }
+    };
+    // Ascending and descending runs, random keys, and plain inserts that
+    // invalidate the splice behind its back.
+    for (Key key = 1000; key < 20000; key += 2) {
+        insert(key, true);
+    }
+    for (Key key = 19999; key > 1000; key -= 2) {
+        insert(key, true);
+    }
+    for (int i = 0; i < 20000; i++) {
+        insert(rnd.Next() % 100000, rnd.OneIn(3));
+    }
+    SkipList<Key, Comparator>::Iterator iter(&list);
+    iter.SeekToFirst();
+    for (Key key : keys) {
+        ASSERT_TRUE(iter.Valid());
+        ASSERT_EQ(key, iter.key());
+        iter.Next();
+    }
+    ASSERT_TRUE(!iter.Valid());
+}
+
+TEST(SkipTest, SpliceKeepsUpperLevels) {
+    // Both lists draw the same node heights for the same insert sequence, so
+    // the splice list must link exactly as many nodes at every level as the
+    // one built with plain inserts.
+    Random rnd(301);
+    Arena arena;
+    Comparator cmp;
+    SkipList<Key, Comparator> list(cmp, &arena);
+    SkipList<Key, Comparator> expected(cmp, &arena);
+    SkipList<Key, Comparator>::Splice splice;
+    set<Key> keys;
+    auto insert = [&](Key key, bool use_splice) {
+        if (keys.insert(key).second) {
+            if (use_splice) {
+                list.Insert(key, &splice);
+            } else {
+                list.Insert(key);
+            }
+            expected.Insert(key);
+        }
+    };
+    // Plain inserts just behind an ascending splice run land in its upper
+    // gaps while its lower ones stay good.
+    for (Key key = 1000; key < 100000; key += 10) {
+        insert(key, true);
+        if (rnd.OneIn(2)) {
+            insert(key - 1 - rnd.Uniform(200), false);
+        }
+    }
+    for (int i = 0; i < 20000; i++) {
+        insert(rnd.Next() % 200000, rnd.OneIn(3));
+    }
+    for (int32_t level = 0; level < kMaxHeight; level++) {
+        ASSERT_EQ(expected.CountAtLevel(level), list.CountAtLevel(level)) << "level " << level;
+    }
+    ASSERT_EQ(keys.size(), list.CountAtLevel(0));
+}
+
+TEST(SkipTest, MultiSeek) {
+    static constexpr int kNumTargets = 100;
+    Random rnd(301);
+    Arena arena;
+    Comparator cmp;
+    SkipList<Key, Comparator> list(cmp, &arena);
+    for (int i = 0; i < 10000; i++) {
+        list.Insert(static_cast<Key>(i) * 10);
+    }
+    // Hits, misses, and targets before the first and after the last key.
+    Key targets[kNumTargets];
+    for (int i = 0; i < kNumTargets; i++) {
+        targets[i] = rnd.Uniform(100100);
+    }
+    targets[0] = 0;
+    targets[1] = 100000;
+    std::vector<SkipList<Key, Comparator>::Iterator> iters(kNumTargets, SkipList<Key, Comparator>::Iterator(&list));
+    std::vector<SkipList<Key, Comparator>::Iterator *> iter_ptrs;
+    for (SkipList<Key, Comparator>::Iterator &iter : iters) {
+        iter_ptrs.push_back(&iter);
+    }
+    list.MultiSeek(targets, kNumTargets, iter_ptrs.data());
+    for (int i = 0; i < kNumTargets; i++) {
+        SkipList<Key, Comparator>::Iterator expected(&list);
+        expected.Seek(targets[i]);
+        ASSERT_EQ(expected.Valid(), iters[i].Valid());
+        if (expected.Valid()) {
+            ASSERT_EQ(expected.key(), iters[i].key());
+        }
+    }
+}
+
+TEST(SkipTest, HugePageArena) {
+    Random rnd(301);
+    Arena arena(Arena::kHugePageSize, true);
+    Comparator cmp;
+    SkipList<Key, Comparator> list(cmp, &arena);
+    set<Key> keys;
+    for (int i = 0; i < 100000; i++) {
+        Key key = rnd.Next();
+        if (keys.insert(key).second) {
+            list.Insert(key);
+        }
+    }
+    SkipList<Key, Comparator>::Iterator iter(&list);
+    iter.SeekToFirst();
+    for (Key key : keys) {
+        ASSERT_TRUE(iter.Valid());
+        ASSERT_EQ(key, iter.key());
+        iter.Next();
+    }
+    ASSERT_TRUE(!iter.Valid());
+    // Usage is counted in whole huge-page blocks.
+    ASSERT_GE(arena.MemoryUsage(), Arena::kHugePageSize);
+    ASSERT_LT(arena.MemoryUsage() % Arena::kHugePageSize, 4096U);
+}
+
+TEST(SkipTest, InsertConcurrently) {
+    static constexpr int kNumThreads = 4;
+    static constexpr int kKeysPerThread = 50000;
+    ConcurrentArena arena;
+    Comparator cmp;
+    SkipList<Key, Comparator> list(cmp, &arena);
+    std::atomic<int> writers_done(0);
+
+    // Writers interleave their keys so that they keep contending for the
+    // same gaps.
+    std::vector<std::thread> writers;
+    for (int t = 0; t < kNumThreads; t++) {
+        writers.emplace_back([&list, &writers_done, t]() {
+            Random rnd(1000 + t);
+            for (int i = 0; i < kKeysPerThread; i++) {
+                list.InsertConcurrently(static_cast<Key>(rnd.Next() % 1024) << 32 | (i * kNumThreads + t));
+            }
+            writers_done.fetch_add(1);
+        });
+    }
+    // Readers only ever see sorted lists while writers are running.
+    std::thread reader([&list, &writers_done]() {
+        while (writers_done.load() < kNumThreads) {
+            SkipList<Key, Comparator>::Iterator iter(&list);
+            iter.SeekToFirst();
+            Key last = 0;
+            while (iter.Valid()) {
+                ASSERT_LE(last, iter.key());
+                last = iter.key();
+                iter.Next();
+            }
+        }
+    });
+    for (std::thread &writer : writers) {
+        writer.join();
+    }
+    reader.join();
+
+    set<Key> keys;
+    for (int t = 0; t < kNumThreads; t++) {
+        Random rnd(1000 + t);
+        for (int i = 0; i < kKeysPerThread; i++) {
+            keys.insert(static_cast<Key>(rnd.Next() % 1024) << 32 | (i * kNumThreads + t));
+        }
+    }
+    SkipList<Key, Comparator>::Iterator iter(&list);
+    iter.SeekToFirst();
+    for (Key key : keys) {
+        ASSERT_TRUE(iter.Valid());
+        ASSERT_EQ(key, iter.key());
+        ASSERT_TRUE(list.Contains(key));
+        iter.Next();
+    }
+    ASSERT_TRUE(!iter.Valid());
+}
+
+// Benchmarks are opt-in: run with --gtest_also_run_disabled_tests.
+// Builds a skiplist of kNumKeys random keys in arena and returns the
+// average time of a random Seek() in nanoseconds.
+static double MeasureSeek(Arena *arena) {
+    static constexpr int kNumKeys = 2000000;
+    static constexpr int kNumSeeks = 1000000;
+    Random rnd(301);
+    Comparator cmp;
+    SkipList<Key, Comparator> list(cmp, arena);
+    for (int i = 0; i < kNumKeys; i++) {
+        list.Insert((static_cast<Key>(rnd.Next()) << 32) | i);
+    }
+    SkipList<Key, Comparator>::Iterator iter(&list);
+    Key sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kNumSeeks; i++) {
+        iter.Seek(static_cast<Key>(rnd.Next()) << 32);
+        if (iter.Valid()) {
+            sum += iter.key();
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_NE(0U, sum);
+    return elapsed.count() / kNumSeeks;
+}
+
+TEST(SkipBenchmark, DISABLED_SeekWithHugePages) {
+    Arena small_blocks;
+    double const small_ns = MeasureSeek(&small_blocks);
+    Arena huge_pages(Arena::kHugePageSize, true);
+    double const huge_ns = MeasureSeek(&huge_pages);
+    PRINT_INFO("Seek: 4KB blocks %.1f ns/op (%llu bytes), huge pages %.1f ns/op (%llu bytes)\n",
+               small_ns, static_cast<unsigned long long>(small_blocks.MemoryUsage()),
+               huge_ns, static_cast<unsigned long long>(huge_pages.MemoryUsage()));
+}
+
+TEST(SkipBenchmark, DISABLED_MultiSeek) {
+    static constexpr int kNumKeys = 2000000;
+    static constexpr int kNumSeeks = 1000000;
+    using List = SkipList<Key, Comparator>;
+    Random rnd(301);
+    Arena arena;
+    Comparator cmp;
+    List list(cmp, &arena);
+    for (int i = 0; i < kNumKeys; i++) {
+        list.Insert((static_cast<Key>(rnd.Next()) << 32) | i);
+    }
+    std::vector<Key> targets(kNumSeeks);
+    for (Key &target : targets) {
+        target = static_cast<Key>(rnd.Next()) << 32;
+    }
+
+    List::Iterator iter(&list);
+    Key sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (Key target : targets) {
+        iter.Seek(target);
+        sum += iter.Valid() ? iter.key() : 0;
+    }
+    std::chrono::duration<double, std::nano> seek_elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<List::Iterator> iters(List::kSeekGroupSize, List::Iterator(&list));
+    std::vector<List::Iterator *> iter_ptrs;
+    for (List::Iterator &it : iters) {
+        iter_ptrs.push_back(&it);
+    }
+    Key multi_sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kNumSeeks; i += List::kSeekGroupSize) {
+        list.MultiSeek(&targets[i], List::kSeekGroupSize, iter_ptrs.data());
+        for (List::Iterator &it : iters) {
+            multi_sum += it.Valid() ? it.key() : 0;
+        }
+    }
+    std::chrono::duration<double, std::nano> multi_elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(sum, multi_sum);
+    PRINT_INFO("Seek %.1f ns/op, MultiSeek %.1f ns/op\n", seek_elapsed.count() / kNumSeeks,
+               multi_elapsed.count() / kNumSeeks);
+}
+
 int main(int argc, char **argv) {
     PRINT_INFO("Running main() from %s\n", __FILE__);
     testing::InitGoogleTest(&argc, argv);
@@ -36,17 +36,41 @@ static std::string PrintContents(WriteBatch *b) {
             state.append(")");
             count++;
             break;
+        case kTypeMerge:
+            state.append("Merge(");
+            state.append(ikey.user_key.ToString());
+            state.append(", ");
+            state.append(iter->value().ToString());
+            state.append(")");
+            count++;
+            break;
         case kTypeDeletion:
             state.append("Delete(");
             state.append(ikey.user_key.ToString());
             state.append(")");
             count++;
             break;
+        default:
+            break;
         }
         state.append("@");
         state.append(NumberToString(ikey.sequence));
     }
     delete iter;
+    iter = mem->NewRangeTombstoneIterator();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ParsedInternalKey ikey;
+        EXPECT_TRUE(ParseInternalKey(iter->key(), &ikey));
+        EXPECT_EQ(kTypeRangeDeletion, ikey.type);
+        state.append("DeleteRange(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")@");
+        state.append(NumberToString(ikey.sequence));
+        count++;
+    }
+    delete iter;
     if (!s.ok()) {
         state.append("ParseError()");
     } else if (count != WriteBatchInternal::Count(b)) {
@@ -78,6 +102,48 @@ TEST(WriteBatchTest, Multiple) {
     );
 }
 
+TEST(WriteBatchTest, DeleteRange) {
+    WriteBatch b;
+    b.Put(Slice("foo"), Slice("bar"));
+    b.DeleteRange(Slice("a"), Slice("f"));
+    b.Put(Slice("baz"), Slice("boo"));
+    b.DeleteRange(Slice("x"), Slice("z"));
+    WriteBatchInternal::SetSequence(&b, 100);
+    ASSERT_EQ(4, WriteBatchInternal::Count(&b));
+    ASSERT_EQ(
+        "Put(baz, boo)@102"
+        "Put(foo, bar)@100"
+        "DeleteRange(a, f)@101"
+        "DeleteRange(x, z)@103",
+        PrintContents(&b)
+    );
+    // The truncated end key is corrupt.
+    Slice contents = WriteBatchInternal::Contents(&b);
+    WriteBatchInternal::SetContents(&b, Slice(contents.data(), contents.size() - 1));
+    ASSERT_EQ(
+        "Put(baz, boo)@102"
+        "Put(foo, bar)@100"
+        "DeleteRange(a, f)@101"
+        "ParseError()",
+        PrintContents(&b)
+    );
+}
+
+TEST(WriteBatchTest, Merge) {
+    WriteBatch b;
+    b.Put(Slice("foo"), Slice("bar"));
+    b.Merge(Slice("foo"), Slice("baz"));
+    b.Merge(Slice("box"), Slice("c"));
+    WriteBatchInternal::SetSequence(&b, 100);
+    ASSERT_EQ(3, WriteBatchInternal::Count(&b));
+    ASSERT_EQ(
+        "Merge(box, c)@102"
+        "Merge(foo, baz)@101"
+        "Put(foo, bar)@100",
+        PrintContents(&b)
+    );
+}
+
 TEST(WriteBatchTest, Corruption) {
     WriteBatch b;
     b.Put(Slice("foo"), Slice("bar"));
@@ -0,0 +1,129 @@
+#include "log.h"
+#include "cache.h"
+#include "db_format.h"
+#include "mem_table.h"
+#include "options.h"
+#include "write_buffer_manager.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace ns_db_format;
+using namespace ns_data_structure;
+using namespace ns_comparator;
+using namespace ns_memory;
+using namespace ns_cache;
+
+static constexpr uint64_t kMB = 1024 * 1024;
+
+TEST(WriteBufferManagerTest, ShouldFlush) {
+    WriteBufferManager wbm(10 * kMB);
+    ASSERT_TRUE(wbm.enabled());
+    wbm.ReserveMem(8 * kMB);
+    ASSERT_FALSE(wbm.ShouldFlush());
+    // Mutable memtables above 7/8 of the budget.
+    wbm.ReserveMem(1 * kMB);
+    ASSERT_TRUE(wbm.ShouldFlush());
+
+    // Being flushed: no longer mutable.
+    wbm.ScheduleFreeMem(9 * kMB);
+    ASSERT_EQ(9 * kMB, wbm.memory_usage());
+    ASSERT_EQ(0, wbm.mutable_memtable_memory_usage());
+    ASSERT_FALSE(wbm.ShouldFlush());
+
+    // Over budget, but the mutable part is too small to be worth flushing.
+    wbm.ReserveMem(2 * kMB);
+    ASSERT_FALSE(wbm.ShouldFlush());
+    // Over budget with half of it mutable.
+    wbm.ReserveMem(3 * kMB);
+    ASSERT_TRUE(wbm.ShouldFlush());
+
+    wbm.FreeMem(9 * kMB);
+    ASSERT_EQ(5 * kMB, wbm.memory_usage());
+    ASSERT_FALSE(wbm.ShouldFlush());
+    wbm.ScheduleFreeMem(5 * kMB);
+    wbm.FreeMem(5 * kMB);
+    ASSERT_EQ(0, wbm.memory_usage());
+}
+
+TEST(WriteBufferManagerTest, Disabled) {
+    WriteBufferManager wbm(0);
+    ASSERT_FALSE(wbm.enabled());
+    wbm.ReserveMem(100 * kMB);
+    ASSERT_EQ(100 * kMB, wbm.memory_usage());
+    ASSERT_FALSE(wbm.ShouldFlush());
+    wbm.ScheduleFreeMem(100 * kMB);
+    wbm.FreeMem(100 * kMB);
+}
+
+TEST(WriteBufferManagerTest, MemTablesReportUsage) {
+    InternalKeyComparator cmp(BytewiseComparator());
+    WriteBufferManager wbm(1 * kMB);
+    ns_options::Options options;
+    options.arena_block_size = 64 * 1024;
+    options.write_buffer_manager = &wbm;
+    MemTable *mem1 = new MemTable(cmp, options);
+    MemTable *mem2 = new MemTable(cmp, options);
+    mem1->Ref();
+    mem2->Ref();
+    std::string const value(100, 'v');
+    SequenceNumber seq = 1;
+    while (!wbm.ShouldFlush()) {
+        mem1->Add(seq, kTypeValue, std::to_string(seq), value);
+        mem2->Add(seq, kTypeValue, std::to_string(seq), value);
+        seq++;
+    }
+    ASSERT_EQ(mem1->ApproximateMemoryUsage() + mem2->ApproximateMemoryUsage(), wbm.memory_usage());
+    ASSERT_GT(wbm.memory_usage(), 1 * kMB * 7 / 8);
+
+    mem1->MarkImmutable();
+    ASSERT_EQ(mem2->ApproximateMemoryUsage(), wbm.mutable_memtable_memory_usage());
+    ASSERT_FALSE(wbm.ShouldFlush());
+    mem1->Unref();
+    ASSERT_EQ(mem2->ApproximateMemoryUsage(), wbm.memory_usage());
+    mem2->Unref();
+    ASSERT_EQ(0, wbm.memory_usage());
+    ASSERT_EQ(0, wbm.mutable_memtable_memory_usage());
+}
+
+TEST(WriteBufferManagerTest, ChargesCache) {
+    static constexpr uint64_t kDummy = WriteBufferManager::kDummyEntrySize;
+    Cache *cache = NewLRUCache(64 * kMB);
+    {
+        WriteBufferManager wbm(32 * kMB, cache);
+        wbm.ReserveMem(1);
+        ASSERT_EQ(kDummy, wbm.dummy_entries_in_cache_usage());
+        wbm.ReserveMem(10 * kDummy);
+        ASSERT_EQ(11 * kDummy, wbm.dummy_entries_in_cache_usage());
+        ASSERT_GE(cache->TotalCharge(), 11 * kDummy);
+
+        // Small drops keep the charge, large ones give it back.
+        wbm.ScheduleFreeMem(kDummy);
+        wbm.FreeMem(kDummy);
+        ASSERT_EQ(11 * kDummy, wbm.dummy_entries_in_cache_usage());
+        uint64_t const charge_before = cache->TotalCharge();
+        wbm.ScheduleFreeMem(8 * kDummy);
+        wbm.FreeMem(8 * kDummy);
+        ASSERT_LT(wbm.dummy_entries_in_cache_usage(), 11 * kDummy);
+        ASSERT_GE(wbm.dummy_entries_in_cache_usage(), wbm.memory_usage());
+        // The cache gets the memory back right away.
+        ASSERT_EQ(charge_before - (11 * kDummy - wbm.dummy_entries_in_cache_usage()), cache->TotalCharge());
+
+        // Dummy entries are pinned: other entries are evicted instead.
+        for (int32_t i = 0; i < 1000; i++) {
+            cache->Release(cache->Insert(std::to_string(i), nullptr, kMB, [](Slice const &, void *, void *) {}, nullptr));
+        }
+        ASSERT_GE(cache->TotalCharge(), wbm.dummy_entries_in_cache_usage());
+        ASSERT_LE(cache->TotalCharge(), 64 * kMB + kMB);
+    }
+    // The manager hands its whole charge back on destruction.
+    cache->Prune();
+    ASSERT_EQ(0, cache->TotalCharge());
+    delete cache;
+}
+
+int main(int argc, char **argv) {
+    PRINT_INFO("Running main() from %s\n", __FILE__);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}